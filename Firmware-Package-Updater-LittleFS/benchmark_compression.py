@@ -0,0 +1,81 @@
+import argparse
+import os
+import time
+import zlib
+
+# Host benchmark for compressed package sections: bytes on the wire versus decompression cost.
+# Decompression is streamed the way the device does it: 8 KB input slices (WRITE_BLOCK_SIZE)
+# into a decoder with a 32 KB window. Host CPU times are only comparable with each other;
+# scale them by a measured device/host ratio before drawing conclusions about the ESP32.
+
+CHUNK_SIZE = 8192  # Matches WRITE_BLOCK_SIZE in main/web_server.c
+REPEATS = 5
+
+def collect_inputs(firmware_path, html_folder):
+    """ Returns (label, data) pairs for the firmware and every asset file """
+    inputs = []
+    with open(firmware_path, "rb") as f:
+        inputs.append(("firmware", f.read()))
+    for root, _, files in os.walk(html_folder):
+        for file in sorted(files):
+            file_path = os.path.join(root, file)
+            with open(file_path, "rb") as f:
+                inputs.append((os.path.relpath(file_path, html_folder), f.read()))
+    return inputs
+
+def stream_decompress(compressed):
+    """ Decompresses in CHUNK_SIZE slices and returns the decompressed length """
+    decompressor = zlib.decompressobj(15)  # 32 KB window, zlib header
+    total = 0
+    for offset in range(0, len(compressed), CHUNK_SIZE):
+        total += len(decompressor.decompress(compressed[offset:offset + CHUNK_SIZE]))
+    total += len(decompressor.flush())
+    return total
+
+def best_time(fn, *args):
+    best = None
+    for _ in range(REPEATS):
+        start = time.perf_counter()
+        fn(*args)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+def run(firmware_path, html_folder, link_kbps, levels):
+    inputs = collect_inputs(firmware_path, html_folder)
+    raw_total = sum(len(data) for _, data in inputs)
+    link_bytes_per_s = link_kbps * 1000 / 8
+
+    print(f"Inputs: {len(inputs)} items, {raw_total} bytes raw")
+    print(f"Link: {link_kbps} kbit/s, raw transfer {raw_total / link_bytes_per_s:.2f} s\n")
+
+    header = f"{'level':>5} {'item':<28} {'raw':>10} {'wire':>10} {'ratio':>6} {'inflate ms':>10} {'MB/s':>8}"
+    for level in levels:
+        print(header)
+        wire_total = 0
+        inflate_total = 0.0
+        for label, data in inputs:
+            compressed = zlib.compress(data, level)
+            assert stream_decompress(compressed) == len(data)
+            inflate_s = best_time(stream_decompress, compressed)
+            wire_total += len(compressed)
+            inflate_total += inflate_s
+            throughput = len(data) / inflate_s / 1e6 if inflate_s > 0 else 0
+            print(f"{level:>5} {label[:28]:<28} {len(data):>10} {len(compressed):>10} "
+                  f"{len(compressed) / max(len(data), 1):>6.2f} {inflate_s * 1000:>10.3f} {throughput:>8.1f}")
+
+        saved_s = (raw_total - wire_total) / link_bytes_per_s
+        print(f"{level:>5} {'TOTAL':<28} {raw_total:>10} {wire_total:>10} {wire_total / raw_total:>6.2f} "
+              f"{inflate_total * 1000:>10.3f}")
+        print(f"      transfer {wire_total / link_bytes_per_s:.2f} s (saves {saved_s:.2f} s), "
+              f"host inflate {inflate_total * 1000:.1f} ms\n")
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compare package bytes on the wire with streaming inflate cost")
+    parser.add_argument("firmware_bin", help="Firmware .bin file")
+    parser.add_argument("LittleFS_folder", help="Folder with the web assets")
+    parser.add_argument("--link-kbps", type=float, default=8000, help="Effective upload link speed in kbit/s")
+    parser.add_argument("--levels", type=int, nargs="+", default=[1, 6, 9], help="zlib levels to compare")
+    args = parser.parse_args()
+
+    run(args.firmware_bin, args.LittleFS_folder, args.link_kbps, args.levels)
@@ -0,0 +1,110 @@
+import argparse
+import contextlib
+import io
+import os
+import random
+import subprocess
+import tempfile
+
+from create_firmware_update_package import create_package
+
+# Host benchmark sweep for the package apply path (host/package_apply_bench.c): builds packages
+# for several web asset size distributions and applies each with every WRITE_BLOCK_SIZE x pipeline
+# buffer count binary. Flash is RAM on the host, so times only compare configurations with each
+# other; the flash operation counts carry over to the device as they are.
+
+HOST_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "host")
+FIRMWARE_SIZE = 700 * 1024
+WORDS = ["function", "return", "const", "div", "class", "style", "update", "firmware", "0x", "{", "}", ";"]
+
+# name: (file count, min size, max size); sizes are drawn log-uniformly
+DISTRIBUTIONS = {
+    "few-large": (4, 96 * 1024, 160 * 1024),
+    "mixed": (40, 1024, 64 * 1024),
+    "many-small": (256, 256, 4096),
+}
+
+def text_like(rng, size):
+    """ Compressible filler that deflates roughly like minified web assets """
+    out = bytearray()
+    while len(out) < size:
+        out += rng.choice(WORDS).encode() + (b"%d " % rng.randrange(1000))
+    return bytes(out[:size])
+
+def make_assets(folder, distribution, rng):
+    count, low, high = DISTRIBUTIONS[distribution]
+    os.makedirs(folder)
+    total = 0
+    for i in range(count):
+        size = int(low * (high / low) ** rng.random())
+        # Flat names: the device's LittleFS does not create parent directories for package files
+        with open(os.path.join(folder, f"asset{i:03d}.js"), "wb") as f:
+            f.write(text_like(rng, size))
+        total += size
+    return count, total
+
+def make_firmware(path, rng):
+    data = bytearray(rng.randbytes(FIRMWARE_SIZE))
+    data[0] = 0xE9  # ESP_IMAGE_HEADER_MAGIC, checked by esp_ota_write
+    with open(path, "wb") as f:
+        f.write(data)
+
+def build(build_dir, block_sizes, buffer_counts):
+    subprocess.run(["cmake", "-S", HOST_DIR, "-B", build_dir,
+                    "-DWRITE_BLOCK_SIZES=" + ";".join(map(str, block_sizes)),
+                    "-DPIPELINE_BUFFER_COUNTS=" + ";".join(map(str, buffer_counts))],
+                   check=True, stdout=subprocess.DEVNULL)
+    subprocess.run(["cmake", "--build", build_dir, "-j"], check=True, stdout=subprocess.DEVNULL)
+
+def run_bench(build_dir, block_size, buffer_count, package, repeats):
+    binary = os.path.join(build_dir, f"package_apply_bench_{block_size}x{buffer_count}")
+    out = subprocess.run([binary, "--csv", package, str(repeats)], check=True, capture_output=True, text=True)
+    fields = out.stdout.strip().split(",")
+    keys = ["block", "buffers", "size", "total_ms", "firmware_ms", "littlefs_ms", "mb_s", "peak_heap",
+            "ota_writes", "ota_erases", "web_writes", "web_unaligned", "web_erases",
+            "ota_unaligned", "file_writes", "file_unaligned"]
+    return dict(zip(keys, map(float, fields)))
+
+def run(args):
+    rng = random.Random(args.seed)
+    build(args.build_dir, args.block_sizes, args.buffer_counts)
+
+    header = (f"{'assets':<11} {'pkg':<4} {'block':>6} {'bufs':>4} {'total ms':>9} {'fw ms':>8} {'lfs ms':>8} "
+              f"{'MB/s':>7} {'heap KB':>8} {'ota wr':>6} {'unalgn':>6} {'web wr':>6} {'unalgn':>6} {'erases':>6}")
+    with tempfile.TemporaryDirectory() as work:
+        firmware = args.firmware
+        if not firmware:
+            firmware = os.path.join(work, "firmware.bin")
+            make_firmware(firmware, rng)
+
+        for distribution in args.distributions:
+            assets = os.path.join(work, distribution)
+            count, total = make_assets(assets, distribution, rng)
+            print(f"\n{distribution}: {count} files, {total} bytes")
+            print(header)
+            for compress in args.formats:
+                package = os.path.join(work, f"{distribution}_{compress}.pkg")
+                with contextlib.redirect_stdout(io.StringIO()):
+                    create_package(firmware, assets, package, compress=(compress == "zlib"), gzip_assets=False)
+                for block_size in args.block_sizes:
+                    for buffer_count in args.buffer_counts:
+                        r = run_bench(args.build_dir, block_size, buffer_count, package, args.repeats)
+                        print(f"{distribution:<11} {compress:<4} {block_size:>6} {buffer_count:>4} "
+                              f"{r['total_ms']:>9.2f} {r['firmware_ms']:>8.2f} {r['littlefs_ms']:>8.2f} "
+                              f"{r['mb_s']:>7.1f} {r['peak_heap'] / 1024:>8.1f} {int(r['ota_writes']):>6} {int(r['ota_unaligned']):>6} "
+                              f"{int(r['web_writes']):>6} {int(r['web_unaligned']):>6} "
+                              f"{int(r['ota_erases'] + r['web_erases']):>6}")
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Sweep the host package apply benchmark over pipeline settings")
+    parser.add_argument("--firmware", help="Firmware .bin to package (default: random 700 KB image)")
+    parser.add_argument("--distributions", nargs="+", choices=DISTRIBUTIONS.keys(), default=list(DISTRIBUTIONS))
+    parser.add_argument("--formats", nargs="+", choices=["raw", "zlib"], default=["raw", "zlib"])
+    parser.add_argument("--block-sizes", type=int, nargs="+", default=[4096, 8192, 16384], help="WRITE_BLOCK_SIZE values")
+    parser.add_argument("--buffer-counts", type=int, nargs="+", default=[2, 4, 8], help="UPDATE_PIPELINE_BUFFER_COUNT values")
+    parser.add_argument("--repeats", type=int, default=5, help="Runs per configuration; the fastest is reported")
+    parser.add_argument("--build-dir", default="build_host", help="CMake build directory for host/")
+    parser.add_argument("--seed", type=int, default=1, help="Seed for the generated firmware and assets")
+    args = parser.parse_args()
+
+    run(args)
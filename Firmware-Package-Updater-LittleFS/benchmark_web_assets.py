@@ -0,0 +1,77 @@
+import argparse
+import http.client
+import os
+import random
+import statistics
+import time
+import urllib.parse
+
+# Device benchmark for the static file path: requests each asset repeatedly over one keep-alive
+# connection and reports requests per second and time-to-last-byte. Run it against the firmware
+# before and after a change (--label tags the CSV rows) to compare the two.
+
+ASSET_SIZES = {"bench_4k.bin": 4 * 1024, "bench_64k.bin": 64 * 1024, "bench_512k.bin": 512 * 1024}
+
+def make_assets(folder, seed=1):
+    """ Writes incompressible test assets of each size (no .gz variants are worth keeping for them) """
+    rng = random.Random(seed)
+    os.makedirs(folder, exist_ok=True)
+    for name, size in ASSET_SIZES.items():
+        with open(os.path.join(folder, name), "wb") as f:
+            f.write(rng.randbytes(size))
+        print(f"Wrote {os.path.join(folder, name)} ({size} bytes)")
+
+def measure(host, port, path, requests, timeout):
+    """ Returns (body size, framing, per-request seconds to the last byte, total seconds) """
+    connection = http.client.HTTPConnection(host, port, timeout=timeout)
+    times = []
+    size = 0
+    framing = ""
+    start = time.perf_counter()
+    for _ in range(requests):
+        request_start = time.perf_counter()
+        connection.request("GET", path, headers={"Accept-Encoding": "identity"})
+        response = connection.getresponse()
+        body = response.read()
+        times.append(time.perf_counter() - request_start)
+        if response.status != 200:
+            raise RuntimeError(f"GET {path}: HTTP {response.status}")
+        size = len(body)
+        framing = "chunked" if response.getheader("Transfer-Encoding") == "chunked" else "content-length"
+        if response.will_close:
+            connection.close()
+            connection = http.client.HTTPConnection(host, port, timeout=timeout)
+    total = time.perf_counter() - start
+    connection.close()
+    return size, framing, times, total
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Measure static asset requests per second and time-to-last-byte on the device")
+    parser.add_argument("device", nargs="?", default="http://192.168.4.1", help="Device base URL (default http://192.168.4.1)")
+    parser.add_argument("paths", nargs="*", help="Asset paths to request (default: /bench_4k.bin /bench_64k.bin /bench_512k.bin)")
+    parser.add_argument("--requests", type=int, default=50, help="Requests per asset (default 50)")
+    parser.add_argument("--timeout", type=float, default=30, help="Socket timeout in seconds")
+    parser.add_argument("--label", default="", help="Tag for the CSV rows, e.g. the firmware version")
+    parser.add_argument("--csv", action="store_true", help="Print CSV rows instead of a table")
+    parser.add_argument("--make-assets", metavar="FOLDER", help="Only write the 4 KB, 64 KB and 512 KB test assets to FOLDER")
+    args = parser.parse_args()
+
+    if args.make_assets:
+        make_assets(args.make_assets)
+        raise SystemExit(0)
+
+    url = urllib.parse.urlsplit(args.device)
+    paths = args.paths or ["/" + name for name in ASSET_SIZES]
+    if args.csv:
+        print("label,path,bytes,framing,requests,requests_per_s,ttlb_median_ms,ttlb_p95_ms,throughput_kb_s")
+    for path in paths:
+        size, framing, times, total = measure(url.hostname, url.port or 80, path, args.requests, args.timeout)
+        rps = len(times) / total
+        median_ms = statistics.median(times) * 1000
+        p95_ms = sorted(times)[max(0, int(len(times) * 0.95) - 1)] * 1000
+        throughput = size * len(times) / total / 1024
+        if args.csv:
+            print(f"{args.label},{path},{size},{framing},{len(times)},{rps:.2f},{median_ms:.1f},{p95_ms:.1f},{throughput:.1f}")
+        else:
+            print(f"{path}: {size} bytes ({framing}), {rps:.2f} req/s, time-to-last-byte median {median_ms:.1f} ms, "
+                  f"p95 {p95_ms:.1f} ms, {throughput:.1f} KB/s")
@@ -1,4 +1,7 @@
 #include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <esp_system.h>
@@ -6,6 +9,7 @@
 #include <esp_log.h>
 #include <esp_ota_ops.h>
 #include <esp_http_client.h>
+#include <esp_timer.h>
 #include <esp_flash_partitions.h>
 #include <esp_partition.h>
 #include <nvs.h>
@@ -13,12 +17,31 @@
 #include <driver/gpio.h>
 #include <esp_app_format.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <sys/param.h>
+#include <mbedtls/sha256.h>
+#include "pkg_parser.h"
+#include "ota.h"
+#include "ota_writer.h"
 
-#define BUFFSIZE 1024
+#define BUFFSIZE 4096      // One flash sector per read
 #define HASH_LEN 32 // SHA-256 digest length
 
+// Resumable download settings
+#define DOWNLOAD_CHECKPOINT_INTERVAL (64 * 1024)   // Download bytes between NVS checkpoints (a multiple of the flash sector)
+#define DOWNLOAD_MAX_RETRIES 8                      // Reconnects in a row without progress before giving up
+#define DOWNLOAD_BACKOFF_MIN_MS 1000                // First reconnect delay, doubled on every failure in a row
+#define DOWNLOAD_BACKOFF_MAX_MS 60000
+#define DOWNLOAD_URL_MAX_LEN 256                    // Longer URLs still resume within one boot, but not after a reboot
+#define DOWNLOAD_ETAG_MAX_LEN 64
+#define DOWNLOAD_RECORD_LAYOUT 1                    // Bump whenever download_record_t changes
+
+#define NVS_NAMESPACE "ota_download"
+#define NVS_KEY_RECORD "record"
+
 static const char *TAG = "ota_app";
 static char ota_write_data[BUFFSIZE + 1] = { 0 };
+static ota_prepare_slot_fn prepare_slot_hook;   // Set by the application, see ota_set_prepare_slot_hook()
 
 esp_err_t validate_image_header(esp_app_desc_t *new_app_info)
 {
@@ -42,122 +65,692 @@ esp_err_t validate_image_header(esp_app_desc_t *new_app_info)
     return ESP_OK;
 }
 
-esp_err_t perform_ota_update(const char *url)
-{
-    esp_err_t err;
-    esp_ota_handle_t update_handle = 0;
-    const esp_partition_t *update_partition = NULL;
+// What NVS keeps for an interrupted download; written at checkpoints, so a reboot sees the last one
+typedef struct {
+    uint32_t layout;                    // DOWNLOAD_RECORD_LAYOUT
+    char url[DOWNLOAD_URL_MAX_LEN + 1];
+    char etag[DOWNLOAD_ETAG_MAX_LEN + 1];   // Strong validator sent as If-Range, "" if the server sent none
+    uint32_t size;                      // Bytes in the whole download
+    uint32_t offset;                    // Download bytes consumed
+    uint32_t partition_address;         // OTA slot being written
+    uint32_t resumes;
+    bool is_package;
+    bool app_done;                      // Package: the app section is complete on flash
+    pkg_header_t header;                // Package only
+    mbedtls_sha256_context sha;         // Software copy of the running hash (mbedtls_sha256_clone)
+} download_record_t;
 
-    // Configure HTTP client
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 5000,
-        .keep_alive_enable = true,
-    };
+// A download applied by perform_ota_update(): a raw app image, or the firmware section of an update package.
+// It survives reconnects within one boot as it is, and reboots through the record in NVS.
+typedef struct {
+    const char *url;
+    const esp_partition_t *partition;
+    ota_writer_t writer;
+    bool started;                       // `writer` holds an unfinished app image
+    bool app_done;
+    bool image_header_checked;
+    bool format_checked;
+    bool is_package;
+    uint32_t size;                      // Bytes in the whole download, 0 while unknown (chunked)
+    uint32_t offset;                    // Download bytes consumed
+    uint32_t received;                  // Bytes consumed by the current attempt
+    uint32_t checkpoint_offset;         // Offset of the last record stored in NVS
+    uint32_t resumes;                   // Requests that continued at an offset, over all attempts and reboots
+    char etag[DOWNLOAD_ETAG_MAX_LEN + 1];
+    mbedtls_sha256_context sha;         // Digest of the current package section, or of the whole raw image
+    esp_err_t err;                      // Why a parser callback stopped the download
+    bool transport_failed;              // The attempt failed on the network side; worth reconnecting
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (client == NULL) {
-        ESP_LOGE(TAG, "Failed to initialize HTTP connection");
-        return ESP_FAIL;
-    }
+    // Headers of the current response
+    char response_etag[DOWNLOAD_ETAG_MAX_LEN + 1];
+    int64_t range_start;                // Content-Range of a 206, -1 without one
+    uint32_t range_total;
+} ota_download_t;
+
+static pkg_parser_t package_parser;
 
-    err = esp_http_client_open(client, 0);
+static esp_err_t record_load(download_record_t *record)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
         return err;
     }
+    size_t size = sizeof(download_record_t);
+    err = nvs_get_blob(nvs, NVS_KEY_RECORD, record, &size);
+    nvs_close(nvs);
+    if (err == ESP_OK && (size != sizeof(download_record_t) || record->layout != DOWNLOAD_RECORD_LAYOUT)) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    return err;
+}
 
-    esp_http_client_fetch_headers(client);
+static esp_err_t record_store(const download_record_t *record)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, NVS_KEY_RECORD, record, sizeof(download_record_t));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
 
-    update_partition = esp_ota_get_next_update_partition(NULL);
-    if (update_partition == NULL) {
-        ESP_LOGE(TAG, "Failed to get next OTA partition");
-        esp_http_client_cleanup(client);
-        return ESP_FAIL;
+static void record_erase(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, NVS_KEY_RECORD);
+        nvs_commit(nvs);
+        nvs_close(nvs);
     }
+}
 
+// Starts the app image, or continues one whose first `written` bytes (sector aligned) are on flash.
+// Images of known size are erased ahead of the writes, which is what lets them resume after a reboot.
+static esp_err_t download_begin(ota_download_t *download, size_t image_size, size_t written)
+{
     ESP_LOGI(TAG, "Writing to partition subtype %" PRIu32 " at offset 0x%" PRIx32,
-         (uint32_t)update_partition->subtype, (uint32_t)update_partition->address);
+         (uint32_t)download->partition->subtype, (uint32_t)download->partition->address);
 
-    err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
+    esp_err_t err = (written > 0)
+        ? ota_writer_resume(&download->writer, download->partition, image_size, written)
+        : ota_writer_begin(&download->writer, download->partition, image_size, image_size > 0);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_begin failed (%s)", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
+        ESP_LOGE(TAG, "Failed to start the OTA image (%s)", esp_err_to_name(err));
         return err;
     }
+    download->started = true;
+    download->image_header_checked = (written > 0);
+    return ESP_OK;
+}
 
-    bool image_header_was_checked = false;
-    int binary_file_length = 0;
-    
-    while (1) {
-        int data_read = esp_http_client_read(client, ota_write_data, BUFFSIZE);
-        if (data_read < 0) {
-            ESP_LOGE(TAG, "Error reading data");
-            esp_http_client_cleanup(client);
-            esp_ota_abort(update_handle);
-            return ESP_FAIL;
-        } else if (data_read > 0) {
-            if (image_header_was_checked == false) {
-                esp_app_desc_t new_app_info;
-                if (data_read > sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                    memcpy(&new_app_info, &ota_write_data[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], sizeof(esp_app_desc_t));
-                    err = validate_image_header(&new_app_info);
-                    if (err != ESP_OK) {
-                        esp_ota_abort(update_handle);
-                        esp_http_client_cleanup(client);
-                        return err;
-                    }
-                    image_header_was_checked = true;
-                }
-            }
-
-            err = esp_ota_write(update_handle, (const void *)ota_write_data, data_read);
+static esp_err_t download_write(ota_download_t *download, const uint8_t *data, size_t len)
+{
+    if (download->image_header_checked == false) {
+        esp_app_desc_t new_app_info;
+        if (len > sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
+            memcpy(&new_app_info, &data[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], sizeof(esp_app_desc_t));
+            esp_err_t err = validate_image_header(&new_app_info);
             if (err != ESP_OK) {
-                esp_ota_abort(update_handle);
-                esp_http_client_cleanup(client);
                 return err;
             }
-            binary_file_length += data_read;
-            ESP_LOGD(TAG, "Written image length %d", binary_file_length);
-        } else if (data_read == 0) {
-            if (errno == ECONNRESET || errno == ENOTCONN) {
-                ESP_LOGE(TAG, "Connection closed, errno = %d", errno);
-                break;
+            download->image_header_checked = true;
+        }
+    }
+
+    esp_err_t err = ota_writer_write(&download->writer, data, len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ESP_LOGD(TAG, "Written image length %u", (unsigned)(download->writer.written + download->writer.staged));
+    return ESP_OK;
+}
+
+// Drops everything downloaded so far, for a file that changed on the server
+static void download_restart(ota_download_t *download)
+{
+    if (download->started) {
+        ota_writer_abort(&download->writer);
+    }
+    download->started = false;
+    download->app_done = false;
+    download->image_header_checked = false;
+    download->format_checked = false;
+    download->is_package = false;
+    download->size = 0;
+    download->offset = 0;
+    download->checkpoint_offset = 0;
+    download->etag[0] = '\0';
+    mbedtls_sha256_starts(&download->sha, 0);
+    record_erase();
+}
+
+// Package parser callbacks. Only the app section is applied here: decompression, delta
+// patching, the web banks and data partitions live in the application's package upload.
+// A package carrying anything else is refused before a byte is written, rather than
+// booting firmware without the assets or partitions it was packaged with.
+static int download_header(void *ctx, const pkg_header_t *header)
+{
+    ota_download_t *download = ctx;
+    uint32_t apps = 0;
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        if (header->sections[i].type != PKG_SECTION_APP) {
+            ESP_LOGE(TAG, "Section of type %" PRIu32 " is not supported by the OTA download, use the package upload",
+                     header->sections[i].type);
+            download->err = ESP_ERR_NOT_SUPPORTED;
+            return -1;
+        }
+        if (header->sections[i].encoding != 0) {
+            ESP_LOGE(TAG, "Compressed or delta firmware is not supported by the OTA download");
+            download->err = ESP_ERR_NOT_SUPPORTED;
+            return -1;
+        }
+        apps++;
+    }
+    if (apps != 1) {
+        ESP_LOGE(TAG, "Package must contain exactly one app section (%" PRIu32 " found)", apps);
+        download->err = ESP_ERR_NOT_SUPPORTED;
+        return -1;
+    }
+    ESP_LOGI(TAG, "Package v%" PRIu32 ": %" PRIu32 " sections", header->version, header->section_count);
+    return PKG_PARSER_OK;
+}
+
+static int download_section_begin(void *ctx, const pkg_section_t *section)
+{
+    ota_download_t *download = ctx;
+    mbedtls_sha256_starts(&download->sha, 0);
+    if (section->type == PKG_SECTION_APP) {
+        download->err = download_begin(download, section->length, 0);
+        return download->err == ESP_OK ? PKG_PARSER_OK : -1;
+    }
+    return PKG_PARSER_OK;
+}
+
+static int download_section_data(void *ctx, const pkg_section_t *section, const uint8_t *data, size_t len)
+{
+    ota_download_t *download = ctx;
+    if (section->verify) {
+        mbedtls_sha256_update(&download->sha, data, len);
+    }
+    return PKG_PARSER_OK;
+}
+
+static int download_stream_data(void *ctx, const pkg_section_t *section, const uint8_t *data, size_t len)
+{
+    ota_download_t *download = ctx;
+    if (section->type != PKG_SECTION_APP) {
+        return PKG_PARSER_OK;
+    }
+    download->err = download_write(download, data, len);
+    return download->err == ESP_OK ? PKG_PARSER_OK : -1;
+}
+
+static int download_section_end(void *ctx, const pkg_section_t *section)
+{
+    ota_download_t *download = ctx;
+    if (section->verify) {
+        uint8_t actual[HASH_LEN];
+        mbedtls_sha256_finish(&download->sha, actual);
+        if (memcmp(actual, section->sha256, HASH_LEN) != 0) {
+            ESP_LOGE(TAG, "Section %" PRIu32 " SHA-256 mismatch", section->type);
+            download->err = ESP_ERR_INVALID_CRC;
+            return -1;
+        }
+    }
+    if (section->type == PKG_SECTION_APP) {
+        download->err = ota_writer_end(&download->writer);
+        if (download->err != ESP_OK) {
+            return -1;
+        }
+        ota_writer_log_timing(&download->writer);
+        download->started = false;
+        download->app_done = true;
+    }
+    return PKG_PARSER_OK;
+}
+
+static const pkg_parser_callbacks_t download_callbacks = {
+    .header = download_header,
+    .section_begin = download_section_begin,
+    .section_data = download_section_data,
+    .stream_data = download_stream_data,
+    .section_end = download_section_end,
+};
+
+// Package section being parsed, NULL before the header is complete
+static const pkg_section_t *current_section(void)
+{
+    pkg_parser_state_t state = pkg_parser_state(&package_parser);
+    if (state == PKG_STATE_MAGIC || state == PKG_STATE_HEADER || state == PKG_STATE_SECTION_TABLE ||
+        state == PKG_STATE_DONE || state == PKG_STATE_ERROR) {
+        return NULL;
+    }
+    return &package_parser.header.sections[pkg_parser_section(&package_parser)];
+}
+
+// true in the app section's data, where checkpoints fall every DOWNLOAD_CHECKPOINT_INTERVAL image bytes
+static bool in_app_stream(const pkg_section_t *section)
+{
+    return section && section->type == PKG_SECTION_APP && pkg_parser_state(&package_parser) == PKG_STATE_STREAM;
+}
+
+// Download bytes to process before the next position a checkpoint may be taken at. Package slices
+// also end where the parser's current item ends, as in the package upload.
+static size_t slice_limit(const ota_download_t *download)
+{
+    if (!download->is_package) {
+        return DOWNLOAD_CHECKPOINT_INTERVAL - download->offset % DOWNLOAD_CHECKPOINT_INTERVAL;
+    }
+    size_t want = pkg_parser_wants(&package_parser);
+    const pkg_section_t *section = current_section();
+    if (in_app_stream(section)) {
+        uint32_t written = download->offset - section->offset;
+        want = MIN(want, DOWNLOAD_CHECKPOINT_INTERVAL - written % DOWNLOAD_CHECKPOINT_INTERVAL);
+    }
+    return want > 0 ? want : SIZE_MAX;
+}
+
+// Checkpoints go where a reboot can pick up again: the start of a package section, and sector-aligned
+// positions of an app image the writer erases ahead (an erase-all slot always starts over)
+static bool checkpoint_due(const ota_download_t *download)
+{
+    if (download->size == 0 || strlen(download->url) > DOWNLOAD_URL_MAX_LEN ||
+        download->offset == download->checkpoint_offset || download->offset >= download->size) {
+        return false;
+    }
+    if (download->started && (!download->writer.erase_ahead || download->writer.staged > 0)) {
+        return false;
+    }
+    if (!download->is_package) {
+        return download->offset % DOWNLOAD_CHECKPOINT_INTERVAL == 0;
+    }
+    const pkg_section_t *section = current_section();
+    if (!section) {
+        return false;
+    }
+    uint32_t into_section = download->offset - section->offset;
+    return into_section == 0 || (in_app_stream(section) && into_section % DOWNLOAD_CHECKPOINT_INTERVAL == 0);
+}
+
+// A failed checkpoint only costs the progress since the previous one, so the download carries on
+static void take_checkpoint(ota_download_t *download)
+{
+    download_record_t *record = calloc(1, sizeof(download_record_t));
+    if (!record) {
+        return;
+    }
+    record->layout = DOWNLOAD_RECORD_LAYOUT;
+    strcpy(record->url, download->url);
+    strcpy(record->etag, download->etag);
+    record->size = download->size;
+    record->offset = download->offset;
+    record->partition_address = download->partition->address;
+    record->resumes = download->resumes;
+    record->is_package = download->is_package;
+    record->app_done = download->app_done;
+    if (download->is_package) {
+        record->header = package_parser.header;
+    }
+    mbedtls_sha256_init(&record->sha);
+    mbedtls_sha256_clone(&record->sha, &download->sha);
+
+    esp_err_t err = record_store(record);
+    mbedtls_sha256_free(&record->sha);
+    free(record);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save download checkpoint (%s)", esp_err_to_name(err));
+        return;
+    }
+    download->checkpoint_offset = download->offset;
+    ESP_LOGD(TAG, "Checkpoint at offset %" PRIu32, download->offset);
+}
+
+// Picks up the download this URL left in NVS before a reboot. The slot still holds the image up to the
+// checkpoint, so the writer continues after it and the parser re-enters the section it was in.
+static bool download_resume(ota_download_t *download)
+{
+    download_record_t *record = malloc(sizeof(download_record_t));
+    if (!record) {
+        return false;
+    }
+    if (record_load(record) != ESP_OK) {
+        free(record);
+        return false;
+    }
+    if (strcmp(record->url, download->url) != 0 || record->partition_address != download->partition->address) {
+        ESP_LOGI(TAG, "Discarding the interrupted download of %s", record->url);
+        free(record);
+        record_erase();
+        return false;
+    }
+
+    download->size = record->size;
+    download->offset = record->offset;
+    download->checkpoint_offset = record->offset;
+    download->resumes = record->resumes;
+    download->is_package = record->is_package;
+    download->app_done = record->app_done;
+    download->format_checked = true;
+    strcpy(download->etag, record->etag);
+    mbedtls_sha256_clone(&download->sha, &record->sha);
+
+    esp_err_t err = ESP_OK;
+    if (download->is_package) {
+        // A checkpoint of an older firmware may hold a package this one refuses
+        if (download_header(download, &record->header) != PKG_PARSER_OK ||
+            pkg_parser_resume(&package_parser, &download_callbacks, download, &record->header, record->offset) != PKG_PARSER_OK) {
+            err = ESP_ERR_INVALID_STATE;
+        } else {
+            const pkg_section_t *section = current_section();
+            if (section && section->type == PKG_SECTION_APP) {
+                err = download_begin(download, section->length, record->offset - section->offset);
+            }
+        }
+    } else {
+        err = download_begin(download, download->size, download->offset);
+    }
+    mbedtls_sha256_free(&record->sha);
+    free(record);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot continue the interrupted download, starting over");
+        download_restart(download);
+        return false;
+    }
+    ESP_LOGI(TAG, "Resuming the download at %" PRIu32 " of %" PRIu32 " bytes", download->offset, download->size);
+    return true;
+}
+
+// Collects the response headers resuming depends on
+static esp_err_t http_event_handler(esp_http_client_event_t *evt)
+{
+    ota_download_t *download = evt->user_data;
+    if (evt->event_id != HTTP_EVENT_ON_HEADER) {
+        return ESP_OK;
+    }
+    if (strcasecmp(evt->header_key, "ETag") == 0) {
+        // Weak tags cannot be used with If-Range; those downloads are matched by size instead
+        if (strncmp(evt->header_value, "W/", 2) != 0 && strlen(evt->header_value) <= DOWNLOAD_ETAG_MAX_LEN) {
+            strcpy(download->response_etag, evt->header_value);
+        }
+    } else if (strcasecmp(evt->header_key, "Content-Range") == 0) {
+        uint32_t start, end, total;
+        if (sscanf(evt->header_value, "bytes %" SCNu32 "-%" SCNu32 "/%" SCNu32, &start, &end, &total) == 3) {
+            download->range_start = start;
+            download->range_total = total;
+        }
+    }
+    return ESP_OK;
+}
+
+// Pushes downloaded bytes through the parser or into the image, in slices that stop at checkpoint positions
+static esp_err_t download_consume(ota_download_t *download, const uint8_t *data, size_t len)
+{
+    esp_err_t err = ESP_OK;
+    if (download->format_checked == false) {
+        // An update package is pushed through the parser; anything else is a raw app image
+        download->is_package = pkg_parser_sniff(data, len);
+        if (download->is_package) {
+            ESP_LOGI(TAG, "Downloading an update package");
+            pkg_parser_init(&package_parser, &download_callbacks, download);
+        } else {
+            err = download_begin(download, download->size, 0);
+        }
+        download->format_checked = true;
+    }
+
+    while (err == ESP_OK && len > 0) {
+        size_t n = MIN(len, slice_limit(download));
+        if (download->is_package) {
+            if (pkg_parser_feed(&package_parser, data, n) < 0) {
+                ESP_LOGE(TAG, "Invalid update package");
+                err = (download->err != ESP_OK) ? download->err : ESP_ERR_INVALID_RESPONSE;
+            }
+        } else {
+            mbedtls_sha256_update(&download->sha, data, n);
+            err = download_write(download, data, n);
+        }
+        if (err == ESP_OK) {
+            download->offset += n;
+            download->received += n;
+            data += n;
+            len -= n;
+            if (checkpoint_due(download)) {
+                take_checkpoint(download);
+            }
+        }
+    }
+    return err;
+}
+
+// One request, from the current offset to the end or the first failure. A server that ignores the
+// Range header is read from the start and the bytes already written are skipped; one whose file
+// changed (another ETag or size) restarts the download.
+static esp_err_t download_attempt(ota_download_t *download, esp_http_client_handle_t client)
+{
+    download->transport_failed = true;
+    download->response_etag[0] = '\0';
+    download->range_start = -1;
+    if (download->offset > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%" PRIu32 "-", download->offset);
+        esp_http_client_set_header(client, "Range", range);
+        if (download->etag[0]) {
+            esp_http_client_set_header(client, "If-Range", download->etag);
+        } else {
+            esp_http_client_delete_header(client, "If-Range");
+        }
+    } else {
+        esp_http_client_delete_header(client, "Range");
+        esp_http_client_delete_header(client, "If-Range");
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
+        return err;
+    }
+    int64_t content_length = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+
+    uint32_t skip = 0;
+    if (status == 206) {
+        if (download->range_start != download->offset || (download->size && download->range_total != download->size)) {
+            ESP_LOGW(TAG, "Range response does not continue the download, starting over");
+            download_restart(download);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        download->size = download->range_total;
+    } else if (status == 200) {
+        uint32_t total = (content_length > 0 && content_length <= UINT32_MAX) ? (uint32_t)content_length : 0;
+        if (download->offset > 0) {
+            bool same = download->etag[0] ? strcmp(download->response_etag, download->etag) == 0
+                                          : (download->size != 0 && total == download->size);
+            if (same) {
+                ESP_LOGW(TAG, "Server ignored the Range request, skipping %" PRIu32 " bytes", download->offset);
+                skip = download->offset;
+            } else {
+                ESP_LOGW(TAG, "File changed on the server, starting over");
+                download_restart(download);
             }
-            if (esp_http_client_is_complete_data_received(client) == true) {
-                ESP_LOGI(TAG, "Connection closed");
+        }
+        if (download->offset == 0) {
+            download->size = total;
+            strcpy(download->etag, download->response_etag);
+        }
+    } else {
+        ESP_LOGE(TAG, "HTTP status %d", status);
+        download->transport_failed = (status == 408 || status == 429 || status >= 500);
+        return ESP_FAIL;
+    }
+
+    while (download->size == 0 || download->offset < download->size) {
+        size_t want = BUFFSIZE;
+        if (skip > 0) {
+            want = MIN(want, skip);
+        } else if (download->size > 0) {
+            want = MIN(want, download->size - download->offset);
+        }
+        int data_read = esp_http_client_read(client, ota_write_data, want);
+        if (data_read < 0) {
+            ESP_LOGE(TAG, "Error reading data");
+            return ESP_FAIL;
+        }
+        if (data_read == 0) {
+            if (download->size == 0 && esp_http_client_is_complete_data_received(client)) {
                 break;
             }
+            ESP_LOGE(TAG, "Connection closed at offset %" PRIu32 ", errno = %d", download->offset, errno);
+            return ESP_FAIL;
+        }
+        if (skip > 0) {
+            skip -= data_read;
+            continue;
+        }
+        err = download_consume(download, (const uint8_t *)ota_write_data, data_read);
+        if (err != ESP_OK) {
+            download->transport_failed = false;
+            return err;
         }
     }
 
-    esp_http_client_cleanup(client);
+    download->transport_failed = false;
+    if (download->is_package && !pkg_parser_done(&package_parser)) {
+        ESP_LOGE(TAG, "Update package is truncated");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Installs the finished download: the raw image is closed here, a package's app section already was
+static esp_err_t download_finish(ota_download_t *download)
+{
+    esp_err_t err;
+    if (!download->is_package) {
+        uint8_t digest[HASH_LEN];
+        char hex[2 * HASH_LEN + 1];
+        mbedtls_sha256_finish(&download->sha, digest);
+        for (int i = 0; i < HASH_LEN; i++) {
+            sprintf(hex + 2 * i, "%02x", digest[i]);
+        }
+        ESP_LOGI(TAG, "Image SHA-256: %s", hex);
 
-    if (esp_http_client_is_complete_data_received(client) != true) {
-        ESP_LOGE(TAG, "Error in receiving complete file");
-        esp_ota_abort(update_handle);
+        err = ota_writer_end(&download->writer);
+        download->started = false;
+        if (err != ESP_OK) {
+            if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+                ESP_LOGE(TAG, "Image validation failed, image is corrupted");
+            } else {
+                ESP_LOGE(TAG, "esp_ota_end failed (%s)!", esp_err_to_name(err));
+            }
+            return err;
+        }
+        ota_writer_log_timing(&download->writer);
+    } else if (!download->app_done) {
+        ESP_LOGE(TAG, "Update package has no firmware");
         return ESP_FAIL;
     }
 
-    err = esp_ota_end(update_handle);
-    if (err != ESP_OK) {
-        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
-            ESP_LOGE(TAG, "Image validation failed, image is corrupted");
-        } else {
-            ESP_LOGE(TAG, "esp_ota_end failed (%s)!", esp_err_to_name(err));
+    if (prepare_slot_hook) {
+        err = prepare_slot_hook(download->partition);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to prepare %s (%s)", download->partition->label, esp_err_to_name(err));
+            return err;
         }
-        return err;
     }
 
-    err = esp_ota_set_boot_partition(update_partition);
+    err = esp_ota_set_boot_partition(download->partition);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "esp_ota_set_boot_partition failed (%s)!", esp_err_to_name(err));
-        return err;
     }
+    return err;
+}
 
-    ESP_LOGI(TAG, "OTA update successful. Rebooting...");
-    return ESP_OK;
+void ota_set_prepare_slot_hook(ota_prepare_slot_fn hook)
+{
+    prepare_slot_hook = hook;
+}
+
+esp_err_t perform_ota_update(const char *url)
+{
+    ota_download_t *download = calloc(1, sizeof(ota_download_t));
+    if (download == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    download->url = url;
+    download->partition = esp_ota_get_next_update_partition(NULL);
+    if (download->partition == NULL) {
+        ESP_LOGE(TAG, "Failed to get next OTA partition");
+        free(download);
+        return ESP_FAIL;
+    }
+    mbedtls_sha256_init(&download->sha);
+    mbedtls_sha256_starts(&download->sha, 0);
+
+    // Configure HTTP client
+    esp_http_client_config_t config = {
+        .url = url,
+        .timeout_ms = 5000,
+        .keep_alive_enable = true,
+        .event_handler = http_event_handler,
+        .user_data = download,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        ESP_LOGE(TAG, "Failed to initialize HTTP connection");
+        mbedtls_sha256_free(&download->sha);
+        free(download);
+        return ESP_FAIL;
+    }
+
+    download_resume(download);
+
+    // Reconnects continue at the current offset; the delay doubles with every attempt in a row
+    // that brings no new bytes
+    esp_err_t err = ESP_FAIL;
+    uint32_t failures = 0;
+    int64_t download_start = esp_timer_get_time();
+    for (uint32_t attempt = 1; ; attempt++) {
+        uint32_t start_offset = download->offset;
+        if (start_offset > 0) {
+            download->resumes++;
+        }
+        download->received = 0;
+        int64_t attempt_start = esp_timer_get_time();
+        err = download_attempt(download, client);
+        esp_http_client_close(client);
+
+        int64_t elapsed_ms = (esp_timer_get_time() - attempt_start) / 1000;
+        uint32_t received = download->received;
+        ESP_LOGI(TAG, "Attempt %" PRIu32 ": %" PRIu32 " bytes from offset %" PRIu32 " in %" PRId64 " ms (%" PRIu32 " KB/s), "
+                 "%" PRIu32 " resumes, %s", attempt, received, start_offset, elapsed_ms,
+                 (uint32_t)(elapsed_ms > 0 ? (uint64_t)received * 1000 / 1024 / elapsed_ms : 0), download->resumes,
+                 err == ESP_OK ? "complete" : esp_err_to_name(err));
+
+        if (err == ESP_OK || !download->transport_failed) {
+            break;
+        }
+        failures = (received > 0) ? 1 : failures + 1;
+        if (failures > DOWNLOAD_MAX_RETRIES) {
+            ESP_LOGE(TAG, "Giving up after %" PRIu32 " attempts without progress", failures);
+            break;
+        }
+        uint32_t delay_ms = MIN((uint32_t)DOWNLOAD_BACKOFF_MIN_MS << (failures - 1), (uint32_t)DOWNLOAD_BACKOFF_MAX_MS);
+        ESP_LOGW(TAG, "Download interrupted at %" PRIu32 " of %" PRIu32 " bytes, reconnecting in %" PRIu32 " ms",
+                 download->offset, download->size, delay_ms);
+        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+    }
+    esp_http_client_cleanup(client);
+
+    if (err == ESP_OK) {
+        int64_t elapsed_ms = (esp_timer_get_time() - download_start) / 1000;
+        ESP_LOGI(TAG, "Downloaded %" PRIu32 " bytes in %" PRId64 " ms with %" PRIu32 " resumes",
+                 download->offset, elapsed_ms, download->resumes);
+        err = download_finish(download);
+    }
+
+    // A download that failed on the network keeps its checkpoint, so the next call (after a reboot
+    // too) continues from it; any other failure means the file itself cannot be installed
+    if (err == ESP_OK || !download->transport_failed) {
+        record_erase();
+    }
+    if (download->started) {
+        ota_writer_abort(&download->writer);
+    }
+    mbedtls_sha256_free(&download->sha);
+    free(download);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "OTA update successful. Rebooting...");
+    }
+    return err;
 }
 
 void init_ota(void)
@@ -1,6 +1,15 @@
 #pragma once
 
 #include <esp_err.h>
+#include <esp_partition.h>
+
+/**
+ * @brief Prepares what an app slot needs besides its image, before it becomes the boot partition
+ *
+ * @param update_partition App slot the firmware was written to
+ * @return esp_err_t ESP_OK to switch the boot partition; an error keeps the running firmware
+ */
+typedef esp_err_t (*ota_prepare_slot_fn)(const esp_partition_t *update_partition);
 
 /**
  * @brief Initialize OTA subsystem
@@ -12,9 +21,24 @@ void init_ota(void);
 /**
  * @brief Perform OTA update from given URL
  * 
- * Downloads and installs new firmware from the specified URL
+ * Downloads and installs new firmware from the specified URL. The file is either a raw
+ * app image or an update package holding a single uncompressed app section, whose digest is
+ * checked. Packages with web, asset or data partition sections are refused before anything is
+ * written; those are installed by the package upload.
+ * 
+ * A dropped connection is resumed with a Range request after an exponential backoff. The
+ * download also saves checkpoints to NVS, so after a reboot the next call with the same URL
+ * continues in the same OTA slot instead of starting over.
  * 
- * @param url URL of the firmware file
+ * @param url URL of the firmware image or update package
  * @return esp_err_t ESP_OK on success, or error code
  */
-esp_err_t perform_ota_update(const char *url);
\ No newline at end of file
+esp_err_t perform_ota_update(const char *url);
+
+/**
+ * @brief Set the hook perform_ota_update() runs before it switches the boot partition
+ *
+ * The application pairs data with each app slot (the web bank and asset bundle), which an
+ * image download does not carry; the hook fills them in.
+ */
+void ota_set_prepare_slot_hook(ota_prepare_slot_fn hook);
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include "ota_writer.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_app_format.h>
+#include <inttypes.h>
+
+#define SECTOR_SIZE OTA_WRITER_SECTOR_SIZE
+
+static const char *TAG = "ota_writer";
+
+// The checks esp_ota_begin() makes before it erases anything; the erase-ahead path skips that call
+static esp_err_t check_app_target(const esp_partition_t *partition)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    if (partition == running) {
+        ESP_LOGE(TAG, "Cannot write over the running app in %s", partition->label);
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+    // Until the running app is confirmed (rollback enabled), the other slot is what a rollback boots
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGE(TAG, "Running app is still not confirmed state (ESP_OTA_IMG_PENDING_VERIFY)");
+        return ESP_ERR_OTA_ROLLBACK_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_begin(ota_writer_t *writer, const esp_partition_t *partition, size_t image_size, bool erase_ahead)
+{
+    if (writer == NULL || partition == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(writer, 0, sizeof(ota_writer_t));
+    writer->partition = partition;
+    writer->image_size = image_size;
+    writer->erase_ahead = erase_ahead;
+    writer->app_image = true;
+    writer->started_at = esp_timer_get_time();
+
+    if (writer->erase_ahead && partition->encrypted) {
+        ESP_LOGW(TAG, "Partition is encrypted, erasing the whole slot instead");
+        writer->erase_ahead = false;
+    }
+
+    if (writer->erase_ahead) {
+        esp_err_t err = check_app_target(partition);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (image_size == 0 || image_size > partition->size) {
+            ESP_LOGE(TAG, "Image size %u does not fit partition %s (%" PRIu32 " bytes)",
+                     (unsigned)image_size, partition->label, (uint32_t)partition->size);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        writer->erase_end = (image_size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+    } else {
+        esp_err_t err = esp_ota_begin(partition, OTA_SIZE_UNKNOWN, &writer->handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "esp_ota_begin failed (%s)", esp_err_to_name(err));
+            return err;
+        }
+        writer->erase_end = partition->size;
+        writer->erased = partition->size;
+    }
+
+    writer->begin_us = esp_timer_get_time() - writer->started_at;
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_begin_data(ota_writer_t *writer, const esp_partition_t *partition, size_t image_size)
+{
+    if (writer == NULL || partition == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(writer, 0, sizeof(ota_writer_t));
+    writer->partition = partition;
+    writer->image_size = image_size;
+    writer->erase_ahead = true;    // esp_partition_write() handles encrypted data partitions itself
+    writer->started_at = esp_timer_get_time();
+
+    if (image_size == 0 || image_size > partition->size) {
+        ESP_LOGE(TAG, "Image size %u does not fit partition %s (%" PRIu32 " bytes)",
+                 (unsigned)image_size, partition->label, (uint32_t)partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    writer->erase_end = (image_size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_resume(ota_writer_t *writer, const esp_partition_t *partition, size_t image_size, size_t written)
+{
+    if (written % SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = ota_writer_begin(writer, partition, image_size, true);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (!writer->erase_ahead || written > image_size) {
+        // Encrypted slots go through esp_ota_begin(), which always starts over
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Sectors before the cursor hold the image written so far; the magic was checked back then
+    writer->written = written;
+    writer->erased = written;
+    return ESP_OK;
+}
+
+static esp_err_t erase_next_sector(ota_writer_t *writer, int64_t *elapsed_us)
+{
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = esp_partition_erase_range(writer->partition, writer->erased, SECTOR_SIZE);
+    *elapsed_us += esp_timer_get_time() - start;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Erase at 0x%x failed (%s)", (unsigned)writer->erased, esp_err_to_name(err));
+        return err;
+    }
+    writer->erased += SECTOR_SIZE;
+    return ESP_OK;
+}
+
+// Programs `len` bytes at the write cursor: through esp_ota_write() in erase-all mode, otherwise
+// straight to the partition once the sectors it covers are erased
+static esp_err_t program(ota_writer_t *writer, const uint8_t *data, size_t len)
+{
+    int64_t start;
+    esp_err_t err;
+
+    if (!writer->erase_ahead) {
+        start = esp_timer_get_time();
+        err = esp_ota_write(writer->handle, data, len);
+        writer->write_us += esp_timer_get_time() - start;
+    } else {
+        // Catch up if the background eraser has not reached the write cursor yet
+        while (writer->erased < writer->written + len) {
+            err = erase_next_sector(writer, &writer->inline_erase_us);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+
+        start = esp_timer_get_time();
+        err = esp_partition_write(writer->partition, writer->written, data, len);
+        writer->write_us += esp_timer_get_time() - start;
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Write at 0x%x failed (%s)", (unsigned)writer->written, esp_err_to_name(err));
+        }
+    }
+
+    if (err == ESP_OK) {
+        writer->written += len;
+        writer->programs++;
+    }
+    return err;
+}
+
+// Programs the staged bytes, a full sector or the image tail
+static esp_err_t program_stage(ota_writer_t *writer)
+{
+    if (writer->staged == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = program(writer, writer->stage, writer->staged);
+    if (err == ESP_OK) {
+        writer->staged = 0;
+    }
+    return err;
+}
+
+esp_err_t ota_writer_write(ota_writer_t *writer, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    size_t accepted = writer->written + writer->staged;
+
+    if (len == 0) {
+        return ESP_OK;
+    }
+
+    if (accepted == 0) {
+        writer->first_write_us = esp_timer_get_time() - writer->started_at;
+    }
+
+    if (writer->erase_ahead && accepted + len > writer->image_size) {
+        ESP_LOGE(TAG, "Write past the announced image size (%u bytes)", (unsigned)writer->image_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Same sanity check esp_ota_write() does on the first chunk
+    if (writer->app_image && accepted == 0 && bytes[0] != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG, "OTA image has invalid magic byte (expected 0xE9, saw 0x%02x)", bytes[0]);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    // Complete the staged sector first
+    if (writer->staged > 0) {
+        size_t fill = SECTOR_SIZE - writer->staged;
+        if (fill > len) {
+            fill = len;
+        }
+        memcpy(writer->stage + writer->staged, bytes, fill);
+        writer->staged += fill;
+        writer->staged_bytes += fill;
+        bytes += fill;
+        len -= fill;
+        if (writer->staged < SECTOR_SIZE) {
+            return ESP_OK;      // Still partial; the stage must be kept as it is
+        }
+        esp_err_t err = program_stage(writer);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    // The cursor is sector aligned here whenever data remains: whole sectors go out without a copy
+    size_t run = len & ~(size_t)(SECTOR_SIZE - 1);
+    if (run > 0) {
+        esp_err_t err = program(writer, bytes, run);
+        if (err != ESP_OK) {
+            return err;
+        }
+        bytes += run;
+        len -= run;
+    }
+
+    // Keep the partial sector for the next write (or ota_writer_end)
+    memcpy(writer->stage, bytes, len);
+    writer->staged = len;
+    writer->staged_bytes += len;
+    return ESP_OK;
+}
+
+bool ota_writer_erase_step(ota_writer_t *writer)
+{
+    if (!writer->erase_ahead || writer->erased >= writer->erase_end) {
+        return false;
+    }
+    if (erase_next_sector(writer, &writer->background_erase_us) != ESP_OK) {
+        // The write path retries the erase and reports the error
+        return false;
+    }
+    return writer->erased < writer->erase_end;
+}
+
+esp_err_t ota_writer_end(ota_writer_t *writer)
+{
+    esp_err_t err = program_stage(writer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (!writer->erase_ahead) {
+        return esp_ota_end(writer->handle);
+    }
+
+    if (writer->written != writer->image_size) {
+        ESP_LOGE(TAG, "Image incomplete: %u of %u bytes written", (unsigned)writer->written, (unsigned)writer->image_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+void ota_writer_abort(ota_writer_t *writer)
+{
+    if (!writer->erase_ahead) {
+        esp_ota_abort(writer->handle);
+    }
+}
+
+void ota_writer_log_timing(const ota_writer_t *writer)
+{
+    int64_t total_us = esp_timer_get_time() - writer->started_at;
+    ESP_LOGI(TAG, "%s timing (%s): %u bytes written, %u bytes erased", writer->partition->label,
+             writer->erase_ahead ? "erase-ahead" : "erase-all", (unsigned)writer->written, (unsigned)writer->erased);
+    ESP_LOGI(TAG, "  begin: %" PRId64 " ms, first write after: %" PRId64 " ms",
+             writer->begin_us / 1000, writer->first_write_us / 1000);
+    ESP_LOGI(TAG, "  erase: %" PRId64 " ms in background, %" PRId64 " ms stalling writes",
+             writer->background_erase_us / 1000, writer->inline_erase_us / 1000);
+    ESP_LOGI(TAG, "  write: %" PRId64 " ms in %" PRIu32 " sector-aligned programs (%" PRIu64 " bytes staged), total: %" PRId64 " ms",
+             writer->write_us / 1000, writer->programs, writer->staged_bytes, total_us / 1000);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Sequential writer for an OTA app slot
+ *
+ * In erase-ahead mode only the sectors covered by the image size are erased,
+ * one sector at a time, either from ota_writer_erase_step() while the caller
+ * is idle or just before a write reaches an unerased sector. In erase-all mode
+ * the writer wraps esp_ota_begin(OTA_SIZE_UNKNOWN), which erases the whole
+ * slot up front.
+ *
+ * ota_writer_begin_data() uses the same erase-ahead path for a raw image
+ * headed for a data partition (for example a prebuilt LittleFS image).
+ *
+ * Flash is programmed in whole, sector-aligned runs whatever the size of the
+ * writes: a partial sector collects in `stage` until it is full, whole sectors
+ * go to flash straight from the caller's buffer, and only the image tail is
+ * programmed short, by ota_writer_end().
+ */
+#define OTA_WRITER_SECTOR_SIZE 4096
+
+typedef struct {
+    const esp_partition_t *partition;
+    esp_ota_handle_t handle;    // Only used in erase-all mode
+    bool erase_ahead;
+    bool app_image;             // Check the app image magic on the first write
+    size_t image_size;
+    size_t erase_end;           // image_size rounded up to a whole sector
+    size_t erased;              // Bytes erased from the start of the slot
+    size_t written;             // Bytes programmed from the start of the slot
+    size_t staged;              // Bytes waiting in `stage` (they follow `written`)
+    uint8_t stage[OTA_WRITER_SECTOR_SIZE];
+
+    // Timing report (microseconds)
+    int64_t begin_us;           // Time spent in ota_writer_begin()
+    int64_t background_erase_us;// Erase time spent in ota_writer_erase_step()
+    int64_t inline_erase_us;    // Erase time that stalled a write
+    int64_t write_us;           // Time spent programming flash (including esp_ota_write's own work)
+    int64_t first_write_us;     // From begin until the first byte was written
+    int64_t started_at;
+    uint32_t programs;          // Flash program operations
+    uint64_t staged_bytes;      // Bytes that were copied through `stage`
+} ota_writer_t;
+
+/**
+ * @brief Prepare the partition for a new image
+ *
+ * Falls back to erase-all mode for encrypted partitions, where esp_ota_write
+ * takes care of the encryption block alignment.
+ *
+ * @param writer Writer state to initialize
+ * @param partition Target OTA app partition
+ * @param image_size Exact image size in bytes (required for erase-ahead)
+ * @param erase_ahead true for erase-ahead, false to erase the whole slot first
+ * @return esp_err_t ESP_OK on success, or error code
+ */
+esp_err_t ota_writer_begin(ota_writer_t *writer, const esp_partition_t *partition, size_t image_size, bool erase_ahead);
+
+/**
+ * @brief Prepare a data partition for a raw image, erasing ahead of the write cursor
+ *
+ * @param writer Writer state to initialize
+ * @param partition Target data partition (must not be mounted)
+ * @param image_size Exact image size in bytes
+ * @return esp_err_t ESP_OK on success, or ESP_ERR_INVALID_SIZE if the image does not fit
+ */
+esp_err_t ota_writer_begin_data(ota_writer_t *writer, const esp_partition_t *partition, size_t image_size);
+
+/**
+ * @brief Continue an erase-ahead image that was interrupted at a sector boundary
+ *
+ * The first `written` bytes of the slot are kept as they are; erasing and writing
+ * carry on from there.
+ *
+ * @param writer Writer state to initialize
+ * @param partition Target OTA app partition
+ * @param image_size Exact image size in bytes
+ * @param written Bytes already in the slot, a multiple of the sector size
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if the slot cannot be resumed, or error code
+ */
+esp_err_t ota_writer_resume(ota_writer_t *writer, const esp_partition_t *partition, size_t image_size, size_t written);
+
+/**
+ * @brief Append image data at the write cursor
+ *
+ * Data that does not complete a sector is kept in the writer until a later
+ * write or ota_writer_end() programs it.
+ */
+esp_err_t ota_writer_write(ota_writer_t *writer, const void *data, size_t len);
+
+/**
+ * @brief Erase the next sector ahead of the write cursor
+ *
+ * @return true while sectors covered by the image remain unerased
+ */
+bool ota_writer_erase_step(ota_writer_t *writer);
+
+/**
+ * @brief Finish the image
+ *
+ * Programs the staged tail. The image itself is verified by esp_ota_set_boot_partition().
+ *
+ * @return esp_err_t ESP_OK if the full image was written, or error code
+ */
+esp_err_t ota_writer_end(ota_writer_t *writer);
+
+/**
+ * @brief Abandon a partially written image
+ */
+void ota_writer_abort(ota_writer_t *writer);
+
+/**
+ * @brief Log the erase/write timing report of the last image
+ */
+void ota_writer_log_timing(const ota_writer_t *writer);
@@ -0,0 +1,480 @@
+#include "pkg_parser.h"
+
+#include <string.h>
+
+// Define Package Header Format
+#define PACKAGE_MAGIC "ESP_UPDATE"      // v1: magic + 4x uint32_t, no integrity data
+#define PACKAGE_MAGIC_V2 "ESP_PKG_V2"   // v2: adds header size, flags and SHA-256 digests
+#define PACKAGE_MAGIC_V3 "ESP_PKG_V3"   // v3: header size, flags and a table of sections
+#define PACKAGE_MAGIC_LEN PKG_MAGIC_LEN
+#define HEADER_SIZE (PACKAGE_MAGIC_LEN + sizeof(uint32_t) * 4)  // 10-byte magic + 4x uint32_t values
+#define HEADER_V2_PREFIX_SIZE (PACKAGE_MAGIC_LEN + sizeof(uint32_t))  // Magic + header size
+#define HEADER_V2_SIZE (PACKAGE_MAGIC_LEN + sizeof(uint32_t) * 6 + PKG_SHA256_LEN * 2)
+#define HEADER_V3_PREFIX_SIZE (PACKAGE_MAGIC_LEN + sizeof(uint32_t) * 2 + sizeof(uint16_t) * 2)  // Magic, header size, flags, section count, entry size
+#define SECTION_ENTRY_SIZE (4 + PKG_LABEL_MAX_LEN + sizeof(uint32_t) * 2 + PKG_SHA256_LEN * 2)  // Type, encoding, reserved, label, length, size, digests
+#define FILE_METADATA_SIZE 6            // uint16_t name length + uint32_t file size
+
+// v2 header flags, mapped onto the synthesized section table
+#define PKG_FLAG_FIRMWARE_DEFLATE (1 << 0) // Firmware section is a zlib stream
+#define PKG_FLAG_FILES_DEFLATE    (1 << 1) // Each file's data is a zlib stream, its record carries the raw size
+#define PKG_FLAG_FIRMWARE_DELTA   (1 << 2) // Firmware section is a patch against the running app
+#define PKG_FLAG_LITTLEFS_IMAGE   (1 << 3) // LittleFS section is a whole partition image (a zlib stream with FILES_DEFLATE)
+
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+// Runs an optional callback; a negative return stops the parser
+#define CALLBACK(parser, fn, ...) \
+    ((parser)->callbacks->fn ? (parser)->callbacks->fn((parser)->ctx, __VA_ARGS__) : PKG_PARSER_OK)
+
+static uint32_t read_u32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint16_t read_u16(const uint8_t *data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static int callback_status(int ret) {
+    return ret < 0 ? PKG_PARSER_ERR_CALLBACK : ret;
+}
+
+static const pkg_section_t *current_section(const pkg_parser_t *parser) {
+    return &parser->header.sections[parser->section];
+}
+
+static void start_fields(pkg_parser_t *parser, pkg_parser_state_t state, size_t need) {
+    parser->state = state;
+    parser->need = need;
+    parser->have = 0;
+}
+
+static void start_record(pkg_parser_t *parser) {
+    size_t need = FILE_METADATA_SIZE;
+    if (current_section(parser)->encoding & PKG_ENCODING_DEFLATE) {
+        need += sizeof(uint32_t);
+    }
+    if (parser->header.version >= 2) {
+        need += PKG_SHA256_LEN;
+    }
+    start_fields(parser, PKG_STATE_FILE_RECORD, need);
+}
+
+// Positions the parser at the first byte of the current section's data
+static void enter_section(pkg_parser_t *parser) {
+    if (current_section(parser)->type == PKG_SECTION_FILES) {
+        start_record(parser);
+    } else {
+        parser->state = PKG_STATE_STREAM;
+        parser->item_left = parser->section_left;
+    }
+}
+
+// Moves on to section `index`, reporting sections that hold no bytes as they are passed,
+// and the trailer after the last one
+static int start_section(pkg_parser_t *parser, uint32_t index) {
+    for (; index < parser->header.section_count; index++) {
+        parser->section = index;
+        const pkg_section_t *section = current_section(parser);
+        int ret = callback_status(CALLBACK(parser, section_begin, section));
+        if (ret < 0) {
+            return ret;
+        }
+        parser->section_left = section->length;
+        if (section->length > 0) {
+            enter_section(parser);
+            return PKG_PARSER_OK;
+        }
+        ret = callback_status(CALLBACK(parser, section_end, section));
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    parser->state = PKG_STATE_DONE;
+    return parser->callbacks->trailer ? callback_status(parser->callbacks->trailer(parser->ctx)) : PKG_PARSER_OK;
+}
+
+static int end_section(pkg_parser_t *parser) {
+    int ret = callback_status(CALLBACK(parser, section_end, current_section(parser)));
+    return ret < 0 ? ret : start_section(parser, parser->section + 1);
+}
+
+// Lays the sections out back to back after the header and reports it
+static int finish_header(pkg_parser_t *parser) {
+    pkg_header_t *header = &parser->header;
+    uint64_t offset = header->header_size;
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        header->sections[i].offset = (uint32_t)offset;
+        offset += header->sections[i].length;
+        if (offset > UINT32_MAX) {
+            return PKG_PARSER_ERR_HEADER;
+        }
+    }
+
+    int ret = callback_status(CALLBACK(parser, header, header));
+    return ret < 0 ? ret : start_section(parser, 0);
+}
+
+// Decodes a complete v1 or v2 header from the field buffer into a firmware + LittleFS table
+static int parse_legacy_header(pkg_parser_t *parser) {
+    pkg_header_t *header = &parser->header;
+    pkg_section_t *firmware = &header->sections[0];
+    pkg_section_t *littlefs = &header->sections[1];
+    const uint8_t *fields = parser->buffer + PACKAGE_MAGIC_LEN;
+    uint32_t flags = 0;
+    header->header_size = parser->have;
+    header->section_count = 2;
+
+    // v2 inserts header size and flags after the magic; the size/offset fields keep their v1 order
+    if (header->version == 2) {
+        flags = read_u32(fields + sizeof(uint32_t));
+        fields += 2 * sizeof(uint32_t);
+    }
+
+    // Extract firmware & LittleFS sizes (the offsets follow from the header size)
+    firmware->type = PKG_SECTION_APP;
+    firmware->length = read_u32(fields);
+    firmware->size = firmware->length;
+    littlefs->type = (flags & PKG_FLAG_LITTLEFS_IMAGE) ? PKG_SECTION_WEB_IMAGE : PKG_SECTION_FILES;
+    littlefs->length = read_u32(fields + sizeof(uint32_t));
+    littlefs->size = littlefs->length;
+    if (header->version == 1) {
+        return finish_header(parser);
+    }
+
+    firmware->verify = littlefs->verify = true;
+    memcpy(firmware->sha256, fields + 4 * sizeof(uint32_t), PKG_SHA256_LEN);
+    memcpy(littlefs->sha256, fields + 4 * sizeof(uint32_t) + PKG_SHA256_LEN, PKG_SHA256_LEN);
+    firmware->encoding = ((flags & PKG_FLAG_FIRMWARE_DEFLATE) ? PKG_ENCODING_DEFLATE : 0) |
+                         ((flags & PKG_FLAG_FIRMWARE_DELTA) ? PKG_ENCODING_DELTA : 0);
+    littlefs->encoding = (flags & PKG_FLAG_FILES_DEFLATE) ? PKG_ENCODING_DEFLATE : 0;
+
+    // Optional fields follow the fixed v2 header in flag order
+    size_t extension = HEADER_V2_SIZE;
+
+    // Compressed or delta firmware carries the size of the image it expands to
+    if (firmware->encoding) {
+        if (header->header_size < extension + sizeof(uint32_t)) {
+            return PKG_PARSER_ERR_HEADER;
+        }
+        firmware->size = read_u32(parser->buffer + extension);
+        extension += sizeof(uint32_t);
+    }
+
+    // Delta firmware names the app it was diffed against
+    if (firmware->encoding & PKG_ENCODING_DELTA) {
+        if (header->header_size < extension + PKG_SHA256_LEN) {
+            return PKG_PARSER_ERR_HEADER;
+        }
+        memcpy(firmware->base_sha256, parser->buffer + extension, PKG_SHA256_LEN);
+        extension += PKG_SHA256_LEN;
+    }
+
+    // A partition image section carries its decompressed size
+    if (littlefs->type == PKG_SECTION_WEB_IMAGE) {
+        if (header->header_size < extension + sizeof(uint32_t)) {
+            return PKG_PARSER_ERR_HEADER;
+        }
+        littlefs->size = read_u32(parser->buffer + extension);
+        extension += sizeof(uint32_t);
+    }
+    return finish_header(parser);
+}
+
+// v3 header prefix: sizes of the header and of its table
+static int parse_v3_prefix(pkg_parser_t *parser) {
+    pkg_header_t *header = &parser->header;
+    const uint8_t *fields = parser->buffer + PACKAGE_MAGIC_LEN;
+    header->header_size = read_u32(fields);
+    header->section_count = read_u16(fields + 2 * sizeof(uint32_t));
+    parser->entry_size = read_u16(fields + 2 * sizeof(uint32_t) + sizeof(uint16_t));
+
+    if (header->section_count < 1 || header->section_count > PKG_MAX_SECTIONS ||
+        parser->entry_size < SECTION_ENTRY_SIZE || parser->entry_size > PKG_HEADER_MAX_SIZE ||
+        header->header_size < HEADER_V3_PREFIX_SIZE + header->section_count * parser->entry_size) {
+        return PKG_PARSER_ERR_HEADER;
+    }
+    parser->header_left = header->header_size - HEADER_V3_PREFIX_SIZE;
+    parser->section = 0;
+    start_fields(parser, PKG_STATE_SECTION_TABLE, parser->entry_size);
+    parser->header_left -= parser->entry_size;
+    return PKG_PARSER_OK;
+}
+
+// Called each time a v3 table entry is in, then for each piece of the header that follows the table
+static int table_fields(pkg_parser_t *parser) {
+    pkg_header_t *header = &parser->header;
+    if (parser->section < header->section_count) {
+        const uint8_t *entry = parser->buffer;
+        pkg_section_t *section = &header->sections[parser->section++];
+        section->type = entry[0];
+        section->encoding = entry[1];
+        memcpy(section->label, entry + 4, PKG_LABEL_MAX_LEN);
+        section->label[PKG_LABEL_MAX_LEN] = '\0';
+        section->length = read_u32(entry + 4 + PKG_LABEL_MAX_LEN);
+        section->size = read_u32(entry + 8 + PKG_LABEL_MAX_LEN);
+        section->verify = true;
+        memcpy(section->sha256, entry + 12 + PKG_LABEL_MAX_LEN, PKG_SHA256_LEN);
+        memcpy(section->base_sha256, entry + 12 + PKG_LABEL_MAX_LEN + PKG_SHA256_LEN, PKG_SHA256_LEN);
+    }
+
+    // Entries first, then newer header fields are read past in buffer-sized pieces
+    size_t next = (parser->section < header->section_count) ? parser->entry_size : MIN(parser->header_left, PKG_HEADER_MAX_SIZE);
+    if (next == 0) {
+        return finish_header(parser);
+    }
+    start_fields(parser, PKG_STATE_SECTION_TABLE, next);
+    parser->header_left -= next;
+    return PKG_PARSER_OK;
+}
+
+// Called each time the header field buffer is full: magic, then the header size, then the rest
+static int header_fields(pkg_parser_t *parser) {
+    if (parser->state == PKG_STATE_MAGIC) {
+        if (memcmp(parser->buffer, PACKAGE_MAGIC, PACKAGE_MAGIC_LEN) == 0) {
+            parser->header.version = 1;
+            parser->need = HEADER_SIZE;
+        } else if (memcmp(parser->buffer, PACKAGE_MAGIC_V2, PACKAGE_MAGIC_LEN) == 0) {
+            parser->header.version = 2;
+            parser->need = HEADER_V2_PREFIX_SIZE;
+        } else if (memcmp(parser->buffer, PACKAGE_MAGIC_V3, PACKAGE_MAGIC_LEN) == 0) {
+            parser->header.version = 3;
+            parser->need = HEADER_V3_PREFIX_SIZE;
+        } else {
+            return PKG_PARSER_ERR_MAGIC;
+        }
+        parser->state = PKG_STATE_HEADER;
+        return PKG_PARSER_OK;
+    }
+
+    if (parser->header.version == 3) {
+        return parse_v3_prefix(parser);
+    }
+    if (parser->header.version == 2 && parser->need == HEADER_V2_PREFIX_SIZE) {
+        uint32_t declared_size = read_u32(parser->buffer + PACKAGE_MAGIC_LEN);
+        if (declared_size < HEADER_V2_SIZE || declared_size > PKG_HEADER_MAX_SIZE) {
+            return PKG_PARSER_ERR_HEADER;
+        }
+        parser->need = declared_size;
+        return PKG_PARSER_OK;
+    }
+    return parse_legacy_header(parser);
+}
+
+// Called once the fixed record fields are in: validates them and moves on to the name
+static int record_fields(pkg_parser_t *parser) {
+    const uint8_t *record = parser->buffer;
+    pkg_file_t *file = &parser->file;
+    file->name_len = read_u16(record);
+    file->stored_size = read_u32(record + 2);
+    file->size = file->stored_size;
+    size_t sha_offset = FILE_METADATA_SIZE;
+    if (current_section(parser)->encoding & PKG_ENCODING_DEFLATE) {
+        file->size = read_u32(record + FILE_METADATA_SIZE);
+        sha_offset += sizeof(uint32_t);
+    }
+    file->sha256 = (parser->header.version >= 2) ? record + sha_offset : NULL;
+    file->name = parser->name;
+
+    if (file->name_len < 1 || file->name_len > PKG_FILE_NAME_MAX_LEN ||
+        (uint64_t)file->name_len + file->stored_size > parser->section_left) {
+        return PKG_PARSER_ERR_RECORD;
+    }
+    start_fields(parser, PKG_STATE_FILE_NAME, file->name_len);
+    return PKG_PARSER_OK;
+}
+
+static int end_file(pkg_parser_t *parser) {
+    if (!parser->skip_file) {
+        int ret = callback_status(CALLBACK(parser, file_end, &parser->file));
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (parser->section_left == 0) {
+        return end_section(parser);
+    }
+    start_record(parser);
+    return PKG_PARSER_OK;
+}
+
+static int begin_file(pkg_parser_t *parser) {
+    parser->name[parser->file.name_len] = '\0';
+    int ret = callback_status(CALLBACK(parser, file_begin, &parser->file));
+    if (ret < 0) {
+        return ret;
+    }
+    parser->skip_file = (ret == PKG_PARSER_SKIP);
+    parser->item_left = parser->file.stored_size;
+    if (parser->item_left == 0) {
+        return end_file(parser);
+    }
+    parser->state = PKG_STATE_FILE_DATA;
+    return PKG_PARSER_OK;
+}
+
+// Reports `len` bytes of the current section as sent
+static int section_bytes(pkg_parser_t *parser, const uint8_t *data, size_t len) {
+    parser->section_left -= len;
+    return callback_status(CALLBACK(parser, section_data, current_section(parser), data, len));
+}
+
+bool pkg_parser_sniff(const uint8_t *data, size_t len) {
+    return len >= PACKAGE_MAGIC_LEN &&
+           (memcmp(data, PACKAGE_MAGIC, PACKAGE_MAGIC_LEN) == 0 || memcmp(data, PACKAGE_MAGIC_V2, PACKAGE_MAGIC_LEN) == 0 ||
+            memcmp(data, PACKAGE_MAGIC_V3, PACKAGE_MAGIC_LEN) == 0);
+}
+
+void pkg_parser_init(pkg_parser_t *parser, const pkg_parser_callbacks_t *callbacks, void *ctx) {
+    memset(parser, 0, sizeof(pkg_parser_t));
+    parser->callbacks = callbacks;
+    parser->ctx = ctx;
+    start_fields(parser, PKG_STATE_MAGIC, PACKAGE_MAGIC_LEN);
+}
+
+int pkg_parser_resume(pkg_parser_t *parser, const pkg_parser_callbacks_t *callbacks, void *ctx,
+                      const pkg_header_t *header, uint32_t offset) {
+    pkg_parser_init(parser, callbacks, ctx);
+    parser->header = *header;
+    parser->offset = offset;
+
+    // The section holding `offset`; empty sections before it have been passed already
+    for (uint32_t i = 0; i < header->section_count && i < PKG_MAX_SECTIONS; i++) {
+        const pkg_section_t *section = &header->sections[i];
+        if (offset >= section->offset && offset - section->offset < section->length) {
+            parser->section = i;
+            parser->section_left = section->length - (offset - section->offset);
+            enter_section(parser);
+            return PKG_PARSER_OK;
+        }
+    }
+    parser->state = PKG_STATE_ERROR;
+    return PKG_PARSER_ERR_HEADER;
+}
+
+int pkg_parser_feed(pkg_parser_t *parser, const uint8_t *data, size_t len) {
+    if (parser->state == PKG_STATE_ERROR) {
+        return PKG_PARSER_ERR_STATE;
+    }
+
+    while (len > 0) {
+        size_t n;
+        int ret = PKG_PARSER_OK;
+
+        switch (parser->state) {
+        case PKG_STATE_MAGIC:
+        case PKG_STATE_HEADER:
+        case PKG_STATE_SECTION_TABLE:
+            n = MIN(len, parser->need - parser->have);
+            memcpy(parser->buffer + parser->have, data, n);
+            parser->have += n;
+            parser->offset += n;
+            if (parser->have == parser->need) {
+                ret = (parser->state == PKG_STATE_SECTION_TABLE) ? table_fields(parser) : header_fields(parser);
+            }
+            break;
+
+        case PKG_STATE_STREAM:
+            n = MIN(len, parser->item_left);
+            parser->item_left -= n;
+            parser->offset += n;
+            ret = section_bytes(parser, data, n);
+            if (ret >= 0) {
+                ret = callback_status(CALLBACK(parser, stream_data, current_section(parser), data, n));
+            }
+            if (ret >= 0 && parser->item_left == 0) {
+                ret = end_section(parser);
+            }
+            break;
+
+        case PKG_STATE_FILE_RECORD:
+            n = MIN(len, parser->need - parser->have);
+            if (n > parser->section_left) {
+                ret = PKG_PARSER_ERR_RECORD;    // Record cut off by the end of the section
+                break;
+            }
+            memcpy(parser->buffer + parser->have, data, n);
+            parser->have += n;
+            parser->offset += n;
+            ret = section_bytes(parser, data, n);
+            if (ret >= 0 && parser->have == parser->need) {
+                ret = record_fields(parser);
+            }
+            break;
+
+        case PKG_STATE_FILE_NAME:
+            n = MIN(len, parser->need - parser->have);
+            memcpy(parser->name + parser->have, data, n);
+            parser->have += n;
+            parser->offset += n;
+            ret = section_bytes(parser, data, n);
+            if (ret >= 0 && parser->have == parser->need) {
+                ret = begin_file(parser);
+            }
+            break;
+
+        case PKG_STATE_FILE_DATA:
+            n = MIN(len, parser->item_left);
+            parser->item_left -= n;
+            parser->offset += n;
+            ret = section_bytes(parser, data, n);
+            if (ret >= 0 && !parser->skip_file) {
+                ret = callback_status(CALLBACK(parser, file_data, data, n));
+            }
+            if (ret >= 0 && parser->item_left == 0) {
+                ret = end_file(parser);
+            }
+            break;
+
+        default:
+            n = 0;
+            ret = PKG_PARSER_ERR_TRAILING;
+            break;
+        }
+
+        if (ret < 0) {
+            parser->state = PKG_STATE_ERROR;
+            return ret;
+        }
+        data += n;
+        len -= n;
+    }
+    return PKG_PARSER_OK;
+}
+
+size_t pkg_parser_wants(const pkg_parser_t *parser) {
+    switch (parser->state) {
+    case PKG_STATE_MAGIC:
+    case PKG_STATE_HEADER:
+    case PKG_STATE_SECTION_TABLE:
+    case PKG_STATE_FILE_RECORD:
+    case PKG_STATE_FILE_NAME:
+        return parser->need - parser->have;
+    case PKG_STATE_STREAM:
+    case PKG_STATE_FILE_DATA:
+        return parser->item_left;
+    default:
+        return 0;
+    }
+}
+
+uint32_t pkg_parser_offset(const pkg_parser_t *parser) {
+    return parser->offset;
+}
+
+pkg_parser_state_t pkg_parser_state(const pkg_parser_t *parser) {
+    return parser->state;
+}
+
+uint32_t pkg_parser_section(const pkg_parser_t *parser) {
+    return parser->section;
+}
+
+bool pkg_parser_at_record_start(const pkg_parser_t *parser) {
+    return parser->state == PKG_STATE_FILE_RECORD && parser->have == 0;
+}
+
+bool pkg_parser_done(const pkg_parser_t *parser) {
+    return parser->state == PKG_STATE_DONE;
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Incremental parser for firmware + LittleFS update packages
+ *
+ * The caller pushes package bytes in slices of any size with pkg_parser_feed() and the
+ * parser reports what they contain through callbacks. It does not allocate: header and
+ * file record fields are gathered in the parser state, and data callbacks point into the
+ * slice being fed. It has no ESP-IDF dependencies, so the same code runs in the HTTP
+ * upload handler, in perform_ota_update() and in host builds.
+ *
+ * A package is a header with a table of sections, then the sections back to back in table
+ * order. v3 headers carry the table itself; v1/v2 headers (firmware + LittleFS) are mapped
+ * onto a synthesized two-entry table, so callers only ever see sections.
+ *
+ * Event order for a package:
+ *   header, then for each section:
+ *     section_begin, section_data + (stream_data... | file_begin, file_data..., file_end ...), section_end
+ *   trailer
+ *
+ * section_data gets every section byte as it was sent (including file records), for
+ * section digests; it runs before the parsed events for the same bytes.
+ */
+
+#define PKG_MAGIC_LEN 10
+#define PKG_SHA256_LEN 32
+#define PKG_HEADER_MAX_SIZE 256         // Upper bound for v2 headers and for one v3 table entry (newer fields are skipped)
+#define PKG_FILE_NAME_MAX_LEN 255
+#define PKG_MAX_SECTIONS 8              // Sections a v3 table may hold
+#define PKG_LABEL_MAX_LEN 16            // Partition label, as in the partition table
+
+// Section types; types the caller does not know are delivered as streams and should be refused
+typedef enum {
+    PKG_SECTION_APP = 0,                // App image -> next OTA slot
+    PKG_SECTION_FILES = 1,              // LittleFS file records -> web bank paired with that slot
+    PKG_SECTION_WEB_IMAGE = 2,          // LittleFS partition image -> web bank paired with that slot
+    PKG_SECTION_PARTITION = 3,          // Raw image -> the data partition named by `label`
+    PKG_SECTION_ASSET_BUNDLE = 4,       // Asset bundle (include/asset_bundle.h) -> asset partition paired with the app slot
+} pkg_section_type_t;
+
+// Section encodings (flags); FILES sections compress each file's data on its own
+#define PKG_ENCODING_DEFLATE (1 << 0)   // zlib stream; file records carry the raw size
+#define PKG_ENCODING_DELTA   (1 << 1)   // Patch against the running app (APP only)
+
+// A section table entry
+typedef struct {
+    uint32_t type;                      // pkg_section_type_t
+    uint32_t encoding;                  // PKG_ENCODING_*
+    char label[PKG_LABEL_MAX_LEN + 1];  // Target partition of PARTITION sections, "" otherwise
+    uint32_t offset;                    // Package offset of the section's first byte
+    uint32_t length;                    // Bytes in the package
+    uint32_t size;                      // Bytes once decoded (== length when stored raw; unused for FILES)
+    bool verify;                        // `sha256` is set (every format but v1)
+    uint8_t sha256[PKG_SHA256_LEN];     // Digest of the section as sent
+    uint8_t base_sha256[PKG_SHA256_LEN];// Delta only, app_elf_sha256 of the image the patch applies to
+} pkg_section_t;
+
+typedef struct {
+    uint32_t version;                   // Package format version (1, 2 or 3)
+    uint32_t header_size;               // Bytes before the first section
+    uint32_t section_count;
+    pkg_section_t sections[PKG_MAX_SECTIONS];
+} pkg_header_t;
+
+// A LittleFS file record
+typedef struct {
+    const char *name;                   // NUL terminated, relative to the web bank root
+    uint16_t name_len;
+    uint32_t stored_size;               // Bytes of data in the package
+    uint32_t size;                      // Bytes once decompressed (== stored_size when stored raw)
+    const uint8_t *sha256;              // Digest of the decompressed data, NULL in v1 packages
+} pkg_file_t;
+
+// Return values of pkg_parser_feed(); callbacks return PKG_PARSER_OK, PKG_PARSER_SKIP or a negative value to stop
+typedef enum {
+    PKG_PARSER_OK = 0,
+    PKG_PARSER_SKIP = 1,                // From file_begin: the file's data is not delivered (section_data still is)
+    PKG_PARSER_ERR_MAGIC = -1,          // Not a package
+    PKG_PARSER_ERR_HEADER = -2,         // Header size or fields are inconsistent
+    PKG_PARSER_ERR_RECORD = -3,         // Invalid file record
+    PKG_PARSER_ERR_TRAILING = -4,       // Bytes after the end of the package
+    PKG_PARSER_ERR_CALLBACK = -5,       // A callback stopped the parser
+    PKG_PARSER_ERR_STATE = -6,          // Fed after an error
+} pkg_parser_status_t;
+
+typedef struct {
+    int (*header)(void *ctx, const pkg_header_t *header);
+    int (*section_begin)(void *ctx, const pkg_section_t *section);
+    int (*section_data)(void *ctx, const pkg_section_t *section, const uint8_t *data, size_t len);
+    int (*stream_data)(void *ctx, const pkg_section_t *section, const uint8_t *data, size_t len);
+    int (*file_begin)(void *ctx, const pkg_file_t *file);
+    int (*file_data)(void *ctx, const uint8_t *data, size_t len);
+    int (*file_end)(void *ctx, const pkg_file_t *file);
+    int (*section_end)(void *ctx, const pkg_section_t *section);
+    int (*trailer)(void *ctx);
+} pkg_parser_callbacks_t;
+
+typedef enum {
+    PKG_STATE_MAGIC,
+    PKG_STATE_HEADER,
+    PKG_STATE_SECTION_TABLE,            // v3 table entries, then header bytes this parser does not know
+    PKG_STATE_STREAM,                   // Data of a section other than FILES
+    PKG_STATE_FILE_RECORD,              // File record fields
+    PKG_STATE_FILE_NAME,
+    PKG_STATE_FILE_DATA,
+    PKG_STATE_DONE,
+    PKG_STATE_ERROR,
+} pkg_parser_state_t;
+
+// Parser state; allocate it anywhere (it holds the header and one file record)
+typedef struct {
+    const pkg_parser_callbacks_t *callbacks;
+    void *ctx;
+    pkg_parser_state_t state;
+    pkg_header_t header;
+    uint32_t offset;                    // Package bytes consumed
+    uint32_t section;                   // Index of the current section
+    uint32_t section_left;              // Bytes left in the current section
+    uint32_t item_left;                 // Bytes left in the current stream or file data
+    uint32_t header_left;               // v3: header bytes after the field buffer
+    uint32_t entry_size;                // v3: bytes per table entry
+    size_t need;                        // Bytes the field buffer must hold before it can be parsed
+    size_t have;
+    bool skip_file;
+    pkg_file_t file;
+    uint8_t buffer[PKG_HEADER_MAX_SIZE];// Header, table entry or the current file record
+    char name[PKG_FILE_NAME_MAX_LEN + 1];
+} pkg_parser_t;
+
+/**
+ * @brief true if `data` starts with a package magic (needs PKG_MAGIC_LEN bytes)
+ */
+bool pkg_parser_sniff(const uint8_t *data, size_t len);
+
+/**
+ * @brief Start parsing a package at its first byte
+ */
+void pkg_parser_init(pkg_parser_t *parser, const pkg_parser_callbacks_t *callbacks, void *ctx);
+
+/**
+ * @brief Continue a package at `offset`, a position pkg_parser_offset() returned earlier
+ *
+ * `offset` must be at the start of a section, inside a section other than FILES, or at a
+ * file record boundary. No header or section_begin callback is made for the section it falls in.
+ *
+ * @return PKG_PARSER_OK, or PKG_PARSER_ERR_HEADER if `offset` does not fit the header
+ */
+int pkg_parser_resume(pkg_parser_t *parser, const pkg_parser_callbacks_t *callbacks, void *ctx,
+                      const pkg_header_t *header, uint32_t offset);
+
+/**
+ * @brief Parse the next `len` package bytes
+ *
+ * @return PKG_PARSER_OK, or a negative pkg_parser_status_t; the parser stays failed after an error
+ */
+int pkg_parser_feed(pkg_parser_t *parser, const uint8_t *data, size_t len);
+
+/**
+ * @brief Bytes that complete the current header, record or data item
+ *
+ * A hint for pull-style callers: feeding exactly this many bytes keeps every data callback
+ * on a whole slice. 0 once the package is complete.
+ */
+size_t pkg_parser_wants(const pkg_parser_t *parser);
+
+/**
+ * @brief Package bytes consumed so far
+ */
+uint32_t pkg_parser_offset(const pkg_parser_t *parser);
+
+/**
+ * @brief Current state
+ */
+pkg_parser_state_t pkg_parser_state(const pkg_parser_t *parser);
+
+/**
+ * @brief Index of the section being parsed (valid from its section_begin on)
+ */
+uint32_t pkg_parser_section(const pkg_parser_t *parser);
+
+/**
+ * @brief true between two file records, where pkg_parser_resume() can pick up again
+ */
+bool pkg_parser_at_record_start(const pkg_parser_t *parser);
+
+/**
+ * @brief true once the trailer has been reported
+ */
+bool pkg_parser_done(const pkg_parser_t *parser);
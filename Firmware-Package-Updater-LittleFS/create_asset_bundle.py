@@ -0,0 +1,94 @@
+import argparse
+import hashlib
+import os
+import struct
+
+from prepare_web_assets import MANIFEST_NAME
+
+# Flat asset bundle for the assets_N partitions (include/asset_bundle.h). The device maps the
+# partition and serves from it without a file system:
+#   header | index sorted by path | NUL-terminated strings | payloads (4-byte aligned)
+BUNDLE_MAGIC = b"ESP_ASSETS"  # 10-byte magic
+BUNDLE_VERSION = 1
+HEADER_FORMAT = "<10sHII"  # Magic, version, entry count, bundle size
+ENTRY_FORMAT = "<IIII32s"  # Path offset, MIME offset, data offset, data length, SHA-256 of the data
+PAYLOAD_ALIGNMENT = 4
+
+# Content-Type by extension, as the device's handlers send them; .gz variants take their file's type
+MIME_TYPES = {
+    ".html": "text/html",
+    ".htm": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".mjs": "application/javascript",
+    ".json": "application/json",
+    ".map": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".jpeg": "image/jpeg",
+    ".gif": "image/gif",
+    ".ico": "image/x-icon",
+    ".woff": "font/woff",
+    ".woff2": "font/woff2",
+    ".txt": "text/plain",
+    ".xml": "text/xml",
+}
+
+def mime_type(name):
+    if name.endswith(".gz"):
+        name = name[:-3]
+    return MIME_TYPES.get(os.path.splitext(name)[1].lower(), "application/octet-stream")
+
+def build_bundle(source_folder):
+    """ Returns the bundle holding every file below source_folder (a staged web_assets folder,
+        so .gz variants are included); the asset manifest is left out, the index has the hashes """
+    files = []
+    for root, _, names in os.walk(source_folder):
+        for name in names:
+            path = os.path.join(root, name)
+            relative_path = os.path.relpath(path, source_folder).replace(os.sep, "/")
+            if relative_path.startswith(MANIFEST_NAME):
+                continue
+            with open(path, "rb") as f:
+                files.append((relative_path.encode("utf-8"), f.read()))
+    files.sort()  # Byte order, which is strcmp() order on the device
+
+    strings = bytearray()
+    string_offsets = {}
+    def add_string(value):
+        if value not in string_offsets:
+            string_offsets[value] = len(strings)
+            strings.extend(value + b"\0")
+        return string_offsets[value]
+    names = [(add_string(path), add_string(mime_type(path.decode("utf-8")).encode("ascii"))) for path, _ in files]
+
+    strings_start = struct.calcsize(HEADER_FORMAT) + struct.calcsize(ENTRY_FORMAT) * len(files)
+    data_offset = strings_start + len(strings)
+    index = b""
+    payloads = b""
+    for (path_offset, mime_offset), (_, data) in zip(names, files):
+        padding = -(data_offset + len(payloads)) % PAYLOAD_ALIGNMENT
+        payloads += b"\0" * padding
+        index += struct.pack(ENTRY_FORMAT, strings_start + path_offset, strings_start + mime_offset,
+                             data_offset + len(payloads), len(data), hashlib.sha256(data).digest())
+        payloads += data
+
+    bundle_size = data_offset + len(payloads)
+    return struct.pack(HEADER_FORMAT, BUNDLE_MAGIC, BUNDLE_VERSION, len(files), bundle_size) + index + bytes(strings) + payloads
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Pack the staged web assets into a flat bundle for an assets_N partition")
+    parser.add_argument("source_folder", help="Staged web assets (build/web_assets, see prepare_web_assets.py)")
+    parser.add_argument("output_bundle", help="Output .bin, flashed to assets_1 or shipped with create_firmware_update_package.py --asset-bundle")
+    parser.add_argument("--max-size", type=lambda value: int(value, 0), default=0x40000,
+                        help="Size of the asset partition (default 0x40000, as in partitions.csv)")
+    args = parser.parse_args()
+
+    bundle = build_bundle(args.source_folder)
+    if len(bundle) > args.max_size:
+        parser.error(f"Bundle is {len(bundle)} bytes, the asset partition holds {args.max_size}")
+    with open(args.output_bundle, "wb") as f:
+        f.write(bundle)
+    entry_count, = struct.unpack_from("<I", bundle, 12)
+    print(f"Asset bundle '{args.output_bundle}': {entry_count} files, {len(bundle)} bytes")
@@ -1,72 +1,344 @@
+import argparse
+import hashlib
+import json
 import os
 import struct
-import sys
+import urllib.request
+import zlib
+
+from prepare_web_assets import MANIFEST_NAME, gzip_variant
 
 # Define package format
-PACKAGE_HEADER = b"ESP_UPDATE"  # 10-byte magic header
+PACKAGE_HEADER = b"ESP_UPDATE"  # 10-byte magic header (v1)
 HEADER_FORMAT = "<IIII"  # Four little-endian integers: firmware size, LittleFS size, firmware offset, LittleFS offset
 HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
 
-def create_package(firmware_path, LittleFS_folder, output_file):
-    """ Creates a single .pkg update file containing firmware and LittleFS files """
-    
-    # Read firmware
-    with open(firmware_path, "rb") as f:
-        firmware_data = f.read()
+# v2 adds a header size, flags and SHA-256 digests of both sections and of every file
+PACKAGE_HEADER_V2 = b"ESP_PKG_V2"  # 10-byte magic header (v2)
+HEADER_V2_FORMAT = "<IIIIII32s32s"  # Header size, flags, the four v1 fields, firmware SHA-256, LittleFS section SHA-256
+HEADER_V2_SIZE = len(PACKAGE_HEADER_V2) + struct.calcsize(HEADER_V2_FORMAT)
+
+# v2 header flags
+FLAG_FIRMWARE_DEFLATE = 1 << 0  # Firmware section is a zlib stream; the header gains its decompressed size (uint32)
+FLAG_FILES_DEFLATE = 1 << 1  # Each file's data is a zlib stream; its record gains the decompressed size (uint32)
+FLAG_FIRMWARE_DELTA = 1 << 2  # Firmware section is a patch against the running app; the header gains its image size and base digest
+FLAG_LITTLEFS_IMAGE = 1 << 3  # LittleFS section is a whole partition image (one zlib stream with FLAG_FILES_DEFLATE); the header gains its size
+
+# v3 replaces the fixed firmware + LittleFS fields with a table of sections, which follow the header in table order
+PACKAGE_HEADER_V3 = b"ESP_PKG_V3"  # 10-byte magic header (v3)
+HEADER_V3_FORMAT = "<IIHH"  # Header size, flags (none defined yet), section count, table entry size
+SECTION_ENTRY_FORMAT = "<BBH16sII32s32s"  # Type, encoding, reserved, target label, length, decoded size, SHA-256 as sent, delta base ELF SHA-256
+HEADER_V3_SIZE = len(PACKAGE_HEADER_V3) + struct.calcsize(HEADER_V3_FORMAT)
+MAX_SECTIONS = 8  # PKG_MAX_SECTIONS on the device
+
+# v3 section types and encodings (components/pkg_parser/pkg_parser.h)
+SECTION_APP = 0  # App image -> next OTA slot
+SECTION_FILES = 1  # File records -> web bank paired with that slot
+SECTION_WEB_IMAGE = 2  # LittleFS partition image -> web bank paired with that slot
+SECTION_PARTITION = 3  # Raw image -> the data partition named by the label
+SECTION_ASSET_BUNDLE = 4  # Asset bundle (create_asset_bundle.py) -> asset partition paired with that slot
+ENCODING_DEFLATE = 1 << 0
+ENCODING_DELTA = 1 << 1
+COMPRESSION_LEVEL = 9  # zlib level; the device decoder always uses a 32 KB window
+
+# Delta patch operations (see include/delta_patch.h)
+DELTA_OP_COPY = 0x01  # uint32 source offset, uint32 length
+DELTA_OP_DATA = 0x02  # uint32 length, literal bytes
+DELTA_BLOCK_SIZE = 32  # Granularity of the base image index
+DELTA_MIN_COPY = 24  # Shorter matches cost more as a COPY than as literal bytes
+
+# ESP-IDF app image layout: esp_app_desc_t follows the 24-byte image header and first 8-byte segment header
+APP_DESC_OFFSET = 32
+APP_DESC_MAGIC = 0xABCD5432
+APP_ELF_SHA256_OFFSET = APP_DESC_OFFSET + 144  # esp_app_desc_t.app_elf_sha256
+
+def app_elf_sha256(image):
+    """ Returns the ELF digest the device reports through esp_app_get_description() """
+    magic, = struct.unpack_from("<I", image, APP_DESC_OFFSET)
+    if magic != APP_DESC_MAGIC:
+        raise ValueError("Base firmware is not an ESP-IDF app image")
+    return image[APP_ELF_SHA256_OFFSET:APP_ELF_SHA256_OFFSET + 32]
+
+def create_delta(base, target):
+    """ Encodes `target` as COPY ranges from `base` and literal DATA runs """
+    index = {}
+    for offset in range(0, len(base) - DELTA_BLOCK_SIZE + 1, DELTA_BLOCK_SIZE):
+        index.setdefault(base[offset:offset + DELTA_BLOCK_SIZE], offset)
+
+    patch = bytearray()
+    literal_start = 0
+    position = 0
+
+    def flush_literal(end):
+        if end > literal_start:
+            patch.extend(struct.pack("<BI", DELTA_OP_DATA, end - literal_start))
+            patch.extend(target[literal_start:end])
+
+    while position + DELTA_BLOCK_SIZE <= len(target):
+        source = index.get(target[position:position + DELTA_BLOCK_SIZE])
+        if source is None:
+            position += 1
+            continue
+
+        # Grow the match backwards into pending literals and forwards as far as the images agree
+        start, source_start = position, source
+        while start > literal_start and source_start > 0 and target[start - 1] == base[source_start - 1]:
+            start -= 1
+            source_start -= 1
+        end, source_end = position + DELTA_BLOCK_SIZE, source + DELTA_BLOCK_SIZE
+        while end < len(target) and source_end < len(base) and target[end] == base[source_end]:
+            end += 1
+            source_end += 1
+
+        if end - start < DELTA_MIN_COPY:
+            position += 1
+            continue
+
+        flush_literal(start)
+        patch.extend(struct.pack("<BII", DELTA_OP_COPY, source_start, end - start))
+        literal_start = position = end
 
-    # Collect LittleFS files
+    flush_literal(len(target))
+    return bytes(patch)
+
+def load_device_manifest(source):
+    """ Reads the device's asset hashes (GET /asset_manifest) from a saved file or straight from the device URL """
+    if source.startswith("http://") or source.startswith("https://"):
+        with urllib.request.urlopen(source) as response:
+            manifest = json.load(response)
+    else:
+        with open(source, "r") as f:
+            manifest = json.load(f)
+    return {entry["name"]: (entry["sha256"], entry["size"]) for entry in manifest["files"]}
+
+def collect_files(LittleFS_folder, device_manifest, gzip_assets=True):
+    """ Reads every file below LittleFS_folder, plus the .gz variants of text assets, leaving out files the device already holds """
     LittleFS_files = []
+    skipped_files = 0
     for root, _, files in os.walk(LittleFS_folder):
-        for file in files:
+        for file in sorted(files):
+            if file.startswith(MANIFEST_NAME):
+                continue  # The device keeps its own manifest (a staged build/web_assets folder has one)
             file_path = os.path.join(root, file)
             with open(file_path, "rb") as f:
                 file_data = f.read()
             relative_path = os.path.relpath(file_path, LittleFS_folder)
-            
-            # Encode file name
-            file_name_encoded = relative_path.encode("utf-8")
 
-            # Print metadata before writing
-            print(f"Adding file: {relative_path}")
-            print(f"   - File Name Length: {len(file_name_encoded)} bytes")
-            print(f"   - File Size: {len(file_data)} bytes")
+            # A variant follows its file: the device drops the old variant when it writes the file
+            candidates = [(relative_path, file_data)]
+            if gzip_assets and file + ".gz" not in files:
+                compressed = gzip_variant(relative_path, file_data)
+                if compressed is not None:
+                    candidates.append((relative_path + ".gz", compressed))
+
+            for relative_path, file_data in candidates:
+                # Leave out files the device already holds; it never deletes files missing from a package
+                if device_manifest and device_manifest.get(relative_path) == (hashlib.sha256(file_data).hexdigest(), len(file_data)):
+                    print(f"Unchanged on device, leaving out: {relative_path}")
+                    skipped_files += 1
+                    continue
+
+                # Encode file name
+                file_name_encoded = relative_path.encode("utf-8")
+
+                # Print metadata before writing
+                print(f"Adding file: {relative_path}")
+                print(f"   - File Name Length: {len(file_name_encoded)} bytes")
+                print(f"   - File Size: {len(file_data)} bytes")
 
-            LittleFS_files.append((file_name_encoded, file_data))
+                LittleFS_files.append((file_name_encoded, file_data))
+    return LittleFS_files, skipped_files
 
-    # Serialize LittleFS file structure
-    LittleFS_data = b""
-    for file_name, file_content in LittleFS_files:
-        LittleFS_data += struct.pack("<H", len(file_name))  # File name length (2 bytes, little-endian)
-        LittleFS_data += struct.pack("<I", len(file_content))  # File size (4 bytes, little-endian)
-        LittleFS_data += file_name  # File name bytes
-        LittleFS_data += file_content  # File data
+def section_table_header(sections):
+    """ Packs the v3 header for (type, encoding, label, data, decoded size, delta base) sections """
+    entry_size = struct.calcsize(SECTION_ENTRY_FORMAT)
+    header_size = HEADER_V3_SIZE + entry_size * len(sections)
+    header = PACKAGE_HEADER_V3 + struct.pack(HEADER_V3_FORMAT, header_size, 0, len(sections), entry_size)
+    for section_type, encoding, label, data, size, base_sha256 in sections:
+        header += struct.pack(SECTION_ENTRY_FORMAT, section_type, encoding, 0, label.encode("utf-8"), len(data), size,
+                              hashlib.sha256(data).digest(), base_sha256)
+    return header
+
+def create_package(firmware_path, LittleFS_folder, output_file, version=3, compress=False, delta_base_path=None,
+                   device_manifest=None, littlefs_image=False, partitions=None, gzip_assets=True, asset_bundle_path=None):
+    """ Creates a single .pkg update file containing firmware and LittleFS files (or a LittleFS partition image),
+        plus, in v3, an asset bundle and images for other data partitions given as (label, path) pairs """
+
+    if (compress or delta_base_path or littlefs_image) and version < 2:
+        raise ValueError("Compression, delta firmware and LittleFS images require package format v2")
+    if (partitions or asset_bundle_path) and version < 3:
+        raise ValueError("Partition images and asset bundles require package format v3")
+    if partitions and 2 + bool(asset_bundle_path) + len(partitions) > MAX_SECTIONS:
+        raise ValueError(f"A package holds at most {MAX_SECTIONS - 2 - bool(asset_bundle_path)} partition images")
+    for label, _ in partitions or []:
+        if not 0 < len(label.encode("utf-8")) <= 16:
+            raise ValueError(f"Invalid partition label: {label!r}")
+    flags = (FLAG_FIRMWARE_DEFLATE | FLAG_FILES_DEFLATE) if compress else 0
+    if delta_base_path:
+        flags |= FLAG_FIRMWARE_DELTA
+    if littlefs_image:
+        flags |= FLAG_LITTLEFS_IMAGE
+
+    # Read firmware
+    with open(firmware_path, "rb") as f:
+        firmware_data = f.read()
+
+    skipped_files = 0
+    if littlefs_image:
+        # A prebuilt partition image (build/web_1.bin from littlefs_create_partition_image) replaces the whole partition
+        with open(LittleFS_folder, "rb") as f:
+            image_data = f.read()
+        LittleFS_data = zlib.compress(image_data, COMPRESSION_LEVEL) if compress else image_data
+        print(f"Adding LittleFS image: {LittleFS_folder} ({len(image_data)} bytes)")
+    else:
+        LittleFS_files, skipped_files = collect_files(LittleFS_folder, device_manifest, gzip_assets)
+
+        # Serialize LittleFS file structure
+        LittleFS_data = b""
+        for file_name, file_content in LittleFS_files:
+            stored_content = zlib.compress(file_content, COMPRESSION_LEVEL) if compress else file_content
+            LittleFS_data += struct.pack("<H", len(file_name))  # File name length (2 bytes, little-endian)
+            LittleFS_data += struct.pack("<I", len(stored_content))  # Stored file size (4 bytes, little-endian)
+            if compress:
+                LittleFS_data += struct.pack("<I", len(file_content))  # Decompressed file size (4 bytes, little-endian)
+            if version >= 2:
+                LittleFS_data += hashlib.sha256(file_content).digest()  # SHA-256 of the decompressed file (32 bytes)
+            LittleFS_data += file_name  # File name bytes
+            LittleFS_data += stored_content  # File data
+
+    # Diff, then compress firmware
+    firmware_image_size = len(firmware_data)
+    header_extension = b""
+    if delta_base_path:
+        with open(delta_base_path, "rb") as f:
+            base_data = f.read()
+        base_sha256 = app_elf_sha256(base_data)
+        firmware_data = create_delta(base_data, firmware_data)
+        print(f"Delta against {delta_base_path}: {len(firmware_data)} byte patch for a {firmware_image_size} byte image")
+    if compress:
+        firmware_data = zlib.compress(firmware_data, COMPRESSION_LEVEL)
+    if flags & (FLAG_FIRMWARE_DEFLATE | FLAG_FIRMWARE_DELTA):
+        header_extension += struct.pack("<I", firmware_image_size)
+    if delta_base_path:
+        header_extension += base_sha256
+    if littlefs_image:
+        header_extension += struct.pack("<I", len(image_data))
 
     # Create package header
-    firmware_offset = len(PACKAGE_HEADER) + HEADER_SIZE  # Firmware starts after the header
+    if version >= 3:
+        # Sections go in the order the device applies them: app, web assets, then the partitions without an A/B copy
+        encoding = (ENCODING_DEFLATE if compress else 0) | (ENCODING_DELTA if delta_base_path else 0)
+        sections = [(SECTION_APP, encoding, "", firmware_data, firmware_image_size, base_sha256 if delta_base_path else b"")]
+        if littlefs_image:
+            sections.append((SECTION_WEB_IMAGE, ENCODING_DEFLATE if compress else 0, "", LittleFS_data, len(image_data), b""))
+        else:
+            sections.append((SECTION_FILES, ENCODING_DEFLATE if compress else 0, "", LittleFS_data, len(LittleFS_data), b""))
+        if asset_bundle_path:
+            with open(asset_bundle_path, "rb") as f:
+                bundle_data = f.read()
+            stored_data = zlib.compress(bundle_data, COMPRESSION_LEVEL) if compress else bundle_data
+            sections.append((SECTION_ASSET_BUNDLE, ENCODING_DEFLATE if compress else 0, "", stored_data, len(bundle_data), b""))
+        for label, path in partitions or []:
+            with open(path, "rb") as f:
+                partition_data = f.read()
+            stored_data = zlib.compress(partition_data, COMPRESSION_LEVEL) if compress else partition_data
+            sections.append((SECTION_PARTITION, ENCODING_DEFLATE if compress else 0, label, stored_data, len(partition_data), b""))
+            print(f"Adding partition image: {path} -> {label} ({len(partition_data)} bytes)")
+
+        package_header = section_table_header(sections)
+        with open(output_file, "wb") as f:
+            f.write(package_header)
+            for section in sections:
+                f.write(section[3])
+
+        print(f"\n Package '{output_file}' (format v{version}) created successfully!")
+        offset = len(package_header)
+        for section_type, encoding, label, data, size, _ in sections:
+            name = {SECTION_APP: "Firmware", SECTION_FILES: "LittleFS files", SECTION_WEB_IMAGE: "LittleFS image",
+                    SECTION_ASSET_BUNDLE: "Asset bundle"}.get(section_type, f"Partition {label}")
+            print(f"   - {name}: {len(data)} bytes at offset {offset}" + (f" (encoded from {size})" if encoding and section_type != SECTION_FILES else "")
+                  + f", SHA-256 {hashlib.sha256(data).hexdigest()}")
+            offset += len(data)
+        if delta_base_path:
+            print(f"   - Delta Base ELF SHA-256: {base_sha256.hex()}")
+        if device_manifest and not littlefs_image:
+            print(f"   - {skipped_files} unchanged files left out")
+        return
+
+    if version >= 2:
+        firmware_offset = HEADER_V2_SIZE + len(header_extension)  # Firmware starts after the header
+    else:
+        firmware_offset = len(PACKAGE_HEADER) + HEADER_SIZE  # Firmware starts after the header
     LittleFS_offset = firmware_offset + len(firmware_data)  # LittleFS starts after firmware
 
-    package_header = struct.pack("<IIII", len(firmware_data), len(LittleFS_data), firmware_offset, LittleFS_offset)
+    if version >= 2:
+        magic = PACKAGE_HEADER_V2
+        package_header = struct.pack(HEADER_V2_FORMAT, firmware_offset, flags,
+                                     len(firmware_data), len(LittleFS_data), firmware_offset, LittleFS_offset,
+                                     hashlib.sha256(firmware_data).digest(), hashlib.sha256(LittleFS_data).digest())
+        package_header += header_extension
+    else:
+        magic = PACKAGE_HEADER
+        package_header = struct.pack(HEADER_FORMAT, len(firmware_data), len(LittleFS_data), firmware_offset, LittleFS_offset)
 
     # Write the final package
     with open(output_file, "wb") as f:
-        f.write(PACKAGE_HEADER)
+        f.write(magic)
         f.write(package_header)
         f.write(firmware_data)
         f.write(LittleFS_data)
 
-    print(f"\n Package '{output_file}' created successfully!")
-    print(f"   - Firmware Size: {len(firmware_data)} bytes")
-    print(f"   - LittleFS Size: {len(LittleFS_data)} bytes")
+    print(f"\n Package '{output_file}' (format v{version}) created successfully!")
+    print(f"   - Firmware Size: {len(firmware_data)} bytes" + (f" (encoded from {firmware_image_size})" if flags & (FLAG_FIRMWARE_DEFLATE | FLAG_FIRMWARE_DELTA) else ""))
+    print(f"   - LittleFS Size: {len(LittleFS_data)} bytes" + (f" ({skipped_files} unchanged files left out)" if device_manifest and not littlefs_image else "")
+          + (" (partition image)" if littlefs_image else ""))
     print(f"   - Firmware Offset: {firmware_offset}")
     print(f"   - LittleFS Offset: {LittleFS_offset}")
+    if delta_base_path:
+        print(f"   - Delta Base ELF SHA-256: {base_sha256.hex()}")
+    if version >= 2:
+        print(f"   - Firmware SHA-256: {hashlib.sha256(firmware_data).hexdigest()}")
+        print(f"   - LittleFS SHA-256: {hashlib.sha256(LittleFS_data).hexdigest()}")
 
 if __name__ == "__main__":
-    if len(sys.argv) != 4:
-        print("Usage: python create_update_package.py <firmware.bin> <LittleFS_folder> <output.pkg>")
-        sys.exit(1)
+    parser = argparse.ArgumentParser(description="Create a firmware + LittleFS update package")
+    parser.add_argument("firmware_bin", help="Firmware .bin file")
+    parser.add_argument("LittleFS_folder", help="Folder whose files are written to the LittleFS web partition (or an image with --littlefs-image)")
+    parser.add_argument("output_package", help="Output .pkg file")
+    parser.add_argument("--v1", action="store_true", help="Write the legacy v1 format without SHA-256 digests")
+    parser.add_argument("--v2", action="store_true", help="Write the v2 format, for devices running firmware without section table support")
+    parser.add_argument("--compress", action="store_true", help="Deflate the firmware and every file (not with --v1)")
+    parser.add_argument("--delta-base", metavar="BASE_BIN",
+                        help="Ship the firmware as a patch against this .bin, which must be the firmware running on the device (not with --v1)")
+    parser.add_argument("--only-changed", metavar="MANIFEST",
+                        help="Leave out files whose hash matches the device's /asset_manifest (a saved JSON file or http://<device>/asset_manifest)")
+    parser.add_argument("--littlefs-image", action="store_true",
+                        help="LittleFS_folder is a prebuilt partition image such as build/web_1.bin; it replaces the whole web partition (not with --v1)")
+    parser.add_argument("--no-gzip", action="store_true",
+                        help="Do not add precompressed .gz variants of text assets (the device then serves them uncompressed)")
+    parser.add_argument("--partition", metavar="LABEL=IMAGE", action="append", default=[],
+                        help="Also write IMAGE to the data partition LABEL, e.g. an NVS preset (v3 only, repeatable)")
+    parser.add_argument("--asset-bundle", metavar="BUNDLE",
+                        help="Also ship a bundle from create_asset_bundle.py, served from mapped flash by the new firmware (v3 only)")
+    args = parser.parse_args()
 
-    firmware_bin = sys.argv[1]
-    LittleFS_folder = sys.argv[2]
-    output_package = sys.argv[3]
+    if args.v1 and args.v2:
+        parser.error("--v1 and --v2 are mutually exclusive")
+    if args.v1 and (args.compress or args.delta_base or args.littlefs_image):
+        parser.error("--compress, --delta-base and --littlefs-image require the v2 format")
+    if (args.v1 or args.v2) and (args.partition or args.asset_bundle):
+        parser.error("--partition and --asset-bundle require the v3 format")
+    partitions = []
+    for spec in args.partition:
+        label, sep, path = spec.partition("=")
+        if not sep or not label or not path:
+            parser.error(f"--partition expects LABEL=IMAGE, got {spec!r}")
+        partitions.append((label, path))
+    if args.littlefs_image and args.only_changed:
+        parser.error("--only-changed applies to individual files, not to --littlefs-image")
 
-    create_package(firmware_bin, LittleFS_folder, output_package)
\ No newline at end of file
+    device_manifest = load_device_manifest(args.only_changed) if args.only_changed else None
+    create_package(args.firmware_bin, args.LittleFS_folder, args.output_package,
+                   version=1 if args.v1 else 2 if args.v2 else 3, compress=args.compress, delta_base_path=args.delta_base,
+                   device_manifest=device_manifest, littlefs_image=args.littlefs_image, partitions=partitions,
+                   gzip_assets=not args.no_gzip, asset_bundle_path=args.asset_bundle)
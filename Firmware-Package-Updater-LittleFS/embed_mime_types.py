@@ -0,0 +1,30 @@
+import argparse
+
+from create_asset_bundle import MIME_TYPES
+
+# Compiles MIME_TYPES into the firmware: writes the C source of the extension table declared in
+# include/mime_types.h, so files in the web bank get the Content-Type the bundle and the embedded
+# table were built with. Run by main/CMakeLists.txt whenever create_asset_bundle.py changes.
+
+def c_string(value):
+    return '"' + value.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+def generate_table():
+    entries = "".join(f"    {{ {c_string(extension[1:].lower())}, {c_string(mime_type)} }},\n"
+                      for extension, mime_type in MIME_TYPES.items())
+    return ("// Generated by embed_mime_types.py from create_asset_bundle.py, do not edit\n"
+            "#include \"mime_types.h\"\n\n"
+            "const mime_type_entry_t mime_type_table[] = {\n"
+            + entries
+            + "};\n"
+            + "const size_t mime_type_count = sizeof(mime_type_table) / sizeof(mime_type_table[0]);\n\n"
+            + "_Static_assert(sizeof(mime_type_table) / sizeof(mime_type_table[0]) < MIME_TYPE_SLOT_COUNT / 2, \"Keep the table at most half full\");\n")
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Generate the MIME type table compiled into the firmware")
+    parser.add_argument("output_source", help="C file to write")
+    args = parser.parse_args()
+
+    source = generate_table()
+    with open(args.output_source, "w", newline="\n") as f:
+        f.write(source)
@@ -0,0 +1,65 @@
+import argparse
+import hashlib
+import os
+
+from create_asset_bundle import mime_type
+from prepare_web_assets import gzip_variant
+
+# Compiles html/ into the firmware: writes the C source of the constant asset table declared in
+# include/embedded_assets.h. Run by main/CMakeLists.txt whenever a file in html/ changes.
+
+ETAG_HASH_BYTES = 16  # As in web_server.c: the leading bytes of the SHA-256, quoted hex
+
+def etag(data):
+    return '"' + hashlib.sha256(data).digest()[:ETAG_HASH_BYTES].hex() + '"'
+
+def c_array(name, data):
+    lines = [", ".join(f"0x{b:02x}" for b in data[i:i + 16]) for i in range(0, len(data), 16)]
+    body = ",\n    ".join(lines)
+    return f"static const uint8_t {name}[{len(data)}] = {{\n    {body}\n}};\n"
+
+def c_string(value):
+    return '"' + value.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+def generate_table(source_folder):
+    """ Returns the C source for every file below source_folder, sorted by URI """
+    assets = []
+    for root, _, files in os.walk(source_folder):
+        for file in files:
+            path = os.path.join(root, file)
+            uri = "/" + os.path.relpath(path, source_folder).replace(os.sep, "/")
+            with open(path, "rb") as f:
+                assets.append((uri.encode("utf-8"), f.read()))
+    assets.sort()  # Byte order, which is strcmp() order on the device
+
+    arrays = []
+    entries = []
+    for index, (uri, data) in enumerate(assets):
+        uri = uri.decode("utf-8")
+        name = f"asset_{index}"
+        arrays.append(c_array(name, data))
+        compressed = gzip_variant(uri, data)
+        if compressed is not None:
+            arrays.append(c_array(name + "_gz", compressed))
+            gzip_fields = f"{c_string(etag(compressed))}, {name}_gz, sizeof({name}_gz)"
+        else:
+            gzip_fields = "NULL, NULL, 0"
+        entries.append(f"    {{ {c_string(uri)}, {c_string(mime_type(uri))}, {c_string(etag(data))}, {name}, sizeof({name}), {gzip_fields} }},\n")
+
+    return ("// Generated by embed_web_assets.py from html/, do not edit\n"
+            "#include \"embedded_assets.h\"\n\n"
+            + "\n".join(arrays) + "\n"
+            + "const embedded_asset_t embedded_assets[] = {\n"
+            + ("".join(entries) if entries else "    { 0 },\n")
+            + "};\n"
+            + f"const size_t embedded_asset_count = {len(entries)};\n")
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Generate the embedded web asset table compiled into the firmware")
+    parser.add_argument("source_folder", help="Folder with the web assets (html/)")
+    parser.add_argument("output_source", help="C file to write")
+    args = parser.parse_args()
+
+    source = generate_table(args.source_folder)
+    with open(args.output_source, "w", newline="\n") as f:
+        f.write(source)
@@ -0,0 +1,203 @@
+#include "package_update.h"
+#include "web_bank.h"
+#include "project_settings.h"
+#include "host_flash.h"
+#include "host_heap.h"
+#include "host_vfs.h"
+
+#include <esp_log.h>
+#include <esp_littlefs.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Host benchmark for the whole package apply path: package_update_run() with its writer task,
+// the OTA writer, inflate, the asset manifest and the A/B bank sync, on top of a RAM flash laid
+// out from partitions.csv. The package is served from memory, so the time measured is the
+// device-side work without the network. Every repeat starts from blank flash, like a fresh device.
+
+#define DEFAULT_REPEATS 5
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+} bench_source_t;
+
+typedef struct {
+    int64_t total_us;
+    int64_t firmware_us;                // Start until the first access to the next web bank
+    int64_t littlefs_us;                // From there until the boot partition is switched
+    size_t peak_heap;
+    host_flash_stats_t ota;
+    host_flash_stats_t web;
+    host_vfs_stats_t files;
+} bench_run_t;
+
+static int source_recv(void *ctx, char *buffer, size_t len) {
+    bench_source_t *source = ctx;
+    size_t left = source->size - source->offset;
+    if (left == 0) {
+        return -1;
+    }
+    if (len > left) {
+        len = left;
+    }
+    memcpy(buffer, source->data + source->offset, len);
+    source->offset += len;
+    return (int)len;
+}
+
+static uint8_t *load_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = (length > 0) ? malloc(length) : NULL;
+    if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = data ? (size_t)length : 0;
+    return data;
+}
+
+static esp_err_t apply_once(const uint8_t *package, size_t size, bench_run_t *run) {
+    host_flash_reset();
+    esp_err_t err = web_bank_mount_active();
+    if (err != ESP_OK) {
+        return err;
+    }
+    const esp_partition_t *active_bank = web_bank_partition(esp_ota_get_running_partition());
+    const esp_partition_t *update_app = esp_ota_get_next_update_partition(NULL);
+    const esp_partition_t *next_bank = web_bank_partition(update_app);
+
+    bench_source_t source = { .data = package, .size = size };
+    package_update_config_t config = {
+        .recv = source_recv,
+        .recv_ctx = &source,
+        .size = size,
+    };
+    package_update_result_t result;
+
+    host_flash_reset_stats();
+    host_vfs_reset_stats();
+    host_heap_reset_peak();
+    size_t heap_before = host_heap_used();
+    int64_t start = esp_timer_get_time();
+    err = package_update_run(&config, &result);
+    int64_t end = esp_timer_get_time();
+
+    if (err != ESP_OK) {
+        fprintf(stderr, "Update failed: %s (%s)\n", result.message ? result.message : "transport", esp_err_to_name(err));
+    } else if (esp_ota_get_boot_partition() != update_app) {
+        fprintf(stderr, "Update finished without switching the boot partition\n");
+        err = ESP_FAIL;
+    }
+
+    int64_t bank_start = host_flash_first_access_us(next_bank->label);
+    if (bank_start == 0 || bank_start > end) {
+        bank_start = end;
+    }
+    run->total_us = end - start;
+    run->firmware_us = bank_start - start;
+    run->littlefs_us = end - bank_start;
+    run->peak_heap = host_heap_peak() - heap_before;
+    run->ota = host_flash_stats(update_app->label);
+    run->web = host_flash_stats(next_bank->label);
+    run->files = host_vfs_stats();
+
+    esp_vfs_littlefs_unregister(active_bank->label);
+    return err;
+}
+
+static void print_stats(const char *label, const host_flash_stats_t *stats) {
+    printf("  %-8s %6" PRIu32 " writes (%" PRIu64 " bytes, %" PRIu32 " unaligned), %5" PRIu32 " sector erases, %6" PRIu32 " reads (%" PRIu64 " bytes)\n",
+           label, stats->writes, stats->write_bytes, stats->unaligned_writes, stats->erases, stats->reads, stats->read_bytes);
+    if (stats->dirty_writes) {
+        printf("  %-8s %" PRIu32 " writes to programmed bytes without an erase\n", label, stats->dirty_writes);
+    }
+}
+
+int main(int argc, char **argv) {
+    bool csv = false;
+    const char *args[3] = { 0 };
+    int arg_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (arg_count < 3) {
+            args[arg_count++] = argv[i];
+        }
+    }
+    if (arg_count < 1) {
+        fprintf(stderr, "Usage: %s [--csv] <package> [repeats] [partitions.csv]\n", argv[0]);
+        return 2;
+    }
+    int repeats = args[1] ? atoi(args[1]) : DEFAULT_REPEATS;
+    const char *partitions_csv = args[2] ? args[2] : HOST_PARTITIONS_CSV;
+    if (repeats < 1) {
+        fprintf(stderr, "repeats must be positive\n");
+        return 2;
+    }
+    const char *log_level = getenv("HOST_LOG_LEVEL");
+    if (log_level) {
+        host_log_level = (esp_log_level_t)atoi(log_level);
+    }
+
+    size_t size;
+    uint8_t *package = load_file(args[0], &size);
+    if (!package) {
+        fprintf(stderr, "Failed to read %s\n", args[0]);
+        return 1;
+    }
+    if (host_flash_init(partitions_csv) != ESP_OK) {
+        free(package);
+        return 1;
+    }
+
+    // Best run by total time; the heap peak is the highest seen in any run
+    bench_run_t best = { 0 };
+    size_t peak_heap = 0;
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < repeats && err == ESP_OK; i++) {
+        bench_run_t run;
+        err = apply_once(package, size, &run);
+        if (i == 0 || run.total_us < best.total_us) {
+            best = run;
+        }
+        if (run.peak_heap > peak_heap) {
+            peak_heap = run.peak_heap;
+        }
+    }
+
+    if (err == ESP_OK && csv) {
+        printf("%d,%d,%zu,%.3f,%.3f,%.3f,%.2f,%zu,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n",
+               WRITE_BLOCK_SIZE, UPDATE_PIPELINE_BUFFER_COUNT, size,
+               best.total_us / 1e3, best.firmware_us / 1e3, best.littlefs_us / 1e3,
+               best.total_us > 0 ? size / (double)best.total_us : 0.0, peak_heap,
+               best.ota.writes, best.ota.erases, best.web.writes, best.web.unaligned_writes, best.web.erases,
+               best.ota.unaligned_writes, best.files.file_writes, best.files.unaligned_file_writes);
+    } else if (err == ESP_OK) {
+        printf("Package %s: %zu bytes, WRITE_BLOCK_SIZE %d, %d pipeline buffers, best of %d\n",
+               args[0], size, WRITE_BLOCK_SIZE, UPDATE_PIPELINE_BUFFER_COUNT, repeats);
+        printf("  total %.3f ms (%.2f MB/s) | firmware %.3f ms | littlefs %.3f ms | peak heap %zu bytes\n",
+               best.total_us / 1e3, best.total_us > 0 ? size / (double)best.total_us : 0.0,
+               best.firmware_us / 1e3, best.littlefs_us / 1e3, peak_heap);
+        print_stats("ota", &best.ota);
+        print_stats("web", &best.web);
+        printf("  %-8s %6" PRIu32 " writes (%" PRIu64 " bytes, %" PRIu32 " unaligned)\n",
+               "files", best.files.file_writes, best.files.file_write_bytes, best.files.unaligned_file_writes);
+    }
+
+    host_flash_deinit();
+    free(package);
+    return err == ESP_OK ? 0 : 1;
+}
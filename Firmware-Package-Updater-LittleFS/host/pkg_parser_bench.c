@@ -0,0 +1,171 @@
+#include "pkg_parser.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Host throughput check for the package parser: the whole package is loaded into memory and
+// pushed through pkg_parser_feed() in fixed size slices, the way the device feeds received
+// buffers. Callbacks only count what they see, so the time measured is the parser's own cost:
+// data is never copied, so it mostly scales with the number of slices and callbacks.
+
+#define DEFAULT_SLICE_SIZE 8192         // Matches WRITE_BLOCK_SIZE in main/package_update.c
+#define DEFAULT_REPEATS 20
+
+typedef struct {
+    uint64_t section_bytes;
+    uint64_t stream_bytes;
+    uint64_t file_bytes;
+    uint32_t files;
+    uint32_t sections;
+    uint64_t callbacks;
+    bool trailer;
+    pkg_header_t header;
+} bench_counts_t;
+
+static int on_header(void *ctx, const pkg_header_t *header) {
+    ((bench_counts_t *)ctx)->callbacks++;
+    ((bench_counts_t *)ctx)->header = *header;
+    return PKG_PARSER_OK;
+}
+
+static int on_section_begin(void *ctx, const pkg_section_t *section) {
+    ((bench_counts_t *)ctx)->callbacks++;
+    return PKG_PARSER_OK;
+}
+
+static int on_section_data(void *ctx, const pkg_section_t *section, const uint8_t *data, size_t len) {
+    ((bench_counts_t *)ctx)->callbacks++;
+    ((bench_counts_t *)ctx)->section_bytes += len;
+    return PKG_PARSER_OK;
+}
+
+static int on_stream_data(void *ctx, const pkg_section_t *section, const uint8_t *data, size_t len) {
+    ((bench_counts_t *)ctx)->callbacks++;
+    ((bench_counts_t *)ctx)->stream_bytes += len;
+    return PKG_PARSER_OK;
+}
+
+static int on_file_data(void *ctx, const uint8_t *data, size_t len) {
+    ((bench_counts_t *)ctx)->callbacks++;
+    ((bench_counts_t *)ctx)->file_bytes += len;
+    return PKG_PARSER_OK;
+}
+
+static int on_file_end(void *ctx, const pkg_file_t *file) {
+    ((bench_counts_t *)ctx)->callbacks++;
+    ((bench_counts_t *)ctx)->files++;
+    return PKG_PARSER_OK;
+}
+
+static int on_section_end(void *ctx, const pkg_section_t *section) {
+    ((bench_counts_t *)ctx)->callbacks++;
+    ((bench_counts_t *)ctx)->sections++;
+    return PKG_PARSER_OK;
+}
+
+static int on_trailer(void *ctx) {
+    ((bench_counts_t *)ctx)->callbacks++;
+    ((bench_counts_t *)ctx)->trailer = true;
+    return PKG_PARSER_OK;
+}
+
+static const pkg_parser_callbacks_t callbacks = {
+    .header = on_header,
+    .section_begin = on_section_begin,
+    .section_data = on_section_data,
+    .stream_data = on_stream_data,
+    .file_data = on_file_data,
+    .file_end = on_file_end,
+    .section_end = on_section_end,
+    .trailer = on_trailer,
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t *load_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = (length > 0) ? malloc(length) : NULL;
+    if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = data ? (size_t)length : 0;
+    return data;
+}
+
+// Parses the package once; returns the first parser error, or PKG_PARSER_OK
+static int parse_once(const uint8_t *package, size_t size, size_t slice, bench_counts_t *counts) {
+    pkg_parser_t parser;
+    memset(counts, 0, sizeof(bench_counts_t));
+    pkg_parser_init(&parser, &callbacks, counts);
+    for (size_t offset = 0; offset < size; offset += slice) {
+        size_t len = (size - offset < slice) ? size - offset : slice;
+        int ret = pkg_parser_feed(&parser, package + offset, len);
+        if (ret < 0) {
+            fprintf(stderr, "Parser error %d at offset %" PRIu32 "\n", ret, pkg_parser_offset(&parser));
+            return ret;
+        }
+    }
+    return pkg_parser_done(&parser) ? PKG_PARSER_OK : PKG_PARSER_ERR_STATE;    // Truncated
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <package> [slice_bytes] [repeats]\n", argv[0]);
+        return 2;
+    }
+    size_t slice = (argc > 2) ? strtoul(argv[2], NULL, 0) : DEFAULT_SLICE_SIZE;
+    int repeats = (argc > 3) ? atoi(argv[3]) : DEFAULT_REPEATS;
+    if (slice == 0 || repeats < 1) {
+        fprintf(stderr, "slice_bytes and repeats must be positive\n");
+        return 2;
+    }
+
+    size_t size;
+    uint8_t *package = load_file(argv[1], &size);
+    if (!package) {
+        fprintf(stderr, "Failed to read %s\n", argv[1]);
+        return 1;
+    }
+
+    bench_counts_t counts;
+    if (parse_once(package, size, slice, &counts) != PKG_PARSER_OK || !counts.trailer) {
+        fprintf(stderr, "%s is not a complete update package\n", argv[1]);
+        free(package);
+        return 1;
+    }
+
+    double best = 0;
+    for (int i = 0; i < repeats; i++) {
+        double start = now_seconds();
+        parse_once(package, size, slice, &counts);
+        double elapsed = now_seconds() - start;
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    printf("Package v%" PRIu32 ", %" PRIu32 " sections, header %" PRIu32 " bytes, %zu bytes total\n",
+           counts.header.version, counts.header.section_count, counts.header.header_size, size);
+    printf("Streams: %" PRIu64 " bytes | files: %" PRIu32 " (%" PRIu64 " bytes)\n",
+           counts.stream_bytes, counts.files, counts.file_bytes);
+    printf("Slice %zu bytes, best of %d: %.3f ms, %.1f MB/s, %" PRIu64 " callbacks (%.1f ns each)\n",
+           slice, repeats, best * 1e3, best > 0 ? size / best / 1e6 : 0.0,
+           counts.callbacks, counts.callbacks ? best * 1e9 / counts.callbacks : 0.0);
+    free(package);
+    return 0;
+}
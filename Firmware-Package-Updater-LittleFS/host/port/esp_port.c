@@ -0,0 +1,114 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_app_desc.h"
+#include "host_heap.h"
+
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+esp_log_level_t host_log_level = ESP_LOG_WARN;
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void host_log(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char letters[] = "NEWIDV";
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+const esp_app_desc_t *esp_app_get_description(void) {
+    static const esp_app_desc_t desc = { .version = "host", .project_name = "host" };
+    return &desc;
+}
+
+// Heap accounting for the wrapped allocator (the writer thread allocates too, hence atomics)
+static atomic_size_t heap_used;
+static atomic_size_t heap_peak;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void heap_add(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    size_t used = atomic_fetch_add(&heap_used, malloc_usable_size(ptr)) + malloc_usable_size(ptr);
+    size_t peak = atomic_load(&heap_peak);
+    while (used > peak && !atomic_compare_exchange_weak(&heap_peak, &peak, used)) {
+    }
+}
+
+static void heap_remove(void *ptr) {
+    if (ptr) {
+        atomic_fetch_sub(&heap_used, malloc_usable_size(ptr));
+    }
+}
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    heap_remove(ptr);
+    void *moved = __real_realloc(ptr, size);
+    heap_add(moved ? moved : (size ? ptr : NULL));
+    return moved;
+}
+
+void __wrap_free(void *ptr) {
+    heap_remove(ptr);
+    __real_free(ptr);
+}
+
+size_t host_heap_used(void) {
+    return atomic_load(&heap_used);
+}
+
+size_t host_heap_peak(void) {
+    return atomic_load(&heap_peak);
+}
+
+void host_heap_reset_peak(void) {
+    atomic_store(&heap_peak, atomic_load(&heap_used));
+}
@@ -0,0 +1,391 @@
+#include "host_flash.h"
+#include "esp_ota_ops.h"
+#include "esp_app_format.h"
+#include "esp_timer.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PARTITIONS 16
+#define PARTITION_TABLE_END 0x9000      // First free offset after the bootloader and partition table
+#define APP_ALIGNMENT 0x10000
+#define DATA_ALIGNMENT 0x1000
+
+typedef struct {
+    esp_partition_t partition;          // First, so partition pointers convert back to the entry
+    uint8_t *data;
+    host_flash_stats_t stats;
+    int64_t first_access_us;
+} host_partition_t;
+
+// The single OTA update esp_ota_begin() allows at a time
+typedef struct {
+    const esp_partition_t *partition;
+    bool sequential;                    // OTA_WITH_SEQUENTIAL_WRITES: erase sectors as writes reach them
+    size_t written;
+    size_t erased;
+} host_ota_t;
+
+static host_partition_t partitions[MAX_PARTITIONS];
+static size_t partition_count;
+static const esp_partition_t *running;
+static const esp_partition_t *boot;
+static host_ota_t ota;
+static pthread_mutex_t flash_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static host_partition_t *entry_of(const esp_partition_t *partition) {
+    return (host_partition_t *)partition;
+}
+
+static void count_access(host_partition_t *entry) {
+    if (entry->first_access_us == 0) {
+        entry->first_access_us = esp_timer_get_time();
+    }
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+// "0x6000", "1M", "64K" or plain decimal
+static uint32_t parse_size(const char *s) {
+    char *end;
+    unsigned long value = strtoul(s, &end, 0);
+    if (*end == 'K' || *end == 'k') {
+        value *= 1024;
+    } else if (*end == 'M' || *end == 'm') {
+        value *= 1024 * 1024;
+    }
+    return (uint32_t)value;
+}
+
+static bool parse_subtype(esp_partition_type_t type, const char *name, esp_partition_subtype_t *subtype) {
+    if (type == ESP_PARTITION_TYPE_APP) {
+        if (strcmp(name, "factory") == 0) {
+            *subtype = ESP_PARTITION_SUBTYPE_APP_FACTORY;
+        } else if (strncmp(name, "ota_", 4) == 0) {
+            *subtype = ESP_PARTITION_SUBTYPE_APP_OTA_MIN + atoi(name + 4);
+        } else {
+            return false;
+        }
+    } else if (strcmp(name, "nvs") == 0) {
+        *subtype = ESP_PARTITION_SUBTYPE_DATA_NVS;
+    } else if (strcmp(name, "ota") == 0) {
+        *subtype = ESP_PARTITION_SUBTYPE_DATA_OTA;
+    } else if (strcmp(name, "phy") == 0) {
+        *subtype = ESP_PARTITION_SUBTYPE_DATA_PHY;
+    } else if (strcmp(name, "littlefs") == 0 || strcmp(name, "spiffs") == 0) {
+        *subtype = ESP_PARTITION_SUBTYPE_DATA_LITTLEFS;
+    } else {
+        *subtype = (esp_partition_subtype_t)strtoul(name, NULL, 0);
+    }
+    return true;
+}
+
+esp_err_t host_flash_init(const char *partitions_csv) {
+    FILE *file = fopen(partitions_csv, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open partition table %s\n", partitions_csv);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char line[256];
+    uint32_t offset = PARTITION_TABLE_END;
+    esp_err_t err = ESP_OK;
+    while (err == ESP_OK && fgets(line, sizeof(line), file)) {
+        char *fields[6] = { 0 };
+        size_t field_count = 0;
+        char *rest = trim(line);
+        if (rest[0] == '#' || rest[0] == '\0') {
+            continue;
+        }
+        for (char *field = strsep(&rest, ","); field && field_count < 6; field = strsep(&rest, ",")) {
+            fields[field_count++] = trim(field);
+        }
+        if (field_count < 5 || partition_count == MAX_PARTITIONS) {
+            err = ESP_ERR_INVALID_ARG;
+            break;
+        }
+
+        host_partition_t *entry = &partitions[partition_count];
+        esp_partition_t *partition = &entry->partition;
+        snprintf(partition->label, sizeof(partition->label), "%s", fields[0]);
+        partition->type = (strcmp(fields[1], "app") == 0) ? ESP_PARTITION_TYPE_APP : ESP_PARTITION_TYPE_DATA;
+        if (!parse_subtype(partition->type, fields[2], &partition->subtype)) {
+            err = ESP_ERR_INVALID_ARG;
+            break;
+        }
+
+        // Blank offsets follow the previous partition, aligned the way gen_esp32part.py does it
+        uint32_t alignment = (partition->type == ESP_PARTITION_TYPE_APP) ? APP_ALIGNMENT : DATA_ALIGNMENT;
+        partition->address = fields[3][0] ? parse_size(fields[3]) : (offset + alignment - 1) & ~(alignment - 1);
+        partition->size = parse_size(fields[4]);
+        partition->erase_size = HOST_FLASH_SECTOR_SIZE;
+        entry->data = malloc(partition->size);
+        if (!entry->data) {
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+        offset = partition->address + partition->size;
+        partition_count++;
+    }
+    fclose(file);
+
+    if (err != ESP_OK) {
+        fprintf(stderr, "Invalid partition table %s\n", partitions_csv);
+        host_flash_deinit();
+        return err;
+    }
+    host_flash_reset();
+    return running ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void host_flash_deinit(void) {
+    for (size_t i = 0; i < partition_count; i++) {
+        free(partitions[i].data);
+    }
+    memset(partitions, 0, sizeof(partitions));
+    partition_count = 0;
+    running = boot = NULL;
+}
+
+void host_flash_reset(void) {
+    for (size_t i = 0; i < partition_count; i++) {
+        memset(partitions[i].data, 0xff, partitions[i].partition.size);
+    }
+    memset(&ota, 0, sizeof(ota));
+    running = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    boot = running;
+    host_flash_reset_stats();
+}
+
+host_flash_stats_t host_flash_stats(const char *label) {
+    host_flash_stats_t total = { 0 };
+    pthread_mutex_lock(&flash_lock);
+    for (size_t i = 0; i < partition_count; i++) {
+        const host_flash_stats_t *stats = &partitions[i].stats;
+        if (label && strcmp(label, partitions[i].partition.label) != 0) {
+            continue;
+        }
+        total.reads += stats->reads;
+        total.read_bytes += stats->read_bytes;
+        total.writes += stats->writes;
+        total.write_bytes += stats->write_bytes;
+        total.unaligned_writes += stats->unaligned_writes;
+        total.erases += stats->erases;
+        total.dirty_writes += stats->dirty_writes;
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return total;
+}
+
+void host_flash_reset_stats(void) {
+    pthread_mutex_lock(&flash_lock);
+    for (size_t i = 0; i < partition_count; i++) {
+        memset(&partitions[i].stats, 0, sizeof(host_flash_stats_t));
+        partitions[i].first_access_us = 0;
+    }
+    pthread_mutex_unlock(&flash_lock);
+}
+
+int64_t host_flash_first_access_us(const char *label) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition) {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, label);
+    }
+    return partition ? entry_of(partition)->first_access_us : 0;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+    for (size_t i = 0; i < partition_count; i++) {
+        const esp_partition_t *partition = &partitions[i].partition;
+        if (partition->type == type &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || partition->subtype == subtype) &&
+            (!label || strcmp(label, partition->label) == 0)) {
+            return partition;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (src_offset > partition->size || size > partition->size - src_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    host_partition_t *entry = entry_of(partition);
+    pthread_mutex_lock(&flash_lock);
+    count_access(entry);
+    entry->stats.reads++;
+    entry->stats.read_bytes += size;
+    memcpy(dst, entry->data + src_offset, size);
+    pthread_mutex_unlock(&flash_lock);
+    return ESP_OK;
+}
+
+// NOR flash programming can only clear bits; anything else is a missing erase
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    if (dst_offset > partition->size || size > partition->size - dst_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    host_partition_t *entry = entry_of(partition);
+    const uint8_t *bytes = src;
+    bool dirty = false;
+    pthread_mutex_lock(&flash_lock);
+    count_access(entry);
+    for (size_t i = 0; i < size; i++) {
+        uint8_t *cell = &entry->data[dst_offset + i];
+        dirty |= (*cell & bytes[i]) != bytes[i];
+        *cell &= bytes[i];
+    }
+    entry->stats.writes++;
+    entry->stats.write_bytes += size;
+    if (dst_offset % HOST_FLASH_SECTOR_SIZE != 0 || size % HOST_FLASH_SECTOR_SIZE != 0) {
+        entry->stats.unaligned_writes++;
+    }
+    if (dirty) {
+        entry->stats.dirty_writes++;
+    }
+    pthread_mutex_unlock(&flash_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (offset % HOST_FLASH_SECTOR_SIZE != 0 || size % HOST_FLASH_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset > partition->size || size > partition->size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    host_partition_t *entry = entry_of(partition);
+    pthread_mutex_lock(&flash_lock);
+    count_access(entry);
+    memset(entry->data + offset, 0xff, size);
+    entry->stats.erases += size / HOST_FLASH_SECTOR_SIZE;
+    pthread_mutex_unlock(&flash_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size, esp_partition_mmap_memory_t memory,
+                             const void **out_ptr, esp_partition_mmap_handle_t *out_handle) {
+    if (offset > partition->size || size > partition->size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    host_partition_t *entry = entry_of(partition);
+    pthread_mutex_lock(&flash_lock);
+    count_access(entry);
+    pthread_mutex_unlock(&flash_lock);
+    *out_ptr = entry->data + offset;
+    *out_handle = 0;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle) {
+    if (!partition || partition->type != ESP_PARTITION_TYPE_APP || partition == running) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota.partition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(&ota, 0, sizeof(ota));
+    ota.partition = partition;
+    ota.sequential = (image_size == OTA_WITH_SEQUENTIAL_WRITES);
+    if (!ota.sequential) {
+        size_t erase_size = (image_size == OTA_SIZE_UNKNOWN) ? partition->size
+                          : (image_size + HOST_FLASH_SECTOR_SIZE - 1) & ~(size_t)(HOST_FLASH_SECTOR_SIZE - 1);
+        esp_err_t err = esp_partition_erase_range(partition, 0, erase_size);
+        if (err != ESP_OK) {
+            ota.partition = NULL;
+            return err;
+        }
+        ota.erased = erase_size;
+    }
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size) {
+    if (!ota.partition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota.written == 0 && size > 0 && ((const uint8_t *)data)[0] != ESP_IMAGE_HEADER_MAGIC) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    while (ota.erased < ota.written + size) {
+        esp_err_t err = esp_partition_erase_range(ota.partition, ota.erased, HOST_FLASH_SECTOR_SIZE);
+        if (err != ESP_OK) {
+            return err;
+        }
+        ota.erased += HOST_FLASH_SECTOR_SIZE;
+    }
+    esp_err_t err = esp_partition_write(ota.partition, ota.written, data, size);
+    if (err == ESP_OK) {
+        ota.written += size;
+    }
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    if (!ota.partition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool written = ota.written > 0;
+    ota.partition = NULL;
+    return written ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    ota.partition = NULL;
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+    return running;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+    const esp_partition_t *from = start_from ? start_from : running;
+    int slot = from->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0;
+    for (int i = 1; i <= ESP_PARTITION_SUBTYPE_APP_OTA_MAX - ESP_PARTITION_SUBTYPE_APP_OTA_MIN; i++) {
+        esp_partition_subtype_t subtype = ESP_PARTITION_SUBTYPE_APP_OTA_0 +
+            (slot + i) % (ESP_PARTITION_SUBTYPE_APP_OTA_MAX - ESP_PARTITION_SUBTYPE_APP_OTA_MIN);
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, subtype, NULL);
+        if (partition) {
+            return partition;
+        }
+    }
+    return NULL;
+}
+
+// The device checks the image here; the host only records which slot would boot
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition) {
+    if (!partition || partition->type != ESP_PARTITION_TYPE_APP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    boot = partition;
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void) {
+    return boot;
+}
+
+// No otadata on the host: the state is unknown, as on a device flashed without rollback support
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state) {
+    if (!partition || !ota_state) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host port: the "running app" has an all-zero ELF digest, so delta packages are refused
+typedef struct {
+    uint32_t magic_word;
+    char version[32];
+    char project_name[32];
+    uint8_t app_elf_sha256[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t *esp_app_get_description(void);
@@ -0,0 +1,3 @@
+#pragma once
+
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
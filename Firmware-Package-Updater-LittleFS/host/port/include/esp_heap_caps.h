@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+
+// Host port: capabilities are ignored, allocations go through malloc (and its heap accounting)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+#define heap_caps_malloc(size, caps) malloc(size)
+#define heap_caps_free(ptr) free(ptr)
@@ -0,0 +1,8 @@
+#pragma once
+
+// Host port: only the status codes package_update_result_t carries
+typedef enum {
+    HTTPD_500_INTERNAL_SERVER_ERROR = 0,
+    HTTPD_400_BAD_REQUEST = 2,
+    HTTPD_404_NOT_FOUND = 3,
+} httpd_err_code_t;
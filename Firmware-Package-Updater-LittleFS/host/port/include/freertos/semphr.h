@@ -0,0 +1,11 @@
+#pragma once
+
+#include "queue.h"
+
+// Binary semaphores are zero-size queues of length one, as in FreeRTOS
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary() xQueueCreate(1, 0)
+#define xSemaphoreGive(sem) xQueueSend(sem, NULL, 0)
+#define xSemaphoreTake(sem, wait) xQueueReceive(sem, NULL, wait)
+#define vSemaphoreDelete(sem) vQueueDelete(sem)
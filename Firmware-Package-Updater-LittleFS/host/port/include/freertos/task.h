@@ -0,0 +1,11 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_size, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *out_task, BaseType_t core_id);
+void vTaskDelete(TaskHandle_t task);  // Only vTaskDelete(NULL) from the task itself
+void vTaskDelay(TickType_t ticks);
@@ -0,0 +1,47 @@
+#pragma once
+
+// Host port: RAM flash behind esp_partition_* and esp_ota_*, with per-partition operation counts
+
+#include <esp_partition.h>
+
+#define HOST_FLASH_SECTOR_SIZE 4096
+
+typedef struct {
+    uint32_t reads;
+    uint64_t read_bytes;
+    uint32_t writes;
+    uint64_t write_bytes;
+    uint32_t unaligned_writes;          // Writes that do not start and end on a sector boundary
+    uint32_t erases;                    // Sectors erased
+    uint32_t dirty_writes;              // Writes that tried to set bits in a programmed byte (NOR flash cannot)
+} host_flash_stats_t;
+
+/**
+ * @brief Build the partition table from a partitions.csv file and erase all of it
+ */
+esp_err_t host_flash_init(const char *partitions_csv);
+
+/**
+ * @brief Free the RAM flash
+ */
+void host_flash_deinit(void);
+
+/**
+ * @brief Erase every partition and make ota_0 the running app again
+ */
+void host_flash_reset(void);
+
+/**
+ * @brief Operation counts for one partition since the last reset (NULL label: all partitions)
+ */
+host_flash_stats_t host_flash_stats(const char *label);
+
+/**
+ * @brief Clear the operation counts
+ */
+void host_flash_reset_stats(void);
+
+/**
+ * @brief Time of the first operation on `label` since the last stats reset, 0 if none
+ */
+int64_t host_flash_first_access_us(const char *label);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+
+// Host port: malloc/calloc/realloc/free are wrapped at link time (-Wl,--wrap) to track heap use
+
+/**
+ * @brief Bytes currently allocated through the wrapped allocator
+ */
+size_t host_heap_used(void);
+
+/**
+ * @brief Highest host_heap_used() since the last host_heap_reset_peak()
+ */
+size_t host_heap_peak(void);
+
+/**
+ * @brief Restart peak tracking from the current usage
+ */
+void host_heap_reset_peak(void);
@@ -0,0 +1,47 @@
+#pragma once
+
+// Host port: force-included into the firmware sources, so file calls on littlefs mount points
+// (WEB_BANK_MOUNT_POINT, WEB_BANK_NEXT_MOUNT_POINT) reach the RAM flash like esp_littlefs's VFS
+// does. Paths outside a mount point fall through to the host file system.
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+FILE *host_fopen(const char *path, const char *mode);
+int host_remove(const char *path);
+int host_rename(const char *from, const char *to);
+int host_stat(const char *path, struct stat *st);
+int host_mkdir(const char *path, mode_t mode);
+DIR *host_opendir(const char *path);
+struct dirent *host_readdir(DIR *dir);
+int host_closedir(DIR *dir);
+
+typedef struct {
+    uint32_t file_writes;               // Writes that reached littlefs (after stdio buffering)
+    uint64_t file_write_bytes;
+    uint32_t unaligned_file_writes;     // Writes that do not start and end on a 4 KB file offset
+} host_vfs_stats_t;
+
+/**
+ * @brief File write counts on the littlefs mounts since the last reset
+ */
+host_vfs_stats_t host_vfs_stats(void);
+
+/**
+ * @brief Clear the file write counts
+ */
+void host_vfs_reset_stats(void);
+
+// Function-like, so `struct stat` and friends are left alone. The VFS itself calls the real ones.
+#ifndef HOST_VFS_IMPLEMENTATION
+#define fopen(path, mode) host_fopen(path, mode)
+#define remove(path) host_remove(path)
+#define rename(from, to) host_rename(from, to)
+#define stat(path, st) host_stat(path, st)
+#define mkdir(path, mode) host_mkdir(path, mode)
+#define opendir(path) host_opendir(path)
+#define readdir(dir) host_readdir(dir)
+#define closedir(dir) host_closedir(dir)
+#endif
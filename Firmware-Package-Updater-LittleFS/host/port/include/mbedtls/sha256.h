@@ -0,0 +1,34 @@
+#pragma once
+
+// Host port: mbedTLS SHA-256 API on top of OpenSSL
+
+#define OPENSSL_SUPPRESS_DEPRECATED    // SHA256_* is deprecated in OpenSSL 3 but still the closest match
+#include <openssl/sha.h>
+#include <stddef.h>
+
+typedef struct {
+    SHA256_CTX ctx;
+} mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx) {
+    SHA256_Init(&ctx->ctx);
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {
+}
+
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224) {
+    return SHA256_Init(&ctx->ctx) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen) {
+    return SHA256_Update(&ctx->ctx, input, ilen) == 1 ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char *output) {
+    return SHA256_Final(output, &ctx->ctx) == 1 ? 0 : -1;
+}
+
+static inline void mbedtls_sha256_clone(mbedtls_sha256_context *dst, const mbedtls_sha256_context *src) {
+    *dst = *src;
+}
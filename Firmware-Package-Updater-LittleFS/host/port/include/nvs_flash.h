@@ -0,0 +1,5 @@
+#pragma once
+
+// Host port: only the default partition name, which the update path refuses to overwrite
+
+#define NVS_DEFAULT_PART_NAME "nvs"
@@ -0,0 +1,81 @@
+#include "inflate_stream.h"
+
+#include <stdlib.h>
+#include <zlib.h>
+
+// Host port of main/inflate_stream.c: the ROM miniz decoder is not available, zlib's inflate
+// takes its place with the same 32 KB output buffer and the same return codes
+
+#define OUTPUT_SIZE 32768
+
+struct inflate_stream {
+    z_stream z;
+    uint8_t *out;
+    bool done;
+};
+
+inflate_stream_t *inflate_stream_create(void) {
+    inflate_stream_t *stream = calloc(1, sizeof(inflate_stream_t));
+    if (!stream) {
+        return NULL;
+    }
+    stream->out = malloc(OUTPUT_SIZE);
+    if (!stream->out || inflateInit(&stream->z) != Z_OK) {
+        free(stream->out);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+void inflate_stream_reset(inflate_stream_t *stream) {
+    inflateReset(&stream->z);
+    stream->done = false;
+}
+
+esp_err_t inflate_stream_feed(inflate_stream_t *stream, const void *data, size_t len,
+                              inflate_stream_output_fn output, void *ctx) {
+    if (stream->done) {
+        return len ? ESP_ERR_INVALID_SIZE : ESP_OK;
+    }
+
+    stream->z.next_in = (Bytef *)data;
+    stream->z.avail_in = len;
+    do {
+        stream->z.next_out = stream->out;
+        stream->z.avail_out = OUTPUT_SIZE;
+        int ret = inflate(&stream->z, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+
+        size_t out_size = OUTPUT_SIZE - stream->z.avail_out;
+        if (out_size > 0) {
+            esp_err_t err = output(ctx, stream->out, out_size);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        if (ret == Z_STREAM_END) {
+            stream->done = true;
+            return stream->z.avail_in ? ESP_ERR_INVALID_SIZE : ESP_OK;
+        }
+    } while (stream->z.avail_in > 0 || stream->z.avail_out == 0);
+    return ESP_OK;
+}
+
+esp_err_t inflate_stream_finish(inflate_stream_t *stream) {
+    return stream->done ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+size_t inflate_stream_total_out(const inflate_stream_t *stream) {
+    return stream->z.total_out;
+}
+
+void inflate_stream_destroy(inflate_stream_t *stream) {
+    if (stream) {
+        inflateEnd(&stream->z);
+        free(stream->out);
+        free(stream);
+    }
+}
@@ -0,0 +1,430 @@
+#define _GNU_SOURCE
+#define HOST_VFS_IMPLEMENTATION
+#include "host_vfs.h"
+#include "host_flash.h"
+#include "esp_littlefs.h"
+#include "lfs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Host port of the esp_littlefs VFS: littlefs runs on the RAM partitions through
+// esp_partition_read/write/erase_range, with the component's default Kconfig geometry, so its
+// flash traffic shows up in the same host_flash counters as the OTA writes
+
+#define MAX_MOUNTS 4
+#define READ_SIZE 128                   // CONFIG_LITTLEFS_READ_SIZE
+#define WRITE_SIZE 128                  // CONFIG_LITTLEFS_WRITE_SIZE
+#define CACHE_SIZE 4096                 // CONFIG_LITTLEFS_CACHE_SIZE (sdkconfig.defaults)
+#define LOOKAHEAD_SIZE 128              // CONFIG_LITTLEFS_LOOKAHEAD_SIZE
+#define BLOCK_CYCLES 512                // CONFIG_LITTLEFS_BLOCK_CYCLES
+#define STDIO_BUFFER_SIZE 128           // newlib's BUFSIZ on the device
+
+typedef struct {
+    char base_path[32];
+    const esp_partition_t *partition;
+    struct lfs_config cfg;
+    lfs_t lfs;
+} mount_t;
+
+typedef struct {
+    mount_t *mount;
+    lfs_file_t file;
+} vfs_file_t;
+
+typedef struct {
+    DIR *host;                          // Set for directories outside the mount points
+    mount_t *mount;
+    lfs_dir_t dir;
+    struct dirent entry;
+} vfs_dir_t;
+
+static mount_t *mounts[MAX_MOUNTS];
+static host_vfs_stats_t stats;
+static pthread_mutex_t vfs_lock = PTHREAD_MUTEX_INITIALIZER;   // littlefs itself is not thread safe
+
+static int part_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
+    const mount_t *mount = c->context;
+    return esp_partition_read(mount->partition, block * c->block_size + off, buffer, size) == ESP_OK ? 0 : LFS_ERR_IO;
+}
+
+static int part_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
+    const mount_t *mount = c->context;
+    return esp_partition_write(mount->partition, block * c->block_size + off, buffer, size) == ESP_OK ? 0 : LFS_ERR_IO;
+}
+
+static int part_erase(const struct lfs_config *c, lfs_block_t block) {
+    const mount_t *mount = c->context;
+    return esp_partition_erase_range(mount->partition, block * c->block_size, c->block_size) == ESP_OK ? 0 : LFS_ERR_IO;
+}
+
+static int part_sync(const struct lfs_config *c) {
+    return 0;
+}
+
+// littlefs error codes are negated errno values
+static int set_errno(int lfs_err) {
+    if (lfs_err < 0) {
+        errno = -lfs_err;
+        return -1;
+    }
+    return lfs_err;
+}
+
+// Finds the mount holding `path` and the path inside it, or NULL for host paths
+static mount_t *resolve(const char *path, const char **inner) {
+    for (int i = 0; i < MAX_MOUNTS; i++) {
+        mount_t *mount = mounts[i];
+        size_t len = mount ? strlen(mount->base_path) : 0;
+        if (mount && strncmp(path, mount->base_path, len) == 0 && (path[len] == '/' || path[len] == '\0')) {
+            *inner = path[len] ? path + len : "/";
+            return mount;
+        }
+    }
+    return NULL;
+}
+
+static mount_t *find_mount(const char *partition_label) {
+    for (int i = 0; i < MAX_MOUNTS; i++) {
+        if (mounts[i] && strcmp(mounts[i]->partition->label, partition_label) == 0) {
+            return mounts[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_vfs_littlefs_register(const esp_vfs_littlefs_conf_t *conf) {
+    const esp_partition_t *partition = conf->partition ? conf->partition
+        : esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, conf->partition_label);
+    if (!partition) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    pthread_mutex_lock(&vfs_lock);
+    int slot = -1;
+    for (int i = MAX_MOUNTS - 1; i >= 0; i--) {
+        if (mounts[i] && (mounts[i]->partition == partition || strcmp(mounts[i]->base_path, conf->base_path) == 0)) {
+            pthread_mutex_unlock(&vfs_lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (!mounts[i]) {
+            slot = i;
+        }
+    }
+    mount_t *mount = (slot >= 0) ? calloc(1, sizeof(mount_t)) : NULL;
+    if (!mount) {
+        pthread_mutex_unlock(&vfs_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    snprintf(mount->base_path, sizeof(mount->base_path), "%s", conf->base_path);
+    mount->partition = partition;
+    mount->cfg = (struct lfs_config) {
+        .context = mount,
+        .read = part_read,
+        .prog = part_prog,
+        .erase = part_erase,
+        .sync = part_sync,
+        .read_size = READ_SIZE,
+        .prog_size = WRITE_SIZE,
+        .block_size = HOST_FLASH_SECTOR_SIZE,
+        .block_count = partition->size / HOST_FLASH_SECTOR_SIZE,
+        .cache_size = CACHE_SIZE,
+        .lookahead_size = LOOKAHEAD_SIZE,
+        .block_cycles = BLOCK_CYCLES,
+    };
+
+    int err = lfs_mount(&mount->lfs, &mount->cfg);
+    if (err != 0 && conf->format_if_mount_failed && !conf->read_only) {
+        err = lfs_format(&mount->lfs, &mount->cfg);
+        if (err == 0) {
+            err = lfs_mount(&mount->lfs, &mount->cfg);
+        }
+    }
+    if (err != 0) {
+        free(mount);
+        pthread_mutex_unlock(&vfs_lock);
+        return ESP_FAIL;
+    }
+    mounts[slot] = mount;
+    pthread_mutex_unlock(&vfs_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_littlefs_unregister(const char *partition_label) {
+    pthread_mutex_lock(&vfs_lock);
+    mount_t *mount = find_mount(partition_label);
+    if (mount) {
+        lfs_unmount(&mount->lfs);
+        for (int i = 0; i < MAX_MOUNTS; i++) {
+            if (mounts[i] == mount) {
+                mounts[i] = NULL;
+            }
+        }
+        free(mount);
+    }
+    pthread_mutex_unlock(&vfs_lock);
+    return mount ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_littlefs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes) {
+    pthread_mutex_lock(&vfs_lock);
+    mount_t *mount = find_mount(partition_label);
+    if (mount) {
+        lfs_ssize_t used_blocks = lfs_fs_size(&mount->lfs);
+        *total_bytes = mount->cfg.block_count * mount->cfg.block_size;
+        *used_bytes = (used_blocks > 0) ? used_blocks * mount->cfg.block_size : 0;
+    }
+    pthread_mutex_unlock(&vfs_lock);
+    return mount ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+host_vfs_stats_t host_vfs_stats(void) {
+    pthread_mutex_lock(&vfs_lock);
+    host_vfs_stats_t copy = stats;
+    pthread_mutex_unlock(&vfs_lock);
+    return copy;
+}
+
+void host_vfs_reset_stats(void) {
+    pthread_mutex_lock(&vfs_lock);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&vfs_lock);
+}
+
+static ssize_t cookie_read(void *cookie, char *buf, size_t size) {
+    vfs_file_t *f = cookie;
+    pthread_mutex_lock(&vfs_lock);
+    lfs_ssize_t ret = lfs_file_read(&f->mount->lfs, &f->file, buf, size);
+    pthread_mutex_unlock(&vfs_lock);
+    return set_errno(ret);
+}
+
+static ssize_t cookie_write(void *cookie, const char *buf, size_t size) {
+    vfs_file_t *f = cookie;
+    pthread_mutex_lock(&vfs_lock);
+    lfs_soff_t position = lfs_file_tell(&f->mount->lfs, &f->file);
+    lfs_ssize_t ret = lfs_file_write(&f->mount->lfs, &f->file, buf, size);
+    stats.file_writes++;
+    stats.file_write_bytes += size;
+    if (position % HOST_FLASH_SECTOR_SIZE != 0 || size % HOST_FLASH_SECTOR_SIZE != 0) {
+        stats.unaligned_file_writes++;
+    }
+    pthread_mutex_unlock(&vfs_lock);
+    return set_errno(ret);
+}
+
+static int cookie_seek(void *cookie, off64_t *offset, int whence) {
+    vfs_file_t *f = cookie;
+    int lfs_whence = (whence == SEEK_SET) ? LFS_SEEK_SET : (whence == SEEK_CUR) ? LFS_SEEK_CUR : LFS_SEEK_END;
+    pthread_mutex_lock(&vfs_lock);
+    lfs_soff_t ret = lfs_file_seek(&f->mount->lfs, &f->file, (lfs_soff_t)*offset, lfs_whence);
+    pthread_mutex_unlock(&vfs_lock);
+    if (ret < 0) {
+        return set_errno(ret);
+    }
+    *offset = ret;
+    return 0;
+}
+
+static int cookie_close(void *cookie) {
+    vfs_file_t *f = cookie;
+    pthread_mutex_lock(&vfs_lock);
+    int ret = lfs_file_close(&f->mount->lfs, &f->file);
+    pthread_mutex_unlock(&vfs_lock);
+    free(f);
+    return set_errno(ret);
+}
+
+static int parse_mode(const char *mode) {
+    int flags;
+    switch (mode[0]) {
+    case 'r':
+        flags = LFS_O_RDONLY;
+        break;
+    case 'w':
+        flags = LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC;
+        break;
+    case 'a':
+        flags = LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND;
+        break;
+    default:
+        return -1;
+    }
+    if (strchr(mode, '+')) {
+        flags = (flags & ~(LFS_O_RDONLY | LFS_O_WRONLY)) | LFS_O_RDWR;
+    }
+    return flags;
+}
+
+FILE *host_fopen(const char *path, const char *mode) {
+    const char *inner;
+    mount_t *mount = resolve(path, &inner);
+    if (!mount) {
+        return fopen(path, mode);
+    }
+
+    int flags = parse_mode(mode);
+    vfs_file_t *f = (flags >= 0) ? calloc(1, sizeof(vfs_file_t)) : NULL;
+    if (!f) {
+        errno = (flags < 0) ? EINVAL : ENOMEM;
+        return NULL;
+    }
+    f->mount = mount;
+
+    pthread_mutex_lock(&vfs_lock);
+    int ret = lfs_file_open(&mount->lfs, &f->file, inner, flags);
+    pthread_mutex_unlock(&vfs_lock);
+    if (ret < 0) {
+        free(f);
+        set_errno(ret);
+        return NULL;
+    }
+
+    cookie_io_functions_t io = {
+        .read = cookie_read,
+        .write = cookie_write,
+        .seek = cookie_seek,
+        .close = cookie_close,
+    };
+    FILE *file = fopencookie(f, mode, io);
+    if (!file) {
+        cookie_close(f);
+        return NULL;
+    }
+    setvbuf(file, NULL, _IOFBF, STDIO_BUFFER_SIZE);
+    return file;
+}
+
+int host_remove(const char *path) {
+    const char *inner;
+    mount_t *mount = resolve(path, &inner);
+    if (!mount) {
+        return remove(path);
+    }
+    pthread_mutex_lock(&vfs_lock);
+    int ret = lfs_remove(&mount->lfs, inner);
+    pthread_mutex_unlock(&vfs_lock);
+    return set_errno(ret);
+}
+
+int host_rename(const char *from, const char *to) {
+    const char *inner_from = NULL, *inner_to = NULL;
+    mount_t *mount = resolve(from, &inner_from);
+    if (mount != resolve(to, &inner_to)) {
+        errno = EXDEV;
+        return -1;
+    }
+    if (!mount) {
+        return rename(from, to);
+    }
+    pthread_mutex_lock(&vfs_lock);
+    int ret = lfs_rename(&mount->lfs, inner_from, inner_to);
+    pthread_mutex_unlock(&vfs_lock);
+    return set_errno(ret);
+}
+
+int host_stat(const char *path, struct stat *st) {
+    const char *inner;
+    mount_t *mount = resolve(path, &inner);
+    if (!mount) {
+        return stat(path, st);
+    }
+    struct lfs_info info;
+    pthread_mutex_lock(&vfs_lock);
+    int ret = lfs_stat(&mount->lfs, inner, &info);
+    pthread_mutex_unlock(&vfs_lock);
+    if (ret < 0) {
+        return set_errno(ret);
+    }
+    memset(st, 0, sizeof(struct stat));
+    st->st_mode = (info.type == LFS_TYPE_DIR) ? S_IFDIR | 0755 : S_IFREG | 0644;
+    st->st_size = info.size;
+    st->st_blksize = mount->cfg.block_size;
+    return 0;
+}
+
+int host_mkdir(const char *path, mode_t mode) {
+    const char *inner;
+    mount_t *mount = resolve(path, &inner);
+    if (!mount) {
+        return mkdir(path, mode);
+    }
+    pthread_mutex_lock(&vfs_lock);
+    int ret = lfs_mkdir(&mount->lfs, inner);
+    pthread_mutex_unlock(&vfs_lock);
+    return set_errno(ret);
+}
+
+DIR *host_opendir(const char *path) {
+    const char *inner;
+    mount_t *mount = resolve(path, &inner);
+    vfs_dir_t *d = calloc(1, sizeof(vfs_dir_t));
+    if (!d) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!mount) {
+        d->host = opendir(path);
+        if (!d->host) {
+            free(d);
+            return NULL;
+        }
+        return (DIR *)d;
+    }
+
+    d->mount = mount;
+    pthread_mutex_lock(&vfs_lock);
+    int ret = lfs_dir_open(&mount->lfs, &d->dir, inner);
+    pthread_mutex_unlock(&vfs_lock);
+    if (ret < 0) {
+        free(d);
+        set_errno(ret);
+        return NULL;
+    }
+    return (DIR *)d;
+}
+
+// Like esp_littlefs, the listing leaves out "." and ".."
+struct dirent *host_readdir(DIR *dir) {
+    vfs_dir_t *d = (vfs_dir_t *)dir;
+    if (d->host) {
+        return readdir(d->host);
+    }
+
+    struct lfs_info info;
+    int ret;
+    pthread_mutex_lock(&vfs_lock);
+    do {
+        ret = lfs_dir_read(&d->mount->lfs, &d->dir, &info);
+    } while (ret > 0 && (strcmp(info.name, ".") == 0 || strcmp(info.name, "..") == 0));
+    pthread_mutex_unlock(&vfs_lock);
+    if (ret <= 0) {
+        if (ret < 0) {
+            set_errno(ret);
+        }
+        return NULL;
+    }
+
+    memset(&d->entry, 0, sizeof(struct dirent));
+    snprintf(d->entry.d_name, sizeof(d->entry.d_name), "%s", info.name);
+    d->entry.d_type = (info.type == LFS_TYPE_DIR) ? DT_DIR : DT_REG;
+    return &d->entry;
+}
+
+int host_closedir(DIR *dir) {
+    vfs_dir_t *d = (vfs_dir_t *)dir;
+    int ret = 0;
+    if (d->host) {
+        ret = closedir(d->host);
+    } else {
+        pthread_mutex_lock(&vfs_lock);
+        ret = set_errno(lfs_dir_close(&d->mount->lfs, &d->dir));
+        pthread_mutex_unlock(&vfs_lock);
+    }
+    free(d);
+    return ret;
+}
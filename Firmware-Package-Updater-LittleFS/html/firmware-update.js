@@ -56,36 +56,11 @@ document.addEventListener("DOMContentLoaded", function () {
         status.className = 'status-info';
 
         try {
-            const xhr = new XMLHttpRequest();
-            
-            xhr.upload.onprogress = function (e) {
-                if (e.lengthComputable) {
-                    const percentComplete = (e.loaded / e.total) * 100;
-                    
-                    if (progressBar) {  // ✅ Prevent errors
-                        progressBar.style.width = percentComplete + '%';
-                        progressText.textContent = `${Math.round(percentComplete)}% (${formatBytes(e.loaded)} / ${formatBytes(e.total)})`;
-                    }
-                }
-            };
-
-            // Wrap XHR in a promise
-            const uploadPromise = new Promise((resolve, reject) => {
-                xhr.onload = () => {
-                    if (xhr.status >= 200 && xhr.status < 300) {
-                        resolve(xhr.responseText);
-                    } else {
-                        reject(new Error(xhr.responseText || `Upload failed with status ${xhr.status}`));
-                    }
-                };
-                xhr.onerror = () => reject(new Error('Upload failed'));
+            const result = await uploadPackage(file, status, function (loaded) {
+                const percentComplete = (loaded / file.size) * 100;
+                progressBar.style.width = percentComplete + '%';
+                progressText.textContent = `${Math.round(percentComplete)}% (${formatBytes(loaded)} / ${formatBytes(file.size)})`;
             });
-
-            xhr.open('POST', '/update_firmware', true);
-            xhr.setRequestHeader('Content-Type', 'application/x-pkg');
-            xhr.send(file);
-
-            const result = await uploadPromise;
             status.textContent = result;
             status.className = 'status-success';
             progressText.textContent = 'Upload complete!';
@@ -113,6 +88,94 @@ document.addEventListener("DOMContentLoaded", function () {
         }
     });
 
+    // Resumable upload: the device keeps checkpoints, so after a dropped connection (or a device
+    // restart) the upload asks /update/init where to continue instead of starting over
+    const CHUNK_SIZE = 64 * 1024;
+    const MAX_RETRIES = 5;
+    const RETRY_DELAY_MS = 2000;
+
+    async function uploadPackage(file, status, onProgress) {
+        const uploadId = `${file.name}:${file.size}:${file.lastModified}`;
+        let offset = null;
+        let retries = 0;
+
+        while (offset === null || offset < file.size) {
+            try {
+                if (offset === null) {
+                    const init = await post('/update/init', JSON.stringify({ id: uploadId, size: file.size }),
+                                            'application/json', null, [503]);
+                    if (init.status === 503) {
+                        // The device is still writing the last chunk
+                        await waitRetryAfter(init);
+                        continue;
+                    }
+                    offset = JSON.parse(init.text).offset;
+                    onProgress(offset);
+                }
+
+                const start = offset;
+                const chunk = await post(`/update/chunk?offset=${start}`, file.slice(start, start + CHUNK_SIZE),
+                                         'application/octet-stream', loaded => onProgress(start + loaded), [409, 503]);
+                // 409: the device expected another offset and says which one
+                offset = JSON.parse(chunk.text).offset;
+                if (chunk.status === 503) {
+                    // 503: the previous chunk is still being written; send this one again
+                    onProgress(offset);
+                    await waitRetryAfter(chunk);
+                    continue;
+                }
+                onProgress(offset);
+                if (chunk.status === 200) {
+                    retries = 0;
+                    status.textContent = 'Uploading...';
+                }
+            } catch (error) {
+                if (error.fatal || ++retries > MAX_RETRIES) {
+                    throw error;
+                }
+                status.textContent = `Connection lost, resuming (attempt ${retries} of ${MAX_RETRIES})...`;
+                await new Promise(resolve => setTimeout(resolve, RETRY_DELAY_MS * retries));
+                offset = null;
+            }
+        }
+
+        status.textContent = 'Installing...';
+        const commit = await post('/update/commit', null, 'text/plain');
+        return commit.text;
+    }
+
+    function waitRetryAfter(response) {
+        const seconds = parseInt(response.retryAfter, 10) || 1;
+        return new Promise(resolve => setTimeout(resolve, seconds * 1000));
+    }
+
+    // POSTs `body`; rejects on network errors, and with a fatal error on unexpected HTTP statuses
+    function post(url, body, contentType, onProgress, acceptedStatuses = []) {
+        return new Promise((resolve, reject) => {
+            const xhr = new XMLHttpRequest();
+            if (onProgress) {
+                xhr.upload.onprogress = function (e) {
+                    if (e.lengthComputable) {
+                        onProgress(e.loaded);
+                    }
+                };
+            }
+            xhr.onload = () => {
+                if ((xhr.status >= 200 && xhr.status < 300) || acceptedStatuses.includes(xhr.status)) {
+                    resolve({ status: xhr.status, text: xhr.responseText, retryAfter: xhr.getResponseHeader('Retry-After') });
+                } else {
+                    const error = new Error(xhr.responseText || `Upload failed with status ${xhr.status}`);
+                    error.fatal = true;
+                    reject(error);
+                }
+            };
+            xhr.onerror = () => reject(new Error('Upload failed'));
+            xhr.open('POST', url, true);
+            xhr.setRequestHeader('Content-Type', contentType);
+            xhr.send(body);
+        });
+    }
+
     function formatBytes(bytes) {
         if (bytes === 0) return '0 Bytes';
         const k = 1024;
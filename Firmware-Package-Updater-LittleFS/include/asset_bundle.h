@@ -0,0 +1,82 @@
+#ifndef ASSET_BUNDLE_H
+#define ASSET_BUNDLE_H
+
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Read-only web asset bundle, served straight from memory-mapped flash.
+ *
+ * Each OTA app slot has an asset partition next to its web bank (ota_0 <-> assets_0,
+ * ota_1 <-> assets_1, and the factory app <-> assets_1). It holds one flat bundle built by create_asset_bundle.py:
+ *
+ *   header | index (entry_count entries, sorted by path) | string table | payloads
+ *
+ * The running slot's bundle is mapped once at start-up; a lookup is a binary search of the
+ * index and the response is sent from the mapped payload without a file system or a copy.
+ * Assets the bundle does not hold are served from the web bank as before. An erased or
+ * invalid partition simply means there is no bundle.
+ */
+
+#define ASSET_BUNDLE_MAGIC "ESP_ASSETS"         // 10 bytes, no terminator
+#define ASSET_BUNDLE_MAGIC_LEN 10
+#define ASSET_BUNDLE_VERSION 1
+#define ASSET_BUNDLE_SHA256_LEN 32
+
+// All fields little-endian; offsets are from the start of the bundle
+typedef struct {
+    char magic[ASSET_BUNDLE_MAGIC_LEN];
+    uint16_t version;
+    uint32_t entry_count;
+    uint32_t bundle_size;               // Header, index, strings and payloads
+} asset_bundle_header_t;
+
+typedef struct {
+    uint32_t path_offset;               // NUL-terminated path below the web root, e.g. "styles.css.gz"
+    uint32_t mime_offset;               // NUL-terminated Content-Type (that of the raw file for .gz variants)
+    uint32_t data_offset;               // Payload, 4-byte aligned
+    uint32_t data_length;
+    uint8_t sha256[ASSET_BUNDLE_SHA256_LEN];    // Of the payload; the ETag comes from it
+} asset_bundle_entry_t;
+
+// An asset found in the mapped bundle; valid until the next boot
+typedef struct {
+    const char *path;
+    const char *mime_type;
+    const uint8_t *data;
+    uint32_t length;
+    const uint8_t *sha256;
+} asset_bundle_file_t;
+
+/**
+ * @brief Find the asset partition paired with an app partition (like web_bank_partition())
+ *
+ * @return const esp_partition_t* assets_N, or NULL if the partition table lacks it
+ */
+const esp_partition_t *asset_bundle_partition(const esp_partition_t *app);
+
+/**
+ * @brief Map the running firmware's bundle, if its asset partition holds a valid one
+ *
+ * @return ESP_ERR_NOT_FOUND when there is no bundle; assets then all come from the web bank
+ */
+esp_err_t asset_bundle_map_active(void);
+
+/**
+ * @brief Look up `path` (relative to the web root) in the mapped bundle
+ */
+bool asset_bundle_find(const char *path, asset_bundle_file_t *file);
+
+/**
+ * @brief Check that `partition` holds a well-formed bundle (after an update wrote it)
+ */
+esp_err_t asset_bundle_verify(const esp_partition_t *partition);
+
+/**
+ * @brief Erase the bundle header, so the paired firmware serves everything from its web bank
+ */
+esp_err_t asset_bundle_invalidate(const esp_partition_t *partition);
+
+#endif // ASSET_BUNDLE_H
@@ -0,0 +1,85 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * In-RAM cache of whole web asset files, so hot assets are sent with one httpd_resp_send()
+ * instead of being read from LittleFS on every request.
+ *
+ * Entries are keyed by path and bounded by a byte budget; the least recently used ones are
+ * evicted first. Each entry keeps the validator it was read under: the content hash from the
+ * asset manifest, or the file's size and mtime for files the manifest does not list. A lookup
+ * with a different validator drops the entry, so rewritten files are never served stale.
+ * Data lives in PSRAM when the chip has it.
+ */
+
+#define ASSET_CACHE_SHA256_LEN 32
+
+// What the cached content must still match
+typedef struct {
+    bool hashed;                        // `sha256` is set (manifest entry); otherwise size and mtime are compared
+    uint8_t sha256[ASSET_CACHE_SHA256_LEN];
+    uint32_t size;
+    time_t mtime;
+} asset_cache_validator_t;
+
+// A cached file, held by the caller between asset_cache_acquire() and asset_cache_release()
+typedef struct asset_cache_entry asset_cache_entry_t;
+
+typedef struct {
+    uint32_t budget;                    // Bytes of file data the cache may hold
+    uint32_t used;
+    uint32_t entries;
+    uint32_t hits;
+    uint32_t misses;                    // Lookups that had to read the file (including stale entries)
+    uint32_t evictions;                 // Entries dropped to make room
+    uint32_t stale;                     // Entries dropped because the file changed
+    uint32_t uncacheable;               // Files larger than ASSET_CACHE_MAX_FILE, or that could not be read into memory
+} asset_cache_stats_t;
+
+/**
+ * @brief Set up the cache with a budget of `budget` bytes (0 disables it)
+ */
+esp_err_t asset_cache_init(uint32_t budget);
+
+/**
+ * @brief Find `path` with content matching `validator`
+ *
+ * @return asset_cache_entry_t* Entry to send from, to be released with asset_cache_release(), or NULL
+ */
+asset_cache_entry_t *asset_cache_acquire(const char *path, const asset_cache_validator_t *validator);
+
+/**
+ * @brief Read `path` whole and add it to the cache
+ *
+ * @return asset_cache_entry_t* Entry to send from (released like a hit), or NULL if the file cannot be cached;
+ *         the caller then streams it from flash
+ */
+asset_cache_entry_t *asset_cache_load(const char *path, const asset_cache_validator_t *validator);
+
+/**
+ * @brief Data and length of an acquired entry
+ */
+const uint8_t *asset_cache_data(const asset_cache_entry_t *entry, size_t *len);
+
+/**
+ * @brief Give back an entry from asset_cache_acquire() or asset_cache_load()
+ */
+void asset_cache_release(asset_cache_entry_t *entry);
+
+/**
+ * @brief Drop every entry that is not being sent
+ */
+void asset_cache_clear(void);
+
+/**
+ * @brief Counters for sizing ASSET_CACHE_BUDGET
+ */
+void asset_cache_get_stats(asset_cache_stats_t *stats);
+
+#endif // ASSET_CACHE_H
@@ -0,0 +1,81 @@
+#ifndef ASSET_MANIFEST_H
+#define ASSET_MANIFEST_H
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ASSET_MANIFEST_SHA256_LEN 32
+#define ASSET_MANIFEST_BUCKETS 64       // Name hash buckets; lookups stay short for a few hundred files
+
+/*
+ * Content hashes of the files on the web partition, kept in a sidecar file next to them
+ * (one "<sha256 hex> <size> <name>" line per file). esp_littlefs does not expose the lfs_t
+ * handle, so the hashes cannot live in littlefs custom attributes.
+ *
+ * Entries are never moved once created: the HTTP task may look up one entry while the
+ * flash writer task updates another.
+ */
+
+typedef struct asset_manifest_entry {
+    struct asset_manifest_entry *next;
+    struct asset_manifest_entry *bucket_next;   // Next entry in the same hash bucket
+    bool valid;                         // false while the file on flash may not match `sha256`
+    uint32_t size;
+    uint8_t sha256[ASSET_MANIFEST_SHA256_LEN];
+    char name[];                        // Path relative to the partition root
+} asset_manifest_entry_t;
+
+typedef struct {
+    asset_manifest_entry_t *entries;
+    size_t count;
+    asset_manifest_entry_t *buckets[ASSET_MANIFEST_BUCKETS];
+} asset_manifest_t;
+
+/**
+ * @brief Load the manifest stored at `path`
+ *
+ * A missing or unreadable file yields an empty manifest, which simply means every file is rewritten.
+ *
+ * @return asset_manifest_t* Manifest, or NULL when out of memory
+ */
+asset_manifest_t *asset_manifest_load(const char *path);
+
+/**
+ * @brief Find the entry for `name`, or NULL
+ */
+asset_manifest_entry_t *asset_manifest_find(asset_manifest_t *manifest, const char *name);
+
+/**
+ * @brief Find the entry for `name`, creating an invalid one if needed
+ *
+ * @return asset_manifest_entry_t* Entry, or NULL when out of memory
+ */
+asset_manifest_entry_t *asset_manifest_get(asset_manifest_t *manifest, const char *name);
+
+/**
+ * @brief Check whether `full_path` already holds content with this digest and size
+ *
+ * The file must still exist with the recorded size, so files deleted behind the
+ * manifest's back are written again.
+ */
+bool asset_manifest_unchanged(asset_manifest_t *manifest, const char *name, const char *full_path,
+                              const uint8_t *sha256, uint32_t size);
+
+/**
+ * @brief Record the content now on flash for an entry
+ */
+void asset_manifest_set(asset_manifest_entry_t *entry, const uint8_t *sha256, uint32_t size);
+
+/**
+ * @brief Write the valid entries to `path` (through a temporary file)
+ */
+esp_err_t asset_manifest_save(const asset_manifest_t *manifest, const char *path);
+
+/**
+ * @brief Free the manifest
+ */
+void asset_manifest_destroy(asset_manifest_t *manifest);
+
+#endif // ASSET_MANIFEST_H
@@ -0,0 +1,58 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming decoder for delta firmware sections.
+ *
+ * A patch is a sequence of operations that rebuild the new image front to back:
+ *   COPY (0x01): uint32_t source offset, uint32_t length - bytes taken from the source partition
+ *   DATA (0x02): uint32_t length, followed by that many literal bytes
+ * Integers are little-endian. Operations may be split across any number of feed calls.
+ */
+
+#define DELTA_OP_COPY 0x01
+#define DELTA_OP_DATA 0x02
+
+// Receives reconstructed image data; returning an error stops the patch
+typedef esp_err_t (*delta_patch_output_fn)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct delta_patch delta_patch_t;
+
+/**
+ * @brief Allocate a patch decoder reading COPY data from `source`
+ *
+ * @param source Partition holding the base image (normally the running app)
+ * @return delta_patch_t* Decoder, or NULL when out of memory
+ */
+delta_patch_t *delta_patch_create(const esp_partition_t *source);
+
+/**
+ * @brief Apply the next slice of the patch stream
+ *
+ * @return esp_err_t ESP_OK, ESP_ERR_INVALID_RESPONSE for a malformed patch,
+ *         ESP_ERR_INVALID_SIZE for a COPY outside the source, or the error from `output`
+ */
+esp_err_t delta_patch_feed(delta_patch_t *patch, const uint8_t *data, size_t len,
+                           delta_patch_output_fn output, void *ctx);
+
+/**
+ * @brief Check that the stream ended on an operation boundary
+ */
+esp_err_t delta_patch_finish(delta_patch_t *patch);
+
+/**
+ * @brief Bytes produced from the source partition and from literal data
+ */
+void delta_patch_stats(const delta_patch_t *patch, size_t *copied, size_t *literal);
+
+/**
+ * @brief Free the decoder
+ */
+void delta_patch_destroy(delta_patch_t *patch);
+
+#endif // DELTA_PATCH_H
@@ -0,0 +1,39 @@
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The html/ tree compiled into the firmware.
+ *
+ * embed_web_assets.py turns html/ into a constant table at build time, sorted by URI, with each
+ * asset's MIME type, ETag and precompressed gzip variant worked out up front. The table lives in
+ * rodata, so serving it is a binary search and a send from flash-mapped memory. The UI therefore
+ * works without a mounted web bank; the bank and the asset bundle, which follow package updates,
+ * take precedence when they hold a file.
+ */
+
+typedef struct {
+    const char *uri;                    // "/styles.css"
+    const char *mime_type;
+    const char *etag;                   // Quoted, derived from the SHA-256 like the manifest ETags
+    const uint8_t *data;
+    uint32_t length;
+    const char *gzip_etag;              // NULL when the asset has no gzip variant
+    const uint8_t *gzip_data;
+    uint32_t gzip_length;
+} embedded_asset_t;
+
+// Generated table (embedded_assets_table.c in the build directory), sorted by `uri` in strcmp() order
+extern const embedded_asset_t embedded_assets[];
+extern const size_t embedded_asset_count;
+
+/**
+ * @brief Find the embedded asset for a request path (without query string)
+ *
+ * @return const embedded_asset_t* Table entry, or NULL if html/ had no such file
+ */
+const embedded_asset_t *embedded_asset_find(const char *uri);
+
+#endif // EMBEDDED_ASSETS_H
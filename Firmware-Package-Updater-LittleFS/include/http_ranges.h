@@ -0,0 +1,30 @@
+#ifndef HTTP_RANGES_H
+#define HTTP_RANGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Range request parsing (RFC 9110 section 14) for the static file path and the firmware download.
+ *
+ * Only byte ranges are understood. A header this parser cannot use (another unit, bad syntax,
+ * more than `max_ranges` ranges) is ignored and the whole representation is sent, which the RFC
+ * allows. Ranges are clipped to the representation; those starting past its end are dropped.
+ */
+
+#define HTTP_RANGES_MAX 8               // Ranges honoured in one request
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;                       // Inclusive, as in Content-Range
+} http_range_t;
+
+/**
+ * @brief Parse a Range header value such as "bytes=0-499,1000-,-200" against a representation of `size` bytes
+ *
+ * @return int Number of ranges written to `ranges`; 0 to send the whole representation;
+ *         -1 if the header is valid but no range can be satisfied (416)
+ */
+int http_ranges_parse(const char *value, uint32_t size, http_range_t *ranges, size_t max_ranges);
+
+#endif // HTTP_RANGES_H
@@ -0,0 +1,62 @@
+#ifndef INFLATE_STREAM_H
+#define INFLATE_STREAM_H
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming zlib/deflate decoder for compressed package sections.
+ *
+ * Wraps the miniz tinfl decoder in ROM. Memory use is fixed: the decoder
+ * state plus a 32 KB wrapping dictionary that doubles as the output buffer,
+ * whatever the size of the stream.
+ */
+
+// Receives decompressed data; returning an error stops the stream
+typedef esp_err_t (*inflate_stream_output_fn)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct inflate_stream inflate_stream_t;
+
+/**
+ * @brief Allocate a decoder
+ *
+ * @return inflate_stream_t* Decoder, or NULL when out of memory
+ */
+inflate_stream_t *inflate_stream_create(void);
+
+/**
+ * @brief Prepare the decoder for a new zlib stream
+ */
+void inflate_stream_reset(inflate_stream_t *stream);
+
+/**
+ * @brief Decompress the next slice of compressed data
+ *
+ * @param stream Decoder
+ * @param data Compressed bytes, any length
+ * @param len Number of bytes
+ * @param output Called with each run of decompressed bytes
+ * @param ctx Passed to `output`
+ * @return esp_err_t ESP_OK, ESP_ERR_INVALID_RESPONSE for corrupt data,
+ *         ESP_ERR_INVALID_SIZE for data past the end of the stream, or the error from `output`
+ */
+esp_err_t inflate_stream_feed(inflate_stream_t *stream, const void *data, size_t len,
+                              inflate_stream_output_fn output, void *ctx);
+
+/**
+ * @brief Check that the stream ended cleanly (final block and Adler-32 seen)
+ */
+esp_err_t inflate_stream_finish(inflate_stream_t *stream);
+
+/**
+ * @brief Total decompressed bytes produced since the last reset
+ */
+size_t inflate_stream_total_out(const inflate_stream_t *stream);
+
+/**
+ * @brief Free the decoder
+ */
+void inflate_stream_destroy(inflate_stream_t *stream);
+
+#endif // INFLATE_STREAM_H
@@ -0,0 +1,34 @@
+#ifndef MIME_TYPES_H
+#define MIME_TYPES_H
+
+/*
+ * Content-Type by file extension for files served from the web bank.
+ *
+ * The bundle index and the embedded table carry their MIME types; files in the bank do not, so
+ * the static route looks them up here on every request. The extensions are hashed into a small
+ * open-addressed table, so a lookup costs the same however many assets or types there are.
+ * embed_mime_types.py generates the list from MIME_TYPES in create_asset_bundle.py, so every source
+ * sends the same Content-Type for a file.
+ */
+
+#include <stddef.h>
+
+#define MIME_TYPE_SLOT_COUNT 64         // Hash slots, a power of two; the table may fill at most half of them
+
+typedef struct {
+    const char *extension;              // Lowercase, without the dot: "html"
+    const char *mime_type;
+} mime_type_entry_t;
+
+// Generated table (mime_types_table.c in the build directory)
+extern const mime_type_entry_t mime_type_table[];
+extern const size_t mime_type_count;
+
+/**
+ * @brief Content-Type for a path; a trailing ".gz" is skipped, so "app.js.gz" is JavaScript
+ *
+ * @return const char* MIME type, "application/octet-stream" for unknown extensions
+ */
+const char *mime_type_for_path(const char *path);
+
+#endif // MIME_TYPES_H
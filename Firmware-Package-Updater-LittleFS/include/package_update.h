@@ -0,0 +1,80 @@
+#ifndef PACKAGE_UPDATE_H
+#define PACKAGE_UPDATE_H
+
+#include "pkg_parser.h"
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACKAGE_CHECKPOINT_LAYOUT 3     // Bump whenever package_checkpoint_t changes
+
+/*
+ * A position in the package from which an interrupted update can continue, even after a reboot.
+ * Everything before `offset` is on flash and verified as far as the format allows.
+ */
+typedef struct {
+    uint32_t layout;                    // PACKAGE_CHECKPOINT_LAYOUT
+    uint32_t offset;                    // Package bytes consumed
+    uint32_t section;                   // Index of the section the next bytes belong to; the ones before it are verified
+    uint32_t section_written;           // Image bytes of that section already on flash (raw firmware, sector aligned)
+    uint32_t update_partition_address;  // OTA slot the update writes, to detect a changed partition layout
+    uint32_t files_skipped;
+    uint64_t bytes_skipped;
+    pkg_header_t header;
+    mbedtls_sha256_context section_sha; // Software copy of the running section digest (mbedtls_sha256_clone)
+} package_checkpoint_t;
+
+// Reads up to `len` package bytes, returning the count, or <= 0 on failure (httpd_req_recv semantics)
+typedef int (*package_recv_fn)(void *ctx, char *buffer, size_t len);
+
+// Persists a checkpoint; called with the writer task idle
+typedef esp_err_t (*package_checkpoint_fn)(void *ctx, const package_checkpoint_t *checkpoint);
+
+typedef struct {
+    package_recv_fn recv;
+    void *recv_ctx;
+    uint32_t size;                      // Total package size in bytes
+    const package_checkpoint_t *resume; // Continue from here, or NULL to start at the header
+    package_checkpoint_fn checkpoint;   // NULL for uploads that cannot resume
+    void *checkpoint_ctx;
+} package_update_config_t;
+
+typedef struct {
+    httpd_err_code_t status;            // Response code for a failure
+    const char *message;                // Response text, NULL when the transport itself failed
+    bool resumable;                     // Failed while receiving; the last checkpoint is still good
+    uint32_t files_skipped;
+    uint64_t bytes_skipped;
+} package_update_result_t;
+
+/**
+ * @brief Apply a firmware + LittleFS update package read from `config->recv`
+ *
+ * Dispatches each package section by type: the app to the next OTA slot, files or a LittleFS
+ * image to the web bank paired with it, and partition images to the data partitions they name.
+ * Every section is verified, then the boot partition is switched. The caller reboots.
+ *
+ * @param config Package source and optional checkpointing
+ * @param result Outcome details for the response
+ * @return esp_err_t ESP_OK once the new firmware is bootable, or error code
+ */
+esp_err_t package_update_run(const package_update_config_t *config, package_update_result_t *result);
+
+/**
+ * @brief Prepare the web assets of an app slot that was written without a package
+ *
+ * Copies the running web bank into the slot's bank and clears the slot's asset bundle, as
+ * package_update_run() does for a package without web sections. Registered as the OTA
+ * component's prepare-slot hook, so perform_ota_update() keeps the UI too.
+ *
+ * @param update_app App partition the firmware was written to
+ * @return esp_err_t ESP_OK once the slot may become the boot partition, or error code
+ */
+esp_err_t package_update_prepare_slot(const esp_partition_t *update_app);
+
+#endif // PACKAGE_UPDATE_H
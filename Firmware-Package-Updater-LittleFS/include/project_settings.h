@@ -10,4 +10,46 @@
 #define WIFI_STA_SSID "My_SSID"   // Your router's WiFi SSID
 #define WIFI_STA_PASSWORD "My_Password" // Your router's WiFi password
 
+// Web Asset Caching - Cache-Control sent with the web assets, next to an ETag from the asset manifest
+#define WEB_CACHE_CONTROL_DOCUMENT "no-cache"       // HTML and JSON: revalidated on every load (a 304 when unchanged)
+#define WEB_CACHE_CONTROL_CODE "no-cache"           // JS and CSS: names are not versioned, so an update must show up at once
+#define WEB_CACHE_CONTROL_MEDIA "max-age=86400"     // Images and fonts: reused for a day without asking
+
+// Web UI Settings - Routes of the static file server (GET /*)
+#define WEB_UI_INDEX "/firmware-update.html"    // Asset served for "/"
+#define WEB_DIRECTORY_INDEX "index.html"        // Served for other paths ending in "/"
+
+// Asset Cache Settings - Hot web assets kept in RAM (PSRAM when available), see GET /asset_cache
+#define ASSET_CACHE_BUDGET (32 * 1024)      // Bytes of file data the cache may hold (0: no cache, every request reads flash)
+#define ASSET_CACHE_MAX_FILE (16 * 1024)    // Larger files are streamed from flash instead
+
+// Update Pipeline Settings - Overlaps network receive with flash writes during package updates
+#ifndef UPDATE_PIPELINE_BUFFER_COUNT       // Overridden by the host benchmark sweep (host/)
+#define UPDATE_PIPELINE_BUFFER_COUNT 4      // Number of DMA-capable receive buffers in the pool
+#endif
+#define UPDATE_WRITER_TASK_STACK 4096       // Flash writer task stack size
+#define UPDATE_WRITER_TASK_PRIORITY 5       // Flash writer task priority (HTTP server default is 5)
+#define UPDATE_WRITER_TASK_CORE 1           // Core for the flash writer task (falls back to no affinity on single-core chips)
+#define OTA_ERASE_AHEAD 1                   // 1: erase only the sectors the firmware needs, ahead of the write cursor | 0: erase the whole OTA slot first
+#define UPDATE_PARTITION_STAGE_MAX (32 * 1024) // Data partition sections up to this size are checked in RAM before the partition is erased
+
+// Resumable Upload Settings - Chunked uploads through /update/init, /update/chunk and /update/commit
+#define UPDATE_CHECKPOINT_INTERVAL (64 * 1024)  // Package bytes between resume checkpoints (a multiple of the 4096 byte flash sector)
+#define UPDATE_SESSION_STREAM_SIZE 8192     // Bytes buffered between the HTTP task and the session task
+#define UPDATE_SESSION_IDLE_TIMEOUT_MS 30000 // Pause an upload (keeping its checkpoint) after this long without data
+#define UPDATE_SESSION_TASK_STACK 6144      // Session task stack size (runs the package parser)
+#define UPDATE_SESSION_TASK_PRIORITY 5      // Session task priority
+#define UPDATE_SESSION_TASK_CORE 0          // Core for the session task (falls back to no affinity on single-core chips)
+
+// Update Worker Settings - Runs /update_firmware and /update/commit off the HTTP server task
+#define UPDATE_WORKER_TASK_STACK 6144       // Update worker task stack size (runs the package parser)
+#define UPDATE_WORKER_TASK_PRIORITY 5       // Update worker task priority
+#define UPDATE_WORKER_TASK_CORE 0           // Core for the update worker task (falls back to no affinity on single-core chips)
+
+// Update Telemetry Settings - Progress record behind /update_status
+#define UPDATE_TELEMETRY_LOG_INTERVAL_MS 5000   // Minimum time between progress log lines during an update (0: no progress lines)
+
+// Update Restart Settings - Reboot into the new firmware once the response is delivered
+#define UPDATE_RESTART_TIMEOUT_MS 3000      // Longest wait for the client to take the update response before restarting anyway
+
 #endif // PROJECT_SETTINGS_H
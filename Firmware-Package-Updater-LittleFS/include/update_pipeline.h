@@ -0,0 +1,95 @@
+#ifndef UPDATE_PIPELINE_H
+#define UPDATE_PIPELINE_H
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+
+/*
+ * Producer/consumer pipeline used by the package upload handler.
+ *
+ * The HTTP task (producer) fills buffers taken from a fixed pool of DMA-capable
+ * buffers and submits them as write jobs. A dedicated writer task (consumer)
+ * runs the jobs in order, so network receive overlaps flash erase/program.
+ */
+
+// Write callback executed on the writer task. `data` is NULL for control jobs (e.g. closing a file).
+typedef esp_err_t (*update_pipeline_write_fn)(void *ctx, const char *data, size_t len);
+
+// Background work run on the writer task while no jobs are queued. Returns true while more work remains.
+typedef bool (*update_pipeline_idle_fn)(void *ctx);
+
+typedef struct {
+    size_t buffer_count;    // Number of buffers in the pool
+    size_t buffer_size;     // Size of each buffer in bytes
+    uint32_t stack_size;    // Writer task stack size
+    UBaseType_t priority;   // Writer task priority
+    BaseType_t core_id;     // Writer task core (tskNO_AFFINITY to float)
+} update_pipeline_config_t;
+
+typedef struct update_pipeline update_pipeline_t;
+
+/**
+ * @brief Allocate the buffer pool and start the writer task
+ *
+ * @param config Pipeline configuration
+ * @param out_pipeline Receives the pipeline handle
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NO_MEM or ESP_FAIL otherwise
+ */
+esp_err_t update_pipeline_create(const update_pipeline_config_t *config, update_pipeline_t **out_pipeline);
+
+/**
+ * @brief Take a free buffer from the pool, blocking until the writer returns one
+ *
+ * The buffer is owned by the caller until it is passed to update_pipeline_submit()
+ * or handed back with update_pipeline_release().
+ */
+char *update_pipeline_acquire(update_pipeline_t *pipeline);
+
+/**
+ * @brief Return an unused buffer to the pool
+ */
+void update_pipeline_release(update_pipeline_t *pipeline, char *buffer);
+
+/**
+ * @brief Queue a write job for the writer task
+ *
+ * Ownership of `buffer` (may be NULL for control jobs) passes to the pipeline.
+ * Jobs run in submission order. Once a job fails, later data jobs are skipped
+ * and their buffers recycled; control jobs (NULL buffer) still run so that
+ * resources such as open files are released.
+ *
+ * @return esp_err_t ESP_OK if queued, or the first error reported by the writer
+ */
+esp_err_t update_pipeline_submit(update_pipeline_t *pipeline, update_pipeline_write_fn fn, void *ctx,
+                                 char *buffer, size_t len);
+
+/**
+ * @brief Wait until every submitted job has run
+ *
+ * @return esp_err_t ESP_OK, or the first error reported by the writer
+ */
+esp_err_t update_pipeline_flush(update_pipeline_t *pipeline);
+
+/**
+ * @brief First error reported by the writer task, without waiting
+ */
+esp_err_t update_pipeline_error(update_pipeline_t *pipeline);
+
+/**
+ * @brief Install (or clear, with NULL) the idle hook of the writer task
+ *
+ * The change is queued behind jobs already submitted. The hook is called
+ * whenever the job queue is empty, until it returns false or an error occurs.
+ */
+void update_pipeline_set_idle(update_pipeline_t *pipeline, update_pipeline_idle_fn fn, void *ctx);
+
+/**
+ * @brief Stop the writer task and free the buffer pool
+ *
+ * Pending jobs are run (or skipped after an error) before the task exits.
+ */
+void update_pipeline_destroy(update_pipeline_t *pipeline);
+
+#endif // UPDATE_PIPELINE_H
@@ -0,0 +1,46 @@
+#ifndef UPDATE_RESTART_H
+#define UPDATE_RESTART_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Reboot into new firmware once the update response has reached the client.
+ *
+ * Instead of sleeping a fixed time after the response, the restart half-closes the connection
+ * and waits for the client to close its side, which it only does after reading the whole
+ * response. Then the web server is stopped and the web bank unmounted, and the device restarts.
+ * Every wait is bounded by UPDATE_RESTART_TIMEOUT_MS. The measured shutdown time is kept in RTC
+ * memory across the restart, so the new firmware can report the time-to-reboot.
+ */
+
+typedef struct {
+    uint32_t shutdown_ms;               // Update complete -> esp_restart()
+    uint32_t flush_ms;                  // Part of it spent waiting for the client to take the response
+    uint32_t boot_ms;                   // esp_restart() -> app_main() of the new firmware
+    bool response_delivered;            // The client closed the connection before the timeout
+} update_restart_stats_t;
+
+/**
+ * @brief Pick up the record left by a restart after an update; call first thing in app_main()
+ */
+void update_restart_init(void);
+
+/**
+ * @brief Restart once the response sent on `req` has been delivered. Does not return.
+ *
+ * @param req Async request the successful update response was sent on; completed here
+ * @param completed_us esp_timer_get_time() when the update completed, the start of the measurement
+ */
+void update_restart_after_response(httpd_req_t *req, int64_t completed_us) __attribute__((noreturn));
+
+/**
+ * @brief Timings of the restart that started this boot
+ *
+ * @return true if this boot followed an update restart
+ */
+bool update_restart_last(update_restart_stats_t *stats);
+
+#endif // UPDATE_RESTART_H
@@ -0,0 +1,76 @@
+#ifndef UPDATE_SESSION_H
+#define UPDATE_SESSION_H
+
+#include "package_update.h"
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Resumable package upload, sent as a series of chunks.
+ *
+ * A session task runs package_update_run() on the bytes the chunks deliver. Its checkpoints
+ * are kept in NVS under the client's upload id, so an upload that loses its connection, or
+ * the device itself, continues from the last checkpoint instead of starting over.
+ */
+
+#define UPDATE_SESSION_ID_MAX_LEN 64
+
+/**
+ * @brief Start or continue an upload
+ *
+ * A live session with the same id and size keeps going from where it is. Otherwise any
+ * running session is stopped and the upload resumes from the last checkpoint stored for
+ * this id, or from the start of the package.
+ *
+ * @param id Client chosen upload id (identifies the package)
+ * @param size Package size in bytes
+ * @param offset Receives the package offset the next chunk must start at
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG for a bad id or size, or error code
+ */
+esp_err_t update_session_init(const char *id, uint32_t size, uint32_t *offset);
+
+/**
+ * @brief Feed package bytes starting at `offset` to the session task
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE without a session,
+ *         ESP_ERR_INVALID_ARG if `offset` is not the expected offset,
+ *         ESP_ERR_INVALID_SIZE past the end of the package, or ESP_FAIL once the update has failed
+ */
+esp_err_t update_session_write(uint32_t offset, const char *data, size_t len);
+
+/**
+ * @brief Package offset the next chunk must start at
+ */
+uint32_t update_session_offset(void);
+
+/**
+ * @brief Package size of the current session
+ */
+uint32_t update_session_size(void);
+
+/**
+ * @brief Wait for the session task to finish the update
+ *
+ * Called once the whole package has been written, or after update_session_write()
+ * returned ESP_FAIL to collect the failure.
+ *
+ * @param result Outcome details for the response
+ * @return esp_err_t ESP_OK once the new firmware is bootable, ESP_ERR_INVALID_STATE without
+ *         a session, ESP_ERR_INVALID_SIZE if the package is incomplete, or the update's error
+ */
+esp_err_t update_session_commit(package_update_result_t *result);
+
+/**
+ * @brief true while a session is accepting chunks
+ */
+bool update_session_active(void);
+
+/**
+ * @brief Stop the running session; its last checkpoint stays available for a resume
+ */
+void update_session_abort(void);
+
+#endif // UPDATE_SESSION_H
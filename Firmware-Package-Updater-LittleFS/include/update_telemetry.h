@@ -0,0 +1,108 @@
+#ifndef UPDATE_TELEMETRY_H
+#define UPDATE_TELEMETRY_H
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Progress record of the package update in progress, replacing per-chunk log lines.
+ *
+ * The update path publishes into it without locks: every counter has a single writer (the
+ * receiving task or the flash writer task) and is stored atomically, and the current file name
+ * is published under a sequence counter. Readers such as /update_status take a consistent
+ * snapshot at any time without stalling the update.
+ */
+
+#define UPDATE_TELEMETRY_FILE_LEN 64    // Longer file names are truncated in the record
+
+typedef enum {
+    UPDATE_PHASE_IDLE,                  // No update has run since boot
+    UPDATE_PHASE_HEADER,                // Waiting for the package header
+    UPDATE_PHASE_FIRMWARE,              // Firmware section -> OTA slot
+    UPDATE_PHASE_BANK_SYNC,             // Copying the running web bank into the next one
+    UPDATE_PHASE_FILES,                 // LittleFS file records -> next web bank
+    UPDATE_PHASE_IMAGE,                 // LittleFS image section -> next web bank
+    UPDATE_PHASE_PARTITION,             // Partition image or asset bundle section -> its data partition
+    UPDATE_PHASE_DONE,                  // Verified; boot partition switched
+    UPDATE_PHASE_FAILED,
+} update_phase_t;
+
+typedef struct {
+    update_phase_t phase;
+    uint32_t size;                      // Package size
+    uint32_t received;                  // Package bytes received by the update
+    uint32_t flashed;                   // Bytes written to the OTA slot and the web bank (after decompression)
+    uint32_t files_written;
+    uint32_t files_skipped;             // Unchanged files that were not rewritten
+    uint32_t recv_ms;                   // Time spent waiting for package data
+    uint32_t flash_ms;                  // Time the writer task spent writing flash
+    uint32_t elapsed_ms;                // Since the update started (until it ended, once it has)
+    esp_err_t error;                    // ESP_OK, or the error that stopped the update
+    const char *message;                // Failure reason, NULL if none
+    char file[UPDATE_TELEMETRY_FILE_LEN];   // File (or data partition) being written, "" otherwise
+} update_telemetry_t;
+
+/**
+ * @brief Reset the record for a new update
+ *
+ * @param size Package size in bytes
+ * @param offset Package bytes already applied (resumed updates)
+ */
+void update_telemetry_begin(uint32_t size, uint32_t offset);
+
+/**
+ * @brief Enter a new phase
+ */
+void update_telemetry_phase(update_phase_t phase);
+
+/**
+ * @brief Account package bytes received, and the time spent waiting for them (receiving task)
+ */
+void update_telemetry_received(uint32_t len, int64_t wait_us);
+
+/**
+ * @brief Account bytes written to flash, and the time the write took (writer task)
+ */
+void update_telemetry_flashed(uint32_t len, int64_t write_us);
+
+/**
+ * @brief Publish the file now being written (receiving task)
+ */
+void update_telemetry_file(const char *name);
+
+/**
+ * @brief Count a file as written (writer task) or skipped as unchanged (receiving task)
+ */
+void update_telemetry_file_done(bool skipped);
+
+/**
+ * @brief Record the failure of the update; only the first one is kept
+ *
+ * @param message Static string describing the failure, or NULL
+ */
+void update_telemetry_fail(esp_err_t error, const char *message);
+
+/**
+ * @brief Mark the update as finished, DONE or FAILED, and log the summary line
+ */
+void update_telemetry_end(esp_err_t result);
+
+/**
+ * @brief Copy the current record
+ */
+void update_telemetry_snapshot(update_telemetry_t *out);
+
+/**
+ * @brief Name of a phase for logs and JSON
+ */
+const char *update_telemetry_phase_name(update_phase_t phase);
+
+/**
+ * @brief Log one progress line, at most every UPDATE_TELEMETRY_LOG_INTERVAL_MS
+ *
+ * Cheap enough to call on every received slice; does nothing when the interval is 0.
+ */
+void update_telemetry_log_progress(void);
+
+#endif // UPDATE_TELEMETRY_H
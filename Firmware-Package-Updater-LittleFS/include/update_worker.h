@@ -0,0 +1,42 @@
+#ifndef UPDATE_WORKER_H
+#define UPDATE_WORKER_H
+
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Runs long update requests off the HTTP server task.
+ *
+ * A handler hands its request to the worker with update_worker_submit(), which detaches it
+ * with httpd_req_async_handler_begin() and returns at once, so the server keeps answering
+ * other requests while the job receives and writes the package. The worker runs one job at
+ * a time and does not queue: a second submit is refused while a job is pending or running.
+ */
+
+// Job run on the worker task. It owns the async request and must call httpd_req_async_handler_complete().
+typedef void (*update_worker_job_fn)(httpd_req_t *req);
+
+/**
+ * @brief Create the worker task (UPDATE_WORKER_* settings in project_settings.h)
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NO_MEM otherwise
+ */
+esp_err_t update_worker_start(void);
+
+/**
+ * @brief Run `job` for `req` on the worker task
+ *
+ * @param req Request from an HTTP handler; the handler must not use it after a successful submit
+ * @param job Job to run
+ * @return esp_err_t ESP_OK once the worker owns the request, ESP_ERR_INVALID_STATE if it is busy, or error code
+ */
+esp_err_t update_worker_submit(httpd_req_t *req, update_worker_job_fn job);
+
+/**
+ * @brief true while a job is pending or running
+ */
+bool update_worker_busy(void);
+
+#endif // UPDATE_WORKER_H
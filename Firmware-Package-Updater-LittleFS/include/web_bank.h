@@ -0,0 +1,77 @@
+#ifndef WEB_BANK_H
+#define WEB_BANK_H
+
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <stdbool.h>
+#include "asset_manifest.h"
+#include "pkg_parser.h"
+
+/*
+ * A/B web asset banks. Each OTA app slot has its own LittleFS partition
+ * (ota_0 <-> web_0, ota_1 <-> web_1; the factory app uses web_1), so the bank follows the boot partition:
+ * an update fills the bank paired with the slot it writes, the running bank keeps
+ * serving meanwhile, and a rollback comes back to the assets of the old firmware.
+ */
+
+#define WEB_BANK_MOUNT_POINT "/web"             // Bank of the running firmware
+#define WEB_BANK_NEXT_MOUNT_POINT "/web_next"   // Bank being prepared for the next boot
+
+// Path of a bank file: the longer mount point, '/', a name of up to PKG_FILE_NAME_MAX_LEN and the terminator
+#define WEB_BANK_PATH_MAX_SIZE (sizeof(WEB_BANK_NEXT_MOUNT_POINT) + PKG_FILE_NAME_MAX_LEN + 1)
+
+/**
+ * @brief Find the web bank paired with an app partition
+ *
+ * Apps outside the OTA slots (the factory app) use web_1: an update from the factory app
+ * writes ota_0, so its bank must not be the one the factory app is serving.
+ *
+ * @return const esp_partition_t* Bank partition, or NULL if the partition table lacks it
+ */
+const esp_partition_t *web_bank_partition(const esp_partition_t *app);
+
+/**
+ * @brief Mount the running firmware's bank at WEB_BANK_MOUNT_POINT
+ */
+esp_err_t web_bank_mount_active(void);
+
+/**
+ * @brief Unmount the running firmware's bank (before a restart)
+ */
+void web_bank_unmount_active(void);
+
+/**
+ * @brief Mount the bank paired with `update_app` at WEB_BANK_NEXT_MOUNT_POINT
+ *
+ * @param update_app App partition the update is written to
+ * @param format_if_mount_failed Format a bank that holds no valid filesystem
+ */
+esp_err_t web_bank_mount_next(const esp_partition_t *update_app, bool format_if_mount_failed);
+
+/**
+ * @brief Unmount the next bank if it is mounted
+ */
+void web_bank_unmount_next(void);
+
+/**
+ * @brief Make the next bank hold the same files as the running one
+ *
+ * Files whose manifest entries already match are left alone, the rest are copied (and hashed
+ * into `next_manifest`), and files the running bank does not have are removed.
+ *
+ * @param active_manifest Hashes of the running bank (may be empty)
+ * @param next_manifest Hashes of the next bank, updated to match its new content
+ */
+esp_err_t web_bank_sync(asset_manifest_t *active_manifest, asset_manifest_t *next_manifest);
+
+/**
+ * @brief Give the bank paired with `update_app` the running bank's files, manifest included
+ *
+ * For updates that carry no web assets: without it the new firmware would boot into whatever
+ * its bank held before, or an empty one. Mounts, syncs and unmounts the next bank.
+ *
+ * @param update_app App partition the update was written to
+ */
+esp_err_t web_bank_copy_active(const esp_partition_t *update_app);
+
+#endif // WEB_BANK_H
@@ -0,0 +1,154 @@
+#include "asset_bundle.h"
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const char* TAG = "AssetBundle";
+
+_Static_assert(sizeof(asset_bundle_header_t) == 20, "Bundle header layout (create_asset_bundle.py)");
+_Static_assert(sizeof(asset_bundle_entry_t) == 48, "Bundle index entry layout (create_asset_bundle.py)");
+
+// The running firmware's bundle. Updates write the other slot's partition, so the mapping
+// does not change until the next boot and lookups need no lock.
+static const uint8_t *bundle;
+static esp_partition_mmap_handle_t bundle_handle;
+
+const esp_partition_t *asset_bundle_partition(const esp_partition_t *app) {
+    int slot = 1;   // Like web_bank_partition(): the factory app pairs with the slot it does not update first
+    if (app && app->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_0 && app->subtype < ESP_PARTITION_SUBTYPE_APP_OTA_MAX) {
+        slot = app->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0;
+    }
+
+    char label[12];
+    snprintf(label, sizeof(label), "assets_%d", slot);
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+}
+
+static const asset_bundle_entry_t *bundle_entries(const uint8_t *base) {
+    return (const asset_bundle_entry_t *)(base + sizeof(asset_bundle_header_t));
+}
+
+// true if a NUL-terminated string starts at `offset` and ends inside the bundle
+static bool string_valid(const uint8_t *base, uint32_t size, uint32_t offset) {
+    return offset < size && memchr(base + offset, '\0', size - offset) != NULL;
+}
+
+// Every offset must stay inside the bundle and the paths must be sorted, or lookups could read past it
+static bool index_valid(const uint8_t *base, uint32_t size, uint32_t entry_count) {
+    const asset_bundle_entry_t *entries = bundle_entries(base);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        const asset_bundle_entry_t *entry = &entries[i];
+        if (!string_valid(base, size, entry->path_offset) || !string_valid(base, size, entry->mime_offset) ||
+            entry->data_offset > size || entry->data_length > size - entry->data_offset) {
+            ESP_LOGE(TAG, "Index entry %" PRIu32 " points outside the bundle", i);
+            return false;
+        }
+        if (i > 0 && strcmp((const char *)base + entries[i - 1].path_offset, (const char *)base + entry->path_offset) >= 0) {
+            ESP_LOGE(TAG, "Index is not sorted at entry %" PRIu32, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Maps the bundle held by `partition` once its header and index check out
+static esp_err_t map_bundle(const esp_partition_t *partition, const uint8_t **base, esp_partition_mmap_handle_t *handle,
+                            asset_bundle_header_t *header) {
+    esp_err_t err = esp_partition_read(partition, 0, header, sizeof(*header));
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (memcmp(header->magic, ASSET_BUNDLE_MAGIC, ASSET_BUNDLE_MAGIC_LEN) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint64_t index_end = sizeof(*header) + (uint64_t)header->entry_count * sizeof(asset_bundle_entry_t);
+    if (header->version != ASSET_BUNDLE_VERSION || header->bundle_size > partition->size || index_end > header->bundle_size) {
+        ESP_LOGE(TAG, "Unsupported or truncated bundle in %s", partition->label);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const void *mapped;
+    err = esp_partition_mmap(partition, 0, header->bundle_size, ESP_PARTITION_MMAP_DATA, &mapped, handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map %s (%s)", partition->label, esp_err_to_name(err));
+        return err;
+    }
+    if (!index_valid(mapped, header->bundle_size, header->entry_count)) {
+        esp_partition_munmap(*handle);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    *base = mapped;
+    return ESP_OK;
+}
+
+esp_err_t asset_bundle_map_active(void) {
+    const esp_partition_t *partition = asset_bundle_partition(esp_ota_get_running_partition());
+    if (!partition) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    asset_bundle_header_t header;
+    esp_err_t err = map_bundle(partition, &bundle, &bundle_handle, &header);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Serving %" PRIu32 " assets from %s (%" PRIu32 " bytes mapped)",
+                 header.entry_count, partition->label, header.bundle_size);
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGI(TAG, "No asset bundle in %s, serving from the web bank", partition->label);
+    }
+    return err;
+}
+
+bool asset_bundle_find(const char *path, asset_bundle_file_t *file) {
+    if (!bundle) {
+        return false;
+    }
+
+    const asset_bundle_header_t *header = (const asset_bundle_header_t *)bundle;
+    const asset_bundle_entry_t *entries = bundle_entries(bundle);
+    uint32_t low = 0;
+    uint32_t high = header->entry_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        const asset_bundle_entry_t *entry = &entries[mid];
+        int cmp = strcmp(path, (const char *)bundle + entry->path_offset);
+        if (cmp == 0) {
+            *file = (asset_bundle_file_t){
+                .path = (const char *)bundle + entry->path_offset,
+                .mime_type = (const char *)bundle + entry->mime_offset,
+                .data = bundle + entry->data_offset,
+                .length = entry->data_length,
+                .sha256 = entry->sha256,
+            };
+            return true;
+        }
+        if (cmp < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return false;
+}
+
+esp_err_t asset_bundle_verify(const esp_partition_t *partition) {
+    const uint8_t *base;
+    esp_partition_mmap_handle_t handle;
+    asset_bundle_header_t header;
+    esp_err_t err = map_bundle(partition, &base, &handle, &header);
+    if (err == ESP_OK) {
+        esp_partition_munmap(handle);
+    }
+    return err;
+}
+
+esp_err_t asset_bundle_invalidate(const esp_partition_t *partition) {
+    asset_bundle_header_t header;
+    if (esp_partition_read(partition, 0, &header, sizeof(header)) == ESP_OK &&
+        memcmp(header.magic, ASSET_BUNDLE_MAGIC, ASSET_BUNDLE_MAGIC_LEN) != 0) {
+        return ESP_OK;      // Nothing to erase
+    }
+    return esp_partition_erase_range(partition, 0, partition->erase_size);
+}
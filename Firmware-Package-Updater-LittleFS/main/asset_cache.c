@@ -0,0 +1,222 @@
+#include "project_settings.h"
+#include "asset_cache.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char* TAG = "AssetCache";
+
+struct asset_cache_entry {
+    asset_cache_entry_t *prev;          // Towards the most recently used entry
+    asset_cache_entry_t *next;          // Towards the least recently used entry
+    bool linked;                        // false once evicted; freed when the last holder releases it
+    uint32_t refs;                      // Holders sending from `data`
+    asset_cache_validator_t validator;
+    uint8_t *data;
+    size_t len;
+    char path[];
+};
+
+// The list holds a handful of UI files, so lookups simply walk it
+static struct {
+    SemaphoreHandle_t lock;
+    asset_cache_entry_t *head;          // Most recently used
+    asset_cache_entry_t *tail;          // Least recently used, evicted first
+    asset_cache_stats_t stats;
+} cache;
+
+static void entry_free(asset_cache_entry_t *entry) {
+    heap_caps_free(entry->data);
+    free(entry);
+}
+
+static void unlink_entry(asset_cache_entry_t *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache.head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache.tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+    entry->linked = false;
+    cache.stats.used -= entry->len;
+    cache.stats.entries--;
+}
+
+// Unlinks an entry; its memory goes once nobody is sending from it
+static void drop_entry(asset_cache_entry_t *entry) {
+    unlink_entry(entry);
+    if (entry->refs == 0) {
+        entry_free(entry);
+    }
+}
+
+static void push_front(asset_cache_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = cache.head;
+    if (cache.head) {
+        cache.head->prev = entry;
+    } else {
+        cache.tail = entry;
+    }
+    cache.head = entry;
+    entry->linked = true;
+    cache.stats.used += entry->len;
+    cache.stats.entries++;
+}
+
+static asset_cache_entry_t *find_entry(const char *path) {
+    for (asset_cache_entry_t *entry = cache.head; entry; entry = entry->next) {
+        if (strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool validator_matches(const asset_cache_validator_t *a, const asset_cache_validator_t *b) {
+    if (a->hashed != b->hashed || a->size != b->size) {
+        return false;
+    }
+    return a->hashed ? memcmp(a->sha256, b->sha256, ASSET_CACHE_SHA256_LEN) == 0 : a->mtime == b->mtime;
+}
+
+esp_err_t asset_cache_init(uint32_t budget) {
+    cache.stats.budget = budget;
+    if (budget == 0 || cache.lock) {
+        return ESP_OK;
+    }
+    cache.lock = xSemaphoreCreateMutex();
+    return cache.lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+asset_cache_entry_t *asset_cache_acquire(const char *path, const asset_cache_validator_t *validator) {
+    if (!cache.lock) {
+        return NULL;
+    }
+
+    xSemaphoreTake(cache.lock, portMAX_DELAY);
+    asset_cache_entry_t *entry = find_entry(path);
+    if (entry && !validator_matches(&entry->validator, validator)) {
+        ESP_LOGD(TAG, "%s changed, dropping it", path);
+        drop_entry(entry);
+        cache.stats.stale++;
+        entry = NULL;
+    }
+    if (entry) {
+        unlink_entry(entry);
+        push_front(entry);
+        entry->refs++;
+        cache.stats.hits++;
+    } else {
+        cache.stats.misses++;
+    }
+    xSemaphoreGive(cache.lock);
+    return entry;
+}
+
+// Reads the whole file into PSRAM if the chip has it, internal RAM otherwise
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return NULL;
+    }
+
+    struct stat st;
+    uint8_t *data = NULL;
+    if (fstat(fileno(file), &st) == 0 && st.st_size > 0 && st.st_size <= ASSET_CACHE_MAX_FILE &&
+        st.st_size <= cache.stats.budget) {
+        data = heap_caps_malloc(st.st_size, MALLOC_CAP_SPIRAM);
+        if (!data) {
+            data = heap_caps_malloc(st.st_size, MALLOC_CAP_8BIT);
+        }
+        if (data && fread(data, 1, st.st_size, file) != (size_t)st.st_size) {
+            heap_caps_free(data);
+            data = NULL;
+        }
+        *len = st.st_size;
+    }
+    fclose(file);
+    return data;
+}
+
+asset_cache_entry_t *asset_cache_load(const char *path, const asset_cache_validator_t *validator) {
+    if (!cache.lock) {
+        return NULL;
+    }
+
+    size_t len = 0;
+    uint8_t *data = read_file(path, &len);
+    size_t path_len = strlen(path);
+    asset_cache_entry_t *entry = data ? calloc(1, sizeof(asset_cache_entry_t) + path_len + 1) : NULL;
+    if (!entry) {
+        heap_caps_free(data);
+        xSemaphoreTake(cache.lock, portMAX_DELAY);
+        cache.stats.uncacheable++;
+        xSemaphoreGive(cache.lock);
+        return NULL;
+    }
+    entry->validator = *validator;
+    entry->data = data;
+    entry->len = len;
+    entry->refs = 1;
+    memcpy(entry->path, path, path_len + 1);
+
+    xSemaphoreTake(cache.lock, portMAX_DELAY);
+    asset_cache_entry_t *previous = find_entry(path);
+    if (previous) {
+        drop_entry(previous);
+    }
+    while (cache.tail && cache.stats.used + len > cache.stats.budget) {
+        ESP_LOGD(TAG, "Evicting %s", cache.tail->path);
+        drop_entry(cache.tail);
+        cache.stats.evictions++;
+    }
+    push_front(entry);
+    xSemaphoreGive(cache.lock);
+    return entry;
+}
+
+const uint8_t *asset_cache_data(const asset_cache_entry_t *entry, size_t *len) {
+    *len = entry->len;
+    return entry->data;
+}
+
+void asset_cache_release(asset_cache_entry_t *entry) {
+    xSemaphoreTake(cache.lock, portMAX_DELAY);
+    if (--entry->refs == 0 && !entry->linked) {
+        entry_free(entry);
+    }
+    xSemaphoreGive(cache.lock);
+}
+
+void asset_cache_clear(void) {
+    if (!cache.lock) {
+        return;
+    }
+    xSemaphoreTake(cache.lock, portMAX_DELAY);
+    while (cache.head) {
+        drop_entry(cache.head);
+    }
+    xSemaphoreGive(cache.lock);
+}
+
+void asset_cache_get_stats(asset_cache_stats_t *stats) {
+    if (!cache.lock) {
+        *stats = cache.stats;
+        return;
+    }
+    xSemaphoreTake(cache.lock, portMAX_DELAY);
+    *stats = cache.stats;
+    xSemaphoreGive(cache.lock);
+}
@@ -0,0 +1,176 @@
+#include "asset_manifest.h"
+
+#include <esp_log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+
+#define LINE_MAX_SIZE 340   // 64 hex digits + size + 255-byte name
+
+static const char* TAG = "AssetManifest";
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_line(char *line, uint8_t *sha256, uint32_t *size, char **name) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (strlen(line) < ASSET_MANIFEST_SHA256_LEN * 2 + 4 || line[ASSET_MANIFEST_SHA256_LEN * 2] != ' ') {
+        return false;
+    }
+    for (int i = 0; i < ASSET_MANIFEST_SHA256_LEN; i++) {
+        int high = hex_value(line[2 * i]);
+        int low = hex_value(line[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        sha256[i] = (uint8_t)((high << 4) | low);
+    }
+
+    char *end;
+    unsigned long value = strtoul(line + ASSET_MANIFEST_SHA256_LEN * 2 + 1, &end, 10);
+    if (*end != ' ' || end[1] == '\0') {
+        return false;
+    }
+    *size = (uint32_t)value;
+    *name = end + 1;
+    return true;
+}
+
+asset_manifest_t *asset_manifest_load(const char *path) {
+    asset_manifest_t *manifest = calloc(1, sizeof(asset_manifest_t));
+    if (!manifest) {
+        return NULL;
+    }
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        ESP_LOGI(TAG, "No asset manifest at %s, every file will be written", path);
+        return manifest;
+    }
+
+    char line[LINE_MAX_SIZE];
+    while (fgets(line, sizeof(line), file)) {
+        uint8_t sha256[ASSET_MANIFEST_SHA256_LEN];
+        uint32_t size;
+        char *name;
+        if (!parse_line(line, sha256, &size, &name)) {
+            ESP_LOGW(TAG, "Ignoring malformed manifest line");
+            continue;
+        }
+        asset_manifest_entry_t *entry = asset_manifest_get(manifest, name);
+        if (!entry) {
+            break;
+        }
+        asset_manifest_set(entry, sha256, size);
+    }
+    fclose(file);
+
+    ESP_LOGI(TAG, "Loaded %u asset hashes", (unsigned)manifest->count);
+    return manifest;
+}
+
+// FNV-1a of the name; the web server looks names up on every request
+static size_t name_bucket(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)name; *c; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash % ASSET_MANIFEST_BUCKETS;
+}
+
+asset_manifest_entry_t *asset_manifest_find(asset_manifest_t *manifest, const char *name) {
+    for (asset_manifest_entry_t *entry = manifest->buckets[name_bucket(name)]; entry; entry = entry->bucket_next) {
+        if (strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+asset_manifest_entry_t *asset_manifest_get(asset_manifest_t *manifest, const char *name) {
+    asset_manifest_entry_t *entry = asset_manifest_find(manifest, name);
+    if (entry) {
+        return entry;
+    }
+
+    size_t name_len = strlen(name);
+    entry = calloc(1, sizeof(asset_manifest_entry_t) + name_len + 1);
+    if (!entry) {
+        ESP_LOGE(TAG, "Out of memory for manifest entry");
+        return NULL;
+    }
+    memcpy(entry->name, name, name_len + 1);
+    size_t bucket = name_bucket(name);
+    entry->bucket_next = manifest->buckets[bucket];
+    entry->next = manifest->entries;
+    manifest->buckets[bucket] = entry;
+    manifest->entries = entry;
+    manifest->count++;
+    return entry;
+}
+
+bool asset_manifest_unchanged(asset_manifest_t *manifest, const char *name, const char *full_path,
+                              const uint8_t *sha256, uint32_t size) {
+    asset_manifest_entry_t *entry = asset_manifest_find(manifest, name);
+    if (!entry || !entry->valid || entry->size != size ||
+        memcmp(entry->sha256, sha256, ASSET_MANIFEST_SHA256_LEN) != 0) {
+        return false;
+    }
+
+    struct stat st;
+    return stat(full_path, &st) == 0 && st.st_size == (off_t)size;
+}
+
+void asset_manifest_set(asset_manifest_entry_t *entry, const uint8_t *sha256, uint32_t size) {
+    memcpy(entry->sha256, sha256, ASSET_MANIFEST_SHA256_LEN);
+    entry->size = size;
+    entry->valid = true;
+}
+
+esp_err_t asset_manifest_save(const asset_manifest_t *manifest, const char *path) {
+    char temp_path[64];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE *file = fopen(temp_path, "w");
+    if (!file) {
+        ESP_LOGE(TAG, "Failed to open %s", temp_path);
+        return ESP_FAIL;
+    }
+
+    bool ok = true;
+    for (const asset_manifest_entry_t *entry = manifest->entries; entry && ok; entry = entry->next) {
+        if (!entry->valid) {
+            continue;
+        }
+        for (int i = 0; i < ASSET_MANIFEST_SHA256_LEN && ok; i++) {
+            ok = fprintf(file, "%02x", entry->sha256[i]) == 2;
+        }
+        ok = ok && fprintf(file, " %" PRIu32 " %s\n", entry->size, entry->name) > 0;
+    }
+
+    if (fclose(file) != 0 || !ok || rename(temp_path, path) != 0) {
+        ESP_LOGE(TAG, "Failed to write asset manifest");
+        remove(temp_path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void asset_manifest_destroy(asset_manifest_t *manifest) {
+    if (!manifest) {
+        return;
+    }
+    asset_manifest_entry_t *entry = manifest->entries;
+    while (entry) {
+        asset_manifest_entry_t *next = entry->next;
+        free(entry);
+        entry = next;
+    }
+    free(manifest);
+}
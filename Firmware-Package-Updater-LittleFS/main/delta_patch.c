@@ -0,0 +1,133 @@
+#include "delta_patch.h"
+
+#include <esp_log.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#define COPY_BUFFER_SIZE 4096
+#define OP_MAX_SIZE 9   // Opcode + two uint32_t
+
+static const char* TAG = "DeltaPatch";
+
+struct delta_patch {
+    const esp_partition_t *source;
+    uint8_t op[OP_MAX_SIZE];        // Operation header collected so far
+    size_t op_len;
+    uint32_t literal_remaining;     // Literal bytes of the current DATA operation still to come
+    uint8_t *copy_buffer;
+    size_t copied;
+    size_t literal;
+};
+
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t op_size(uint8_t opcode) {
+    switch (opcode) {
+        case DELTA_OP_COPY: return 9;
+        case DELTA_OP_DATA: return 5;
+        default:            return 0;
+    }
+}
+
+delta_patch_t *delta_patch_create(const esp_partition_t *source) {
+    delta_patch_t *patch = calloc(1, sizeof(delta_patch_t));
+    if (!patch) {
+        return NULL;
+    }
+    patch->copy_buffer = malloc(COPY_BUFFER_SIZE);
+    if (!patch->copy_buffer) {
+        free(patch);
+        return NULL;
+    }
+    patch->source = source;
+    return patch;
+}
+
+static esp_err_t apply_copy(delta_patch_t *patch, uint32_t offset, uint32_t length,
+                            delta_patch_output_fn output, void *ctx) {
+    if ((uint64_t)offset + length > patch->source->size) {
+        ESP_LOGE(TAG, "COPY 0x%" PRIx32 "+%" PRIu32 " outside source partition", offset, length);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    while (length > 0) {
+        size_t chunk = length < COPY_BUFFER_SIZE ? length : COPY_BUFFER_SIZE;
+        esp_err_t err = esp_partition_read(patch->source, offset, patch->copy_buffer, chunk);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Source read at 0x%" PRIx32 " failed (%s)", offset, esp_err_to_name(err));
+            return err;
+        }
+        err = output(ctx, patch->copy_buffer, chunk);
+        if (err != ESP_OK) {
+            return err;
+        }
+        offset += chunk;
+        length -= chunk;
+        patch->copied += chunk;
+    }
+    return ESP_OK;
+}
+
+esp_err_t delta_patch_feed(delta_patch_t *patch, const uint8_t *data, size_t len,
+                           delta_patch_output_fn output, void *ctx) {
+    while (len > 0) {
+        // Literal bytes pass straight through
+        if (patch->literal_remaining > 0) {
+            size_t chunk = len < patch->literal_remaining ? len : patch->literal_remaining;
+            esp_err_t err = output(ctx, data, chunk);
+            if (err != ESP_OK) {
+                return err;
+            }
+            data += chunk;
+            len -= chunk;
+            patch->literal_remaining -= chunk;
+            patch->literal += chunk;
+            continue;
+        }
+
+        // Collect the next operation header, which may straddle feed calls
+        patch->op[patch->op_len++] = *data++;
+        len--;
+        size_t needed = op_size(patch->op[0]);
+        if (needed == 0) {
+            ESP_LOGE(TAG, "Unknown patch operation 0x%02x", patch->op[0]);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (patch->op_len < needed) {
+            continue;
+        }
+        patch->op_len = 0;
+
+        if (patch->op[0] == DELTA_OP_COPY) {
+            esp_err_t err = apply_copy(patch, read_le32(patch->op + 1), read_le32(patch->op + 5), output, ctx);
+            if (err != ESP_OK) {
+                return err;
+            }
+        } else {
+            patch->literal_remaining = read_le32(patch->op + 1);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t delta_patch_finish(delta_patch_t *patch) {
+    if (patch->op_len != 0 || patch->literal_remaining != 0) {
+        ESP_LOGE(TAG, "Patch ended mid-operation");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+void delta_patch_stats(const delta_patch_t *patch, size_t *copied, size_t *literal) {
+    *copied = patch->copied;
+    *literal = patch->literal;
+}
+
+void delta_patch_destroy(delta_patch_t *patch) {
+    if (patch) {
+        free(patch->copy_buffer);
+        free(patch);
+    }
+}
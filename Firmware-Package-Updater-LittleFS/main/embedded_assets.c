@@ -0,0 +1,21 @@
+#include "embedded_assets.h"
+
+#include <string.h>
+
+const embedded_asset_t *embedded_asset_find(const char *uri) {
+    size_t low = 0;
+    size_t high = embedded_asset_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(uri, embedded_assets[mid].uri);
+        if (cmp == 0) {
+            return &embedded_assets[mid];
+        }
+        if (cmp < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return NULL;
+}
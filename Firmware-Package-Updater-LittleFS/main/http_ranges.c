@@ -0,0 +1,86 @@
+#include "http_ranges.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *skip_spaces(const char *s) {
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    return s;
+}
+
+// Reads the digits at `*s`; false if there are none or the value does not fit 32 bits
+static bool parse_position(const char **s, uint32_t *value) {
+    if (!isdigit((unsigned char)**s)) {
+        return false;
+    }
+    char *end;
+    unsigned long long parsed = strtoull(*s, &end, 10);
+    if (parsed > UINT32_MAX) {
+        return false;
+    }
+    *value = (uint32_t)parsed;
+    *s = end;
+    return true;
+}
+
+int http_ranges_parse(const char *value, uint32_t size, http_range_t *ranges, size_t max_ranges) {
+    const char *s = skip_spaces(value);
+    if (strncasecmp(s, "bytes=", 6) != 0) {
+        return 0;
+    }
+    s += 6;
+
+    size_t count = 0;
+    bool any = false;                   // A syntactically valid range was seen, satisfiable or not
+    while (true) {
+        s = skip_spaces(s);
+        uint32_t first = 0;
+        uint32_t last = UINT32_MAX;
+        bool suffix = (*s == '-');
+        if (suffix) {
+            s++;
+            if (!parse_position(&s, &last)) {
+                return 0;
+            }
+        } else {
+            if (!parse_position(&s, &first) || *s++ != '-') {
+                return 0;
+            }
+            if (isdigit((unsigned char)*s) && (!parse_position(&s, &last) || last < first)) {
+                return 0;
+            }
+        }
+        any = true;
+
+        // "-N" is the last N bytes; "N-" runs to the end
+        bool satisfiable;
+        if (suffix) {
+            satisfiable = (last > 0 && size > 0);
+            first = (last < size) ? size - last : 0;
+            last = size - 1;
+        } else {
+            satisfiable = (first < size);
+            last = (last < size) ? last : size - 1;
+        }
+        if (satisfiable) {
+            if (count == max_ranges) {
+                return 0;               // More than we serve: send everything instead
+            }
+            ranges[count++] = (http_range_t){ .start = first, .end = last };
+        }
+
+        s = skip_spaces(s);
+        if (*s == '\0') {
+            break;
+        }
+        if (*s++ != ',') {
+            return 0;
+        }
+    }
+    return count > 0 ? (int)count : (any ? -1 : 0);
+}
@@ -0,0 +1,89 @@
+#include "inflate_stream.h"
+
+#include <esp_heap_caps.h>
+#include <stdlib.h>
+#include "miniz.h"
+
+struct inflate_stream {
+    tinfl_decompressor decompressor;
+    uint8_t *dict;          // TINFL_LZ_DICT_SIZE wrapping window, also used as output buffer
+    size_t dict_offset;
+    size_t total_out;
+    tinfl_status status;
+};
+
+inflate_stream_t *inflate_stream_create(void) {
+    inflate_stream_t *stream = calloc(1, sizeof(inflate_stream_t));
+    if (!stream) {
+        return NULL;
+    }
+    stream->dict = heap_caps_malloc(TINFL_LZ_DICT_SIZE, MALLOC_CAP_8BIT);
+    if (!stream->dict) {
+        free(stream);
+        return NULL;
+    }
+    inflate_stream_reset(stream);
+    return stream;
+}
+
+void inflate_stream_reset(inflate_stream_t *stream) {
+    tinfl_init(&stream->decompressor);
+    stream->dict_offset = 0;
+    stream->total_out = 0;
+    stream->status = TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+esp_err_t inflate_stream_feed(inflate_stream_t *stream, const void *data, size_t len,
+                              inflate_stream_output_fn output, void *ctx) {
+    const uint8_t *in = data;
+
+    if (stream->status == TINFL_STATUS_DONE) {
+        return len ? ESP_ERR_INVALID_SIZE : ESP_OK;
+    }
+
+    while (1) {
+        size_t in_size = len;
+        size_t out_size = TINFL_LZ_DICT_SIZE - stream->dict_offset;
+        tinfl_status status = tinfl_decompress(&stream->decompressor, in, &in_size,
+                                               stream->dict, stream->dict + stream->dict_offset, &out_size,
+                                               TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_COMPUTE_ADLER32);
+        in += in_size;
+        len -= in_size;
+        stream->status = status;
+
+        if (out_size > 0) {
+            esp_err_t err = output(ctx, stream->dict + stream->dict_offset, out_size);
+            if (err != ESP_OK) {
+                return err;
+            }
+            stream->total_out += out_size;
+            stream->dict_offset = (stream->dict_offset + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            return len ? ESP_ERR_INVALID_SIZE : ESP_OK;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) {
+            return ESP_OK;
+        }
+        // TINFL_STATUS_HAS_MORE_OUTPUT: the window wrapped, keep draining
+    }
+}
+
+esp_err_t inflate_stream_finish(inflate_stream_t *stream) {
+    return stream->status == TINFL_STATUS_DONE ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+size_t inflate_stream_total_out(const inflate_stream_t *stream) {
+    return stream->total_out;
+}
+
+void inflate_stream_destroy(inflate_stream_t *stream) {
+    if (stream) {
+        heap_caps_free(stream->dict);
+        free(stream);
+    }
+}
@@ -4,6 +4,9 @@
 #include "freertos/task.h"
 #include "project_settings.h"
 #include "web_server.h"
+#include "web_bank.h"
+#include "update_restart.h"
+#include "package_update.h"
 #include "driver/gpio.h"
 #include <esp_log.h>
 #include <esp_littlefs.h>
@@ -24,30 +27,18 @@ void print_build_info() {
     printf("%.*s\n", (int)(build_info_end - build_info_start), build_info_start);
 }
 
-// Initialize LittleFS File System
+// Initialize LittleFS File System (the web bank paired with the running app slot)
 static void init_littlefs(void) {
-    esp_vfs_littlefs_conf_t conf = {
-        .base_path = "/web",
-        .partition_label = "web",
-        .partition = NULL, // Explicitly set to avoid warnings
-        .format_if_mount_failed = true,
-        .read_only = false,
-        .dont_mount = false,
-        .grow_on_mount = false,
-    };
-
-    esp_err_t ret = esp_vfs_littlefs_register(&conf);
+    esp_err_t ret = web_bank_mount_active();
     if (ret != ESP_OK) {
         ESP_LOGE("LittleFS", "Failed to initialize LittleFS (%s)", esp_err_to_name(ret));
-        return;
     }
-
-    size_t total, used;
-    esp_littlefs_info(conf.partition_label, &total, &used);
-    ESP_LOGI("LittleFS", "Partition size: total: %" PRIu32 ", used: %" PRIu32, (uint32_t)total, (uint32_t)used);
 }
 
 void app_main(void) {
+    // Time-to-reboot of the update restart that led here, if any
+    update_restart_init();
+
     // Print build info during boot
     print_build_info();
 
@@ -68,6 +59,7 @@ void app_main(void) {
 
     // Initialize OTA update system
     init_ota();
+    ota_set_prepare_slot_hook(package_update_prepare_slot);   // URL updates keep the web UI, like packages
 
     // Start the web server
     start_webserver();
@@ -0,0 +1,74 @@
+#include "mime_types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#define SLOT_COUNT MIME_TYPE_SLOT_COUNT
+#define DEFAULT_MIME_TYPE "application/octet-stream"
+
+// Index + 1 into mime_type_table, 0 for an empty slot. Built on first use from the HTTP server task,
+// the only caller, and read-only after that.
+static uint8_t slots[SLOT_COUNT];
+static bool slots_built;
+
+// FNV-1a of the lowercased extension
+static uint32_t extension_hash(const char *extension, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)tolower((unsigned char)extension[i])) * 16777619u;
+    }
+    return hash;
+}
+
+static void build_slots(void) {
+    for (size_t i = 0; i < mime_type_count; i++) {
+        uint32_t slot = extension_hash(mime_type_table[i].extension, strlen(mime_type_table[i].extension)) & (SLOT_COUNT - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (SLOT_COUNT - 1);
+        }
+        slots[slot] = (uint8_t)(i + 1);
+    }
+    slots_built = true;
+}
+
+const char *mime_type_for_path(const char *path) {
+    if (!slots_built) {
+        build_slots();
+    }
+
+    size_t len = strlen(path);
+    if (len > 3 && strcmp(path + len - 3, ".gz") == 0) {
+        len -= 3;
+    }
+    size_t dot = len;
+    while (dot > 0 && path[dot - 1] != '.' && path[dot - 1] != '/') {
+        dot--;
+    }
+    if (dot == 0 || path[dot - 1] != '.') {
+        return DEFAULT_MIME_TYPE;
+    }
+    // As os.path.splitext(): leading dots of the name (".htaccess") do not start an extension
+    size_t name = dot - 1;
+    while (name > 0 && path[name - 1] == '.') {
+        name--;
+    }
+    if (name == 0 || path[name - 1] == '/') {
+        return DEFAULT_MIME_TYPE;
+    }
+
+    const char *extension = path + dot;
+    size_t extension_len = len - dot;
+    uint32_t slot = extension_hash(extension, extension_len) & (SLOT_COUNT - 1);
+    while (slots[slot] != 0) {
+        const mime_type_entry_t *entry = &mime_type_table[slots[slot] - 1];
+        if (strlen(entry->extension) == extension_len && strncasecmp(entry->extension, extension, extension_len) == 0) {
+            return entry->mime_type;
+        }
+        slot = (slot + 1) & (SLOT_COUNT - 1);
+    }
+    return DEFAULT_MIME_TYPE;
+}
@@ -0,0 +1,1226 @@
+#include "project_settings.h"
+#include "package_update.h"
+#include "update_pipeline.h"
+#include "update_telemetry.h"
+#include "ota_writer.h"
+#include "inflate_stream.h"
+#include "delta_patch.h"
+#include "asset_manifest.h"
+#include "web_bank.h"
+#include "asset_bundle.h"
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_app_desc.h>
+#include <esp_timer.h>
+#include <nvs_flash.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <mbedtls/sha256.h>
+
+static const char* TAG = "PackageUpdate";
+
+#define ASSET_MANIFEST_PATH WEB_BANK_MOUNT_POINT "/.asset_manifest"  // Content hashes of the files on the web partition
+#define NEXT_ASSET_MANIFEST_PATH WEB_BANK_NEXT_MOUNT_POINT "/.asset_manifest"
+#define RESUME_ASSET_MANIFEST_PATH WEB_BANK_NEXT_MOUNT_POINT "/.asset_manifest.resume"  // Manifest as of the last checkpoint
+
+// Get MIN Utility Function
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+#define SHA256_LEN PKG_SHA256_LEN
+#define GZIP_VARIANT_SUFFIX ".gz"       // Precompressed copy of a web asset, served to clients that accept gzip
+#ifndef WRITE_BLOCK_SIZE // The host benchmark (host/) builds one binary per block size
+#define WRITE_BLOCK_SIZE 8192 // Size of each update pipeline buffer. LittleFS Default: 4096 | LittleFS Default: 8192
+#endif
+
+// Incremental SHA-256 state for v2 packages. Sections are hashed as they are received;
+// files are hashed after decompression on the writer task.
+typedef struct {
+    bool enabled;
+    mbedtls_sha256_context section;     // Current section (firmware or LittleFS)
+    int64_t hash_us;                    // Time spent hashing sections, for the throughput report
+    uint64_t hashed_bytes;
+    int64_t file_hash_us;               // Time spent hashing files (writer task, read after a flush)
+    uint64_t file_hashed_bytes;
+} package_digest_t;
+
+// A LittleFS file being written to a temporary name until its data is complete and verified
+typedef struct {
+    FILE *file;
+    uint32_t size;                      // Decompressed bytes announced in the package
+    uint32_t written;                   // Bytes written by the writer task
+    inflate_stream_t *inflater;         // Set when the file's data is compressed
+    bool verify;                        // Set when the package carries a digest for the file
+    mbedtls_sha256_context sha;
+    uint8_t expected_sha256[SHA256_LEN];
+    package_digest_t *digest;           // Hash timing totals
+    asset_manifest_entry_t *manifest_entry; // Receives the file's digest once it has been committed
+    char path[WEB_BANK_PATH_MAX_SIZE];
+    char temp_path[WEB_BANK_PATH_MAX_SIZE + sizeof(".tmp") - 1];
+} pending_file_t;
+
+// Section decoding chain (writer task): [inflate] -> [delta patch] -> partition writer or RAM stage
+typedef struct {
+    inflate_stream_t *inflater;         // Set when the section is compressed
+    delta_patch_t *patch;               // Set when the firmware is a delta against the running app
+    ota_writer_t *writer;
+    uint8_t *stage;                     // Set when the section is collected in RAM until its digest is checked
+    size_t stage_size;
+    size_t staged;
+} image_sink_t;
+
+
+// One package update in progress
+typedef struct {
+    const package_update_config_t *config;
+    package_update_result_t *result;
+    pkg_parser_t parser;
+    update_pipeline_t *pipeline;
+    package_digest_t digest;
+    inflate_stream_t *inflater;         // One decoder serves every compressed stream, in writer task order
+    delta_patch_t *patch;
+    asset_manifest_t *manifest;         // Content hashes of the next web bank (file packages only)
+    pkg_header_t header;
+    uint32_t section;                   // Index of the section being received
+    const esp_partition_t *update_partition;
+    ota_writer_t writer;                // Target of the stream section being received (app, web bank or data partition)
+    image_sink_t sink;
+    update_pipeline_write_fn stream_job;    // How stream section data reaches the writer task
+    void *stream_ctx;
+    pending_file_t *pending;            // File whose data is being received
+    bool ota_started;                   // The writer holds the OTA slot and needs an abort if the update fails
+    bool firmware_checkpoints;          // Raw firmware into an erase-ahead slot: checkpoints inside the section
+    bool checkpoint_due;                // Checkpoint to take once the current slice has been parsed
+    bool transport_failed;              // The package source stopped delivering data
+    char *rx;                           // Pool buffer holding the slice being parsed
+    size_t rx_len;
+    uint32_t offset;                    // Package bytes consumed so far
+    uint32_t checkpoint_offset;         // Package offset of the last checkpoint
+} package_update_t;
+
+
+// Records why the update failed; `message` is NULL when the transport itself failed
+static esp_err_t update_failed(package_update_t *u, httpd_err_code_t status, const char *message) {
+    if (!u->result->message && !u->transport_failed) {
+        u->result->status = status;
+        u->result->message = message;
+        update_telemetry_fail(ESP_FAIL, message);
+    }
+    return ESP_FAIL;
+}
+
+static int64_t package_remaining(const package_update_t *u) {
+    return (int64_t)u->config->size - u->offset;
+}
+
+static void digest_update(package_digest_t *digest, const void *data, size_t len) {
+    if (!digest->enabled) {
+        return;
+    }
+    int64_t start = esp_timer_get_time();
+    mbedtls_sha256_update(&digest->section, data, len);
+    digest->hash_us += esp_timer_get_time() - start;
+    digest->hashed_bytes += len;
+}
+
+// Finishes `ctx` and compares it with the expected digest from the package
+static bool digest_matches(package_digest_t *digest, mbedtls_sha256_context *ctx, const uint8_t *expected) {
+    uint8_t actual[SHA256_LEN];
+    int64_t start = esp_timer_get_time();
+    mbedtls_sha256_finish(ctx, actual);
+    mbedtls_sha256_free(ctx);
+    digest->hash_us += esp_timer_get_time() - start;
+    return memcmp(actual, expected, SHA256_LEN) == 0;
+}
+
+static void digest_start(mbedtls_sha256_context *ctx) {
+    mbedtls_sha256_init(ctx);
+    mbedtls_sha256_starts(ctx, 0);
+}
+
+static void digest_free(package_digest_t *digest) {
+    if (digest->enabled) {
+        mbedtls_sha256_free(&digest->section);
+    }
+}
+
+
+// Receive exactly `len` bytes, looping over short reads from the package source
+static esp_err_t package_recv(package_update_t *u, char *buffer, size_t len) {
+    size_t received = 0;
+    while (received < len) {
+        int64_t start = esp_timer_get_time();
+        int recv_len = u->config->recv(u->config->recv_ctx, buffer + received, len - received);
+        if (recv_len <= 0) {
+            ESP_LOGE(TAG, "Package receive failed (%d)", recv_len);
+            u->transport_failed = true;
+            update_telemetry_fail(ESP_FAIL, "Package receive failed");
+            return ESP_FAIL;
+        }
+        update_telemetry_received(recv_len, esp_timer_get_time() - start);
+        received += recv_len;
+    }
+    u->offset += len;
+    return ESP_OK;
+}
+
+// Pipeline write jobs (run on the flash writer task)
+static esp_err_t ota_write_job(void *ctx, const char *data, size_t len) {
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = ota_writer_write((ota_writer_t *)ctx, data, len);
+    update_telemetry_flashed(len, esp_timer_get_time() - start);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Write to %s failed (%s)", ((ota_writer_t *)ctx)->partition->label, esp_err_to_name(err));
+    }
+    return err;
+}
+
+static esp_err_t image_write_output(void *ctx, const uint8_t *data, size_t len) {
+    image_sink_t *sink = ctx;
+    if (sink->stage) {
+        if (len > sink->stage_size - sink->staged) {
+            ESP_LOGE(TAG, "Section larger than announced (%u bytes)", (unsigned)sink->stage_size);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(sink->stage + sink->staged, data, len);
+        sink->staged += len;
+        return ESP_OK;
+    }
+    return ota_write_job(sink->writer, (const char *)data, len);
+}
+
+// Decompressed (or raw) section bytes: rebuild the image if they are a patch
+static esp_err_t image_patch_output(void *ctx, const uint8_t *data, size_t len) {
+    image_sink_t *sink = ctx;
+    if (!sink->patch) {
+        return image_write_output(sink, data, len);
+    }
+    esp_err_t err = delta_patch_feed(sink->patch, data, len, image_write_output, sink);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Firmware patch failed (%s)", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static esp_err_t image_decode_job(void *ctx, const char *data, size_t len) {
+    image_sink_t *sink = ctx;
+    if (!sink->inflater) {
+        return image_patch_output(sink, (const uint8_t *)data, len);
+    }
+    esp_err_t err = inflate_stream_feed(sink->inflater, data, len, image_patch_output, sink);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Decompression failed (%s)", esp_err_to_name(err));
+    }
+    return err;
+}
+
+// Both decoders must have ended on a stream boundary once the whole section has been written
+static esp_err_t image_decode_finish(image_sink_t *sink) {
+    if (sink->inflater && inflate_stream_finish(sink->inflater) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (sink->patch) {
+        if (delta_patch_finish(sink->patch) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        size_t copied, literal;
+        delta_patch_stats(sink->patch, &copied, &literal);
+        ESP_LOGI(TAG, "Firmware patched: %u bytes copied from the running app, %u bytes literal",
+                 (unsigned)copied, (unsigned)literal);
+    }
+    return ESP_OK;
+}
+
+// Checks up front that a delta package was built against the firmware that is running now
+static bool delta_base_matches(const pkg_section_t *section) {
+    const esp_app_desc_t *running = esp_app_get_description();
+    return memcmp(running->app_elf_sha256, section->base_sha256, SHA256_LEN) == 0;
+}
+
+// Writer task idle hook: erase the OTA slot ahead of the write cursor while waiting for data
+static bool ota_erase_idle(void *ctx) {
+    return ota_writer_erase_step((ota_writer_t *)ctx);
+}
+
+static esp_err_t file_output(void *ctx, const uint8_t *data, size_t len) {
+    pending_file_t *pending = ctx;
+    if (pending->written + len > pending->size) {
+        ESP_LOGE(TAG, "LittleFS file larger than announced: %s", pending->path);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (pending->verify) {
+        int64_t start = esp_timer_get_time();
+        mbedtls_sha256_update(&pending->sha, data, len);
+        pending->digest->file_hash_us += esp_timer_get_time() - start;
+        pending->digest->file_hashed_bytes += len;
+    }
+    int64_t start = esp_timer_get_time();
+    size_t written = fwrite(data, 1, len, pending->file);
+    update_telemetry_flashed(written, esp_timer_get_time() - start);
+    if (written != len) {
+        ESP_LOGE(TAG, "LittleFS file write failed: %s", pending->path);
+        return ESP_FAIL;
+    }
+    pending->written += len;
+    return ESP_OK;
+}
+
+static esp_err_t file_write_job(void *ctx, const char *data, size_t len) {
+    pending_file_t *pending = ctx;
+    if (pending->inflater) {
+        esp_err_t err = inflate_stream_feed(pending->inflater, data, len, file_output, pending);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Decompression failed: %s (%s)", pending->path, esp_err_to_name(err));
+        }
+        return err;
+    }
+    return file_output(pending, (const uint8_t *)data, len);
+}
+
+// Starts a new zlib stream in order with the jobs around it
+static esp_err_t file_inflate_begin_job(void *ctx, const char *data, size_t len) {
+    inflate_stream_reset((inflate_stream_t *)ctx);
+    return ESP_OK;
+}
+
+// Releases a pending file's state once its commit or discard job has run
+static void pending_file_free(pending_file_t *pending) {
+    mbedtls_sha256_free(&pending->sha);
+    free(pending);
+}
+
+// Writer-side checks for a file whose data has all been queued: stream end, size and digest
+static bool pending_file_complete(pending_file_t *pending) {
+    if (pending->inflater && inflate_stream_finish(pending->inflater) != ESP_OK) {
+        ESP_LOGE(TAG, "Truncated compressed data: %s", pending->path);
+        return false;
+    }
+    if (pending->written != pending->size) {
+        ESP_LOGE(TAG, "Incomplete LittleFS file: %s (%" PRIu32 " of %" PRIu32 " bytes)",
+                 pending->path, pending->written, pending->size);
+        return false;
+    }
+    if (pending->verify) {
+        uint8_t actual[SHA256_LEN];
+        mbedtls_sha256_finish(&pending->sha, actual);
+        if (memcmp(actual, pending->expected_sha256, SHA256_LEN) != 0) {
+            ESP_LOGE(TAG, "SHA-256 mismatch: %s", pending->path);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Closes the temporary file and moves it over the live file, if all of its data made it to flash
+static esp_err_t file_commit_job(void *ctx, const char *data, size_t len) {
+    pending_file_t *pending = ctx;
+    esp_err_t err = ESP_OK;
+
+    bool complete = pending_file_complete(pending);
+    if (fclose(pending->file) != 0 || !complete) {
+        remove(pending->temp_path);
+        err = ESP_FAIL;
+    } else if (rename(pending->temp_path, pending->path) != 0) {
+        ESP_LOGE(TAG, "Failed to replace %s", pending->path);
+        remove(pending->temp_path);
+        err = ESP_FAIL;
+    } else {
+        ESP_LOGD(TAG, "Successfully wrote file: %s (%" PRIu32 " bytes)", pending->path, pending->written);
+        update_telemetry_file_done(false);
+        if (pending->manifest_entry && pending->verify) {
+            asset_manifest_set(pending->manifest_entry, pending->expected_sha256, pending->written);
+        }
+    }
+
+    pending_file_free(pending);
+    return err;
+}
+
+// Drops a temporary file that failed to arrive or verify; the live file is left untouched
+static esp_err_t file_discard_job(void *ctx, const char *data, size_t len) {
+    pending_file_t *pending = ctx;
+    fclose(pending->file);
+    remove(pending->temp_path);
+    pending_file_free(pending);
+    return ESP_OK;
+}
+
+
+// Hands section data to the writer task. Slices that fill the receive buffer are queued as they
+// are (no copy); anything shorter is copied into a buffer of its own first.
+static esp_err_t queue_data(package_update_t *u, update_pipeline_write_fn write_fn, void *ctx,
+                            const uint8_t *data, size_t len) {
+    char *buffer;
+    if ((const char *)data == u->rx && len == u->rx_len) {
+        buffer = u->rx;
+        u->rx = NULL;
+    } else {
+        buffer = update_pipeline_acquire(u->pipeline);
+        memcpy(buffer, data, len);
+    }
+    // The buffer now belongs to the pipeline; the write itself happens on the writer task
+    return update_pipeline_submit(u->pipeline, write_fn, ctx, buffer, len);
+}
+
+// Drains the writer task and hands the position reached to the checkpoint callback. Everything
+// before `u->offset` is on flash afterwards, and the section digest is copied as it stands.
+static esp_err_t take_checkpoint(package_update_t *u, uint32_t section_written) {
+    // A checkpoint at the very end would only resume into an empty package
+    if (!u->config->checkpoint || package_remaining(u) <= 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = update_pipeline_flush(u->pipeline);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (u->manifest && asset_manifest_save(u->manifest, RESUME_ASSET_MANIFEST_PATH) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    package_checkpoint_t *checkpoint = calloc(1, sizeof(package_checkpoint_t));
+    if (!checkpoint) {
+        return ESP_ERR_NO_MEM;
+    }
+    checkpoint->layout = PACKAGE_CHECKPOINT_LAYOUT;
+    checkpoint->offset = u->offset;
+    checkpoint->section = u->section;
+    checkpoint->section_written = section_written;
+    checkpoint->update_partition_address = u->update_partition->address;
+    checkpoint->files_skipped = u->result->files_skipped;
+    checkpoint->bytes_skipped = u->result->bytes_skipped;
+    checkpoint->header = u->header;
+    mbedtls_sha256_init(&checkpoint->section_sha);
+    if (u->digest.enabled) {
+        mbedtls_sha256_clone(&checkpoint->section_sha, &u->digest.section);
+    }
+
+    err = u->config->checkpoint(u->config->checkpoint_ctx, checkpoint);
+    mbedtls_sha256_free(&checkpoint->section_sha);
+    free(checkpoint);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save checkpoint (%s)", esp_err_to_name(err));
+        return err;
+    }
+    u->checkpoint_offset = u->offset;
+    ESP_LOGD(TAG, "Checkpoint at package offset %" PRIu32, u->offset);
+    return ESP_OK;
+}
+
+// Checkpoints are only taken between two slices, at positions the parser can resume from
+static esp_err_t checkpoint_if_due(package_update_t *u) {
+    // At the start of every section
+    if (u->checkpoint_due) {
+        u->checkpoint_due = false;
+        return take_checkpoint(u, 0);
+    }
+
+    // Raw firmware: every UPDATE_CHECKPOINT_INTERVAL bytes (the receive loop stops on those boundaries)
+    if (u->firmware_checkpoints && pkg_parser_state(&u->parser) == PKG_STATE_STREAM) {
+        uint32_t written = u->offset - u->header.sections[u->section].offset;
+        if (written % UPDATE_CHECKPOINT_INTERVAL == 0 && u->offset != u->checkpoint_offset) {
+            return take_checkpoint(u, written);
+        }
+        return ESP_OK;
+    }
+
+    // Files: at the next record boundary once enough has been written since the last one
+    if (u->manifest && pkg_parser_at_record_start(&u->parser) &&
+        u->offset - u->checkpoint_offset >= UPDATE_CHECKPOINT_INTERVAL) {
+        return take_checkpoint(u, 0);
+    }
+    return ESP_OK;
+}
+
+// Partitions a PARTITION section may not overwrite: the update's own targets and what the running firmware relies on
+static bool partition_writable(const package_update_t *u, const esp_partition_t *partition) {
+    return partition->type == ESP_PARTITION_TYPE_DATA &&
+           partition->subtype != ESP_PARTITION_SUBTYPE_DATA_OTA &&
+           strcmp(partition->label, NVS_DEFAULT_PART_NAME) != 0 &&       // Holds the update session checkpoint
+           partition != web_bank_partition(esp_ota_get_running_partition()) &&
+           partition != web_bank_partition(u->update_partition) &&
+           partition != asset_bundle_partition(esp_ota_get_running_partition()) &&    // Mapped and being served
+           partition != asset_bundle_partition(u->update_partition);
+}
+
+// Checks the section table up front, so a package this firmware cannot apply is refused before anything is erased
+static esp_err_t check_sections(package_update_t *u) {
+    const pkg_header_t *pkg_header = &u->header;
+    uint32_t apps = 0;
+    uint32_t web = 0;
+    uint32_t bundles = 0;
+    uint32_t partitions = 0;
+
+    for (uint32_t i = 0; i < pkg_header->section_count; i++) {
+        const pkg_section_t *section = &pkg_header->sections[i];
+        ESP_LOGI(TAG, "  Section %" PRIu32 ": type %" PRIu32 "%s%s, %" PRIu32 " bytes%s%s", i, section->type,
+                 section->label[0] ? " -> " : "", section->label, section->length,
+                 (section->encoding & PKG_ENCODING_DEFLATE) ? ", compressed" : "",
+                 (section->encoding & PKG_ENCODING_DELTA) ? ", delta" : "");
+
+        if (section->type > PKG_SECTION_ASSET_BUNDLE || (section->encoding & ~(PKG_ENCODING_DEFLATE | PKG_ENCODING_DELTA)) ||
+            ((section->encoding & PKG_ENCODING_DELTA) && section->type != PKG_SECTION_APP)) {
+            ESP_LOGE(TAG, "Section %" PRIu32 " has an unsupported type or encoding", i);
+            return update_failed(u, HTTPD_400_BAD_REQUEST, "Unsupported package section");
+        }
+
+        // A delta only makes sense against the exact image it was built from
+        if ((section->encoding & PKG_ENCODING_DELTA) && !delta_base_matches(section)) {
+            ESP_LOGE(TAG, "Delta package was built for a different firmware than the one running");
+            return update_failed(u, HTTPD_400_BAD_REQUEST, "Delta base mismatch");
+        }
+
+        // Data partitions are rewritten in place, so every section that can still fail goes first
+        if (partitions > 0 && section->type != PKG_SECTION_PARTITION) {
+            ESP_LOGE(TAG, "Section %" PRIu32 " follows a data partition section", i);
+            return update_failed(u, HTTPD_400_BAD_REQUEST, "Data partition sections must come last");
+        }
+
+        if (section->type == PKG_SECTION_APP) {
+            apps++;
+        } else if (section->type == PKG_SECTION_FILES || section->type == PKG_SECTION_WEB_IMAGE) {
+            web++;
+        } else if (section->type == PKG_SECTION_PARTITION) {
+            partitions++;
+            const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, section->label);
+            if (!partition || !partition_writable(u, partition) || section->size > partition->size) {
+                ESP_LOGE(TAG, "Section %" PRIu32 " cannot be written to partition '%s'", i, section->label);
+                return update_failed(u, HTTPD_400_BAD_REQUEST, "Invalid partition section");
+            }
+            for (uint32_t j = 0; j < i; j++) {
+                if (pkg_header->sections[j].type == PKG_SECTION_PARTITION && strcmp(pkg_header->sections[j].label, section->label) == 0) {
+                    return update_failed(u, HTTPD_400_BAD_REQUEST, "Invalid partition section");
+                }
+            }
+        } else if (section->type == PKG_SECTION_ASSET_BUNDLE) {
+            const esp_partition_t *partition = asset_bundle_partition(u->update_partition);
+            if (!partition || section->size > partition->size || ++bundles > 1) {
+                ESP_LOGE(TAG, "Section %" PRIu32 " does not fit the asset partition of %s", i, u->update_partition->label);
+                return update_failed(u, HTTPD_400_BAD_REQUEST, "Invalid asset bundle section");
+            }
+        }
+    }
+
+    // The app is what the boot switch activates, and its slot decides which web bank is written
+    if (apps != 1 || web > 1) {
+        ESP_LOGE(TAG, "Package needs one app section and at most one web section (%" PRIu32 " and %" PRIu32 " found)", apps, web);
+        return update_failed(u, HTTPD_400_BAD_REQUEST, "Invalid package format");
+    }
+    return ESP_OK;
+}
+
+// Header, decoders and the target slot; shared by fresh and resumed updates
+static esp_err_t update_prepare(package_update_t *u, const package_checkpoint_t *resume) {
+    const pkg_header_t *pkg_header = &u->header;
+
+    ESP_LOGI(TAG, "Package v%" PRIu32 " contains %" PRIu32 " sections", pkg_header->version, pkg_header->section_count);
+    ESP_LOGI(TAG, "Remaining after package header (%" PRId64 " bytes)", package_remaining(u));
+
+    // Get update partition for firmware; a checkpoint only holds for the slot it was taken in
+    u->update_partition = esp_ota_get_next_update_partition(NULL);
+    if (!u->update_partition) {
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "No OTA partition");
+    }
+    if (resume && resume->update_partition_address != u->update_partition->address) {
+        ESP_LOGE(TAG, "Checkpoint was taken for another OTA slot");
+        return update_failed(u, HTTPD_400_BAD_REQUEST, "Update slot changed, restart the upload");
+    }
+    if (check_sections(u) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    // v2 and later packages are verified section by section while they are received
+    u->digest.enabled = (pkg_header->version >= 2);
+    if (u->digest.enabled) {
+        digest_start(&u->digest.section);
+        if (resume) {
+            mbedtls_sha256_clone(&u->digest.section, &resume->section_sha);
+        }
+    }
+
+    uint32_t encodings = 0;
+    for (uint32_t i = 0; i < pkg_header->section_count; i++) {
+        encodings |= pkg_header->sections[i].encoding;
+    }
+    if (encodings & PKG_ENCODING_DEFLATE) {
+        u->inflater = inflate_stream_create();
+        if (!u->inflater) {
+            ESP_LOGE(TAG, "Failed to allocate decompressor");
+            return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        }
+    }
+
+    // Delta firmware copies unchanged ranges from the app that is running now
+    if (encodings & PKG_ENCODING_DELTA) {
+        u->patch = delta_patch_create(esp_ota_get_running_partition());
+        if (!u->patch) {
+            ESP_LOGE(TAG, "Failed to allocate patch decoder");
+            return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        }
+    }
+    return ESP_OK;
+}
+
+// Routes a stream section's data through the decoders its encoding needs into `u->writer`,
+// and lets the writer task erase ahead whenever it is waiting for data
+static void stream_begin(package_update_t *u, const pkg_section_t *section) {
+    u->sink = (image_sink_t){ .writer = &u->writer };
+    u->stream_job = ota_write_job;
+    u->stream_ctx = &u->writer;
+    if (section->encoding & PKG_ENCODING_DEFLATE) {
+        update_pipeline_submit(u->pipeline, file_inflate_begin_job, u->inflater, NULL, 0);
+        u->sink.inflater = u->inflater;
+    }
+    if (section->encoding & PKG_ENCODING_DELTA) {
+        u->sink.patch = u->patch;
+    }
+    if (u->sink.inflater || u->sink.patch) {
+        u->stream_job = image_decode_job;
+        u->stream_ctx = &u->sink;
+    }
+    update_pipeline_set_idle(u->pipeline, ota_erase_idle, &u->writer);
+}
+
+// Waits until every queued byte of the stream is on flash and the decoders ended cleanly
+static esp_err_t stream_end(package_update_t *u) {
+    esp_err_t err = update_pipeline_flush(u->pipeline);
+    if (err == ESP_OK) {
+        err = image_decode_finish(&u->sink);
+    }
+    update_pipeline_set_idle(u->pipeline, NULL, NULL);
+    return err;
+}
+
+// **App section** -> next OTA slot. Raw firmware in an erase-ahead slot is checkpointed every
+// UPDATE_CHECKPOINT_INTERVAL bytes; compressed or delta firmware only restarts at the section start,
+// since the decoder state cannot be saved.
+static esp_err_t firmware_begin(package_update_t *u, const pkg_section_t *section, const package_checkpoint_t *resume) {
+    size_t resume_written = resume ? resume->section_written : 0;
+
+    esp_err_t err = (resume_written > 0)
+        ? ota_writer_resume(&u->writer, u->update_partition, section->size, resume_written)
+        : ota_writer_begin(&u->writer, u->update_partition, section->size, OTA_ERASE_AHEAD);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start OTA update");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start OTA update");
+    }
+    u->ota_started = true;
+    if (section->encoding & PKG_ENCODING_DELTA) {
+        ESP_LOGI(TAG, "Delta firmware: %" PRIu32 " byte patch rebuilds a %" PRIu32 " byte image", section->length, section->size);
+    }
+
+    // Firmware chunks are written by the writer task while the next chunk is being received,
+    // and the sectors the firmware needs are erased whenever the writer is waiting for data
+    stream_begin(u, section);
+    u->firmware_checkpoints = u->config->checkpoint && u->stream_job == ota_write_job && u->writer.erase_ahead;
+    update_telemetry_phase(UPDATE_PHASE_FIRMWARE);
+    return ESP_OK;
+}
+
+static esp_err_t firmware_end(package_update_t *u, const pkg_section_t *section) {
+    u->firmware_checkpoints = false;
+    if (stream_end(u) != ESP_OK) {
+        ESP_LOGE(TAG, "Firmware upload failed");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Firmware write failed");
+    }
+
+    // Finalize OTA (the boot partition is switched once every other section has been verified too)
+    if (ota_writer_end(&u->writer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to complete OTA update");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to complete OTA update");
+    }
+    u->ota_started = false;
+
+    ota_writer_log_timing(&u->writer);
+    ESP_LOGI(TAG, "Firmware written!");
+    return ESP_OK;
+}
+
+// **LittleFS image section** -> the whole web bank paired with the update slot, streamed straight
+// into the unmounted partition with bulk sequential writes. Restarts from its beginning when resumed.
+static esp_err_t web_image_begin(package_update_t *u, const pkg_section_t *section, const package_checkpoint_t *resume) {
+    const esp_partition_t *partition = web_bank_partition(u->update_partition);
+    if (!partition || ota_writer_begin_data(&u->writer, partition, section->size) != ESP_OK) {
+        ESP_LOGE(TAG, "LittleFS image update failed");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "LittleFS image write failed");
+    }
+    stream_begin(u, section);
+    update_telemetry_phase(UPDATE_PHASE_IMAGE);
+    return ESP_OK;
+}
+
+static esp_err_t web_image_end(package_update_t *u, const pkg_section_t *section) {
+    esp_err_t err = stream_end(u);
+    if (err == ESP_OK) {
+        err = ota_writer_end(&u->writer);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "LittleFS image update failed");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "LittleFS image write failed");
+    }
+    ota_writer_log_timing(&u->writer);
+    ESP_LOGI(TAG, "LittleFS image written (%" PRIu32 " bytes)", section->size);
+
+    // Mounting without format proves the image is a usable file system
+    if (web_bank_mount_next(u->update_partition, false) != ESP_OK) {
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to mount web bank");
+    }
+    web_bank_unmount_next();
+    return ESP_OK;
+}
+
+// **Partition section** -> a raw image for the data partition it names (checked by check_sections()).
+// These partitions have no A/B copy: they are rewritten in place before the boot partition switches,
+// after every other section. A verified section up to UPDATE_PARTITION_STAGE_MAX bytes is collected
+// in RAM and only written once its digest matched; a larger one is streamed, so a failure part way
+// through leaves the partition corrupt.
+static esp_err_t partition_begin(package_update_t *u, const pkg_section_t *section, const package_checkpoint_t *resume) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, section->label);
+    uint8_t *stage = NULL;
+    if (u->digest.enabled && section->verify && section->size > 0 && section->size <= UPDATE_PARTITION_STAGE_MAX) {
+        stage = malloc(section->size);
+        if (!stage) {
+            ESP_LOGW(TAG, "No memory to stage partition %s, writing it in place", section->label);
+        }
+    }
+    if (!partition || (!stage && ota_writer_begin_data(&u->writer, partition, section->size) != ESP_OK)) {
+        free(stage);
+        ESP_LOGE(TAG, "Failed to start writing partition %s", section->label);
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Partition write failed");
+    }
+    stream_begin(u, section);
+    if (stage) {
+        // Nothing is erased until partition_end(): the data goes through the sink into the stage
+        u->sink.stage = stage;
+        u->sink.stage_size = section->size;
+        u->stream_job = image_decode_job;
+        u->stream_ctx = &u->sink;
+        update_pipeline_set_idle(u->pipeline, NULL, NULL);
+    }
+    update_telemetry_phase(UPDATE_PHASE_PARTITION);
+    update_telemetry_file(section->label);
+    return ESP_OK;
+}
+
+// Writes a staged section, whose digest on_section_end() has checked by now
+static esp_err_t partition_write_stage(package_update_t *u, const pkg_section_t *section) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, section->label);
+    if (u->sink.staged != section->size) {
+        ESP_LOGE(TAG, "Partition %s image is %u bytes, %" PRIu32 " announced", section->label, (unsigned)u->sink.staged, section->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err = ota_writer_begin_data(&u->writer, partition, section->size);
+    if (err == ESP_OK) {
+        err = ota_write_job(&u->writer, (const char *)u->sink.stage, u->sink.staged);
+    }
+    return err;
+}
+
+static esp_err_t partition_end(package_update_t *u, const pkg_section_t *section) {
+    esp_err_t err = stream_end(u);
+    if (err == ESP_OK && u->sink.stage) {
+        err = partition_write_stage(u, section);
+    }
+    free(u->sink.stage);
+    u->sink.stage = NULL;
+    if (err == ESP_OK) {
+        err = ota_writer_end(&u->writer);
+    }
+    update_telemetry_file("");
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Partition %s update failed", section->label);
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Partition write failed");
+    }
+    ota_writer_log_timing(&u->writer);
+    ESP_LOGI(TAG, "Partition %s written (%" PRIu32 " bytes)", section->label, section->size);
+    return ESP_OK;
+}
+
+// **Asset bundle section** -> the asset partition paired with the update slot, which is not mapped
+// while that slot is not running. Restarts from its beginning when resumed.
+static esp_err_t bundle_begin(package_update_t *u, const pkg_section_t *section, const package_checkpoint_t *resume) {
+    const esp_partition_t *partition = asset_bundle_partition(u->update_partition);
+    if (!partition || ota_writer_begin_data(&u->writer, partition, section->size) != ESP_OK) {
+        ESP_LOGE(TAG, "Asset bundle update failed");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Asset bundle write failed");
+    }
+    stream_begin(u, section);
+    update_telemetry_phase(UPDATE_PHASE_PARTITION);
+    update_telemetry_file(partition->label);
+    return ESP_OK;
+}
+
+static esp_err_t bundle_end(package_update_t *u, const pkg_section_t *section) {
+    esp_err_t err = stream_end(u);
+    if (err == ESP_OK) {
+        err = ota_writer_end(&u->writer);
+    }
+    update_telemetry_file("");
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Asset bundle update failed");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Asset bundle write failed");
+    }
+    ota_writer_log_timing(&u->writer);
+
+    // The digest covers the bytes, not whether the new firmware can map and search them
+    if (asset_bundle_verify(asset_bundle_partition(u->update_partition)) != ESP_OK) {
+        return update_failed(u, HTTPD_400_BAD_REQUEST, "Invalid asset bundle");
+    }
+    ESP_LOGI(TAG, "Asset bundle written (%" PRIu32 " bytes)", section->size);
+    return ESP_OK;
+}
+
+// **Files section** -> web bank paired with the update slot. The running bank keeps serving throughout.
+// Checkpointed at file boundaries.
+static esp_err_t files_begin(package_update_t *u, const pkg_section_t *section, const package_checkpoint_t *resume) {
+    // **Mount the next web bank** (a fresh bank may be formatted)
+    if (web_bank_mount_next(u->update_partition, true) != ESP_OK) {
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to mount web bank");
+    }
+
+    // Past the first file, the bank already holds the synced copy plus the files before the checkpoint
+    if (resume && resume->offset > section->offset) {
+        // Only the manifest saved with the checkpoint describes what the bank holds now
+        u->manifest = asset_manifest_load(RESUME_ASSET_MANIFEST_PATH);
+        if (!u->manifest) {
+            return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        }
+        update_telemetry_phase(UPDATE_PHASE_FILES);
+        return ESP_OK;
+    }
+
+    // The stored manifest is dropped until the update finishes, so an interrupted update rewrites everything
+    u->manifest = asset_manifest_load(NEXT_ASSET_MANIFEST_PATH);
+    remove(NEXT_ASSET_MANIFEST_PATH);
+    remove(RESUME_ASSET_MANIFEST_PATH);
+
+    // Start from a copy of the running bank, so files the package leaves out carry over. Files whose
+    // digest matches what is already in the bank are then received and hashed, but not rewritten.
+    update_telemetry_phase(UPDATE_PHASE_BANK_SYNC);
+    asset_manifest_t *active_manifest = asset_manifest_load(ASSET_MANIFEST_PATH);
+    esp_err_t err = (u->manifest && active_manifest) ? web_bank_sync(active_manifest, u->manifest) : ESP_ERR_NO_MEM;
+    asset_manifest_destroy(active_manifest);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to prepare the next web bank (%s)", esp_err_to_name(err));
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to prepare web bank");
+    }
+    update_telemetry_phase(UPDATE_PHASE_FILES);
+    return ESP_OK;
+}
+
+static esp_err_t files_end(package_update_t *u, const pkg_section_t *section) {
+    // Wait for the writer task to drain before reporting success
+    if (update_pipeline_flush(u->pipeline) != ESP_OK) {
+        ESP_LOGE(TAG, "LittleFS update failed");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "File write or verification failed");
+    }
+    ESP_LOGI(TAG, "Web assets: %" PRIu32 " unchanged files skipped (%" PRIu64 " bytes not rewritten)",
+             u->result->files_skipped, u->result->bytes_skipped);
+    if (u->manifest) {
+        asset_manifest_save(u->manifest, NEXT_ASSET_MANIFEST_PATH);
+        remove(RESUME_ASSET_MANIFEST_PATH);
+        asset_manifest_destroy(u->manifest);
+        u->manifest = NULL;
+    }
+    web_bank_unmount_next();
+    return ESP_OK;
+}
+
+// Where each section type goes; begin/end run on the receiving task, between two sections
+typedef struct {
+    esp_err_t (*begin)(package_update_t *u, const pkg_section_t *section, const package_checkpoint_t *resume);
+    esp_err_t (*end)(package_update_t *u, const pkg_section_t *section);
+    const char *write_failed;           // Response when stream data cannot be queued
+    const char *mismatch;               // Response when the section digest does not match
+} section_handler_t;
+
+static const section_handler_t section_handlers[] = {
+    [PKG_SECTION_APP] = { firmware_begin, firmware_end, "Firmware write failed", "Firmware checksum mismatch" },
+    [PKG_SECTION_FILES] = { files_begin, files_end, "File write failed", "LittleFS checksum mismatch" },
+    [PKG_SECTION_WEB_IMAGE] = { web_image_begin, web_image_end, "LittleFS image write failed", "LittleFS checksum mismatch" },
+    [PKG_SECTION_PARTITION] = { partition_begin, partition_end, "Partition write failed", "Partition checksum mismatch" },
+    [PKG_SECTION_ASSET_BUNDLE] = { bundle_begin, bundle_end, "Asset bundle write failed", "Asset bundle checksum mismatch" },
+};
+
+// Removes the precompressed variant of a file about to be rewritten. The packager puts a variant
+// right after its file, so a package that still has one writes it again next; otherwise the
+// stale variant would be served in place of the new file.
+static void drop_gzip_variant(package_update_t *u, const pkg_file_t *file, const char *file_path) {
+    size_t suffix_len = strlen(GZIP_VARIANT_SUFFIX);
+    if (file->name_len >= suffix_len && strcmp(file->name + file->name_len - suffix_len, GZIP_VARIANT_SUFFIX) == 0) {
+        return;
+    }
+
+    char variant_path[WEB_BANK_PATH_MAX_SIZE + sizeof(GZIP_VARIANT_SUFFIX) - 1];
+    snprintf(variant_path, sizeof(variant_path), "%s" GZIP_VARIANT_SUFFIX, file_path);
+    if (remove(variant_path) == 0) {
+        ESP_LOGD(TAG, "Removed stale variant: %s", variant_path);
+    }
+    if (u->manifest) {
+        char variant_name[PKG_FILE_NAME_MAX_LEN + sizeof(GZIP_VARIANT_SUFFIX)];
+        snprintf(variant_name, sizeof(variant_name), "%s" GZIP_VARIANT_SUFFIX, file->name);
+        asset_manifest_entry_t *entry = asset_manifest_find(u->manifest, variant_name);
+        if (entry) {
+            entry->valid = false;
+        }
+    }
+}
+
+// Opens a file record for writing, or skips it when the bank already holds the same content
+static int file_begin(package_update_t *u, const pkg_file_t *file) {
+    ESP_LOGD(TAG, "Extracted file metadata -> File Name Length: %" PRIu32 ", File Size: %" PRIu32,
+     (uint32_t)file->name_len, file->size);
+
+    // Validate File Size (1MB limit)
+    if (file->size > 1024 * 1024) {
+        ESP_LOGE(TAG, "Invalid file size: %" PRIu32, file->size);
+        return update_failed(u, HTTPD_400_BAD_REQUEST, "Invalid file record");
+    }
+
+    // Ensure the file path is within bounds (the parser caps name_len at PKG_FILE_NAME_MAX_LEN)
+    char file_path[WEB_BANK_PATH_MAX_SIZE];
+    int path_len = snprintf(file_path, sizeof(file_path), "%s/%s", WEB_BANK_NEXT_MOUNT_POINT, file->name);
+    if (strlen(file->name) != file->name_len || path_len < 0 || path_len >= (int)sizeof(file_path)) {
+        ESP_LOGE(TAG, "Invalid file name: %s", file->name);
+        return update_failed(u, HTTPD_400_BAD_REQUEST, "Invalid file record");
+    }
+    if (file->sha256 && u->manifest && asset_manifest_unchanged(u->manifest, file->name, file_path, file->sha256, file->size)) {
+        ESP_LOGD(TAG, "Unchanged, skipping: %s", file_path);
+        update_telemetry_file_done(true);
+        u->result->files_skipped++;
+        u->result->bytes_skipped += file->size;
+        return PKG_PARSER_SKIP;
+    }
+    drop_gzip_variant(u, file, file_path);
+
+    pending_file_t *pending = calloc(1, sizeof(pending_file_t));
+    if (!pending) {
+        ESP_LOGE(TAG, "Failed to allocate file state");
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+    }
+    pending->size = file->size;
+    pending->inflater = (u->header.sections[u->section].encoding & PKG_ENCODING_DEFLATE) ? u->inflater : NULL;
+    pending->verify = file->sha256 != NULL;
+    pending->digest = &u->digest;
+    mbedtls_sha256_init(&pending->sha);
+    if (pending->verify) {
+        mbedtls_sha256_starts(&pending->sha, 0);
+        memcpy(pending->expected_sha256, file->sha256, SHA256_LEN);
+    }
+    memcpy(pending->path, file_path, sizeof(pending->path));
+    if (u->manifest) {
+        // Not trusted again until the commit job has verified the new content
+        pending->manifest_entry = asset_manifest_get(u->manifest, file->name);
+        if (pending->manifest_entry) {
+            pending->manifest_entry->valid = false;
+        }
+    }
+    snprintf(pending->temp_path, sizeof(pending->temp_path), "%s.tmp", pending->path);
+    ESP_LOGD(TAG, "Writing file: %s (Size: %" PRIu32 " bytes)", pending->path, file->size);
+    update_telemetry_file(file->name);
+
+    // Open file in binary mode to prevent corruption. Data lands in a temporary file
+    // so the live file is only replaced once the new one is complete.
+    pending->file = fopen(pending->temp_path, "wb");
+    if (!pending->file) {
+        ESP_LOGE(TAG, "Failed to open file for writing: %s", pending->temp_path);
+        pending_file_free(pending);
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "File write failed");
+    }
+
+    // The writer task owns the file from here on: it decompresses and hashes the data,
+    // then its commit job closes the file and checks size and digest before the rename
+    if (pending->inflater) {
+        update_pipeline_submit(u->pipeline, file_inflate_begin_job, pending->inflater, NULL, 0);
+    }
+    u->pending = pending;
+    return PKG_PARSER_OK;
+}
+
+// Parser callbacks: `ctx` is the package_update_t. A failure records its response first, so the
+// parser error that follows only stops the receive loop.
+static int on_header(void *ctx, const pkg_header_t *header) {
+    package_update_t *u = ctx;
+    u->header = *header;
+    return update_prepare(u, NULL) == ESP_OK ? PKG_PARSER_OK : -1;
+}
+
+// Each section starts with a checkpoint, so a resumed update never redoes a verified section
+static int on_section_begin(void *ctx, const pkg_section_t *section) {
+    package_update_t *u = ctx;
+    u->section = pkg_parser_section(&u->parser);
+    if (section_handlers[section->type].begin(u, section, NULL) != ESP_OK) {
+        return -1;
+    }
+    u->checkpoint_due = true;
+    return PKG_PARSER_OK;
+}
+
+static int on_section_data(void *ctx, const pkg_section_t *section, const uint8_t *data, size_t len) {
+    // Hash while the writer task is still busy with the previous buffer
+    digest_update(&((package_update_t *)ctx)->digest, data, len);
+    return PKG_PARSER_OK;
+}
+
+static int on_stream_data(void *ctx, const pkg_section_t *section, const uint8_t *data, size_t len) {
+    package_update_t *u = ctx;
+    if (queue_data(u, u->stream_job, u->stream_ctx, data, len) != ESP_OK) {
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, section_handlers[section->type].write_failed);
+    }
+    return PKG_PARSER_OK;
+}
+
+static int on_file_begin(void *ctx, const pkg_file_t *file) {
+    return file_begin((package_update_t *)ctx, file);
+}
+
+static int on_file_data(void *ctx, const uint8_t *data, size_t len) {
+    package_update_t *u = ctx;
+    if (queue_data(u, file_write_job, u->pending, data, len) != ESP_OK) {
+        ESP_LOGE(TAG, "File upload error: %s", u->pending->path);
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "File write failed");
+    }
+    return PKG_PARSER_OK;
+}
+
+static int on_file_end(void *ctx, const pkg_file_t *file) {
+    package_update_t *u = ctx;
+    pending_file_t *pending = u->pending;
+    u->pending = NULL;
+    if (update_pipeline_submit(u->pipeline, file_commit_job, pending, NULL, 0) != ESP_OK) {
+        return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "File write or verification failed");
+    }
+    return PKG_PARSER_OK;
+}
+
+// The section digest covers the bytes as sent, so a corrupted section is rejected before its writer
+// finishes: a corrupted app never becomes bootable and a staged data partition is never erased.
+// A data partition section too large to stage has already been rewritten by then.
+static int on_section_end(void *ctx, const pkg_section_t *section) {
+    package_update_t *u = ctx;
+    const section_handler_t *handler = &section_handlers[section->type];
+    if (u->digest.enabled && section->verify) {
+        if (!digest_matches(&u->digest, &u->digest.section, section->sha256)) {
+            ESP_LOGE(TAG, "Section %" PRIu32 " SHA-256 mismatch", u->section);
+            return update_failed(u, HTTPD_400_BAD_REQUEST, handler->mismatch);
+        }
+        digest_start(&u->digest.section);
+    }
+    return handler->end(u, section) == ESP_OK ? PKG_PARSER_OK : -1;
+}
+
+static const pkg_parser_callbacks_t parser_callbacks = {
+    .header = on_header,
+    .section_begin = on_section_begin,
+    .section_data = on_section_data,
+    .stream_data = on_stream_data,
+    .file_begin = on_file_begin,
+    .file_data = on_file_data,
+    .file_end = on_file_end,
+    .section_end = on_section_end,
+};
+
+// Receives the package one slice at a time into pool buffers and pushes each slice through the parser.
+// Slices end where the parser's current item ends, so data callbacks see whole slices and checkpoints
+// land on positions the parser can resume from.
+static esp_err_t receive_package(package_update_t *u) {
+    while (u->offset < u->config->size) {
+        size_t want = pkg_parser_wants(&u->parser);
+        if (want == 0 || want > WRITE_BLOCK_SIZE) {
+            want = WRITE_BLOCK_SIZE;
+        }
+        if (u->firmware_checkpoints && pkg_parser_state(&u->parser) == PKG_STATE_STREAM) {
+            uint32_t written = u->offset - u->header.sections[u->section].offset;
+            want = MIN(want, UPDATE_CHECKPOINT_INTERVAL - written % UPDATE_CHECKPOINT_INTERVAL);
+        }
+        want = MIN(want, u->config->size - u->offset);
+
+        if (!u->rx) {
+            u->rx = update_pipeline_acquire(u->pipeline);
+        }
+        if (package_recv(u, u->rx, want) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        u->rx_len = want;
+        int status = pkg_parser_feed(&u->parser, (const uint8_t *)u->rx, want);
+        u->rx_len = 0;
+        if (status < 0) {
+            ESP_LOGE(TAG, "Package rejected at offset %" PRIu32 " (%d)", u->offset, status);
+            return update_failed(u, HTTPD_400_BAD_REQUEST,
+                                 status == PKG_PARSER_ERR_RECORD ? "Invalid file record" : "Invalid package format");
+        }
+
+        if (checkpoint_if_due(u) != ESP_OK) {
+            return update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save checkpoint");
+        }
+        update_telemetry_log_progress();
+    }
+
+    if (!pkg_parser_done(&u->parser)) {
+        ESP_LOGE(TAG, "Package ends early at offset %" PRIu32, u->offset);
+        return update_failed(u, HTTPD_400_BAD_REQUEST, "Package truncated");
+    }
+    return ESP_OK;
+}
+
+// Continues from a checkpoint: the header comes from the checkpoint, and the section it was
+// taken in is reopened where it stopped
+static esp_err_t update_resume(package_update_t *u, const package_checkpoint_t *resume) {
+    u->header = resume->header;
+    u->offset = resume->offset;
+    u->result->files_skipped = resume->files_skipped;
+    u->result->bytes_skipped = resume->bytes_skipped;
+    ESP_LOGI(TAG, "Resuming package at offset %" PRIu32 " of %" PRIu32, u->offset, u->config->size);
+
+    if (pkg_parser_resume(&u->parser, &parser_callbacks, u, &u->header, u->offset) != PKG_PARSER_OK) {
+        ESP_LOGE(TAG, "Checkpoint does not fit the package");
+        return update_failed(u, HTTPD_400_BAD_REQUEST, "Invalid package format");
+    }
+    esp_err_t err = update_prepare(u, resume);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // The sections before the checkpoint were verified and finished; only the current one is reopened
+    u->section = pkg_parser_section(&u->parser);
+    const pkg_section_t *section = &u->header.sections[u->section];
+    ESP_LOGI(TAG, "Continuing with section %" PRIu32 " of %" PRIu32, u->section + 1, u->header.section_count);
+    return section_handlers[section->type].begin(u, section, resume);
+}
+
+static bool package_has_section(const package_update_t *u, pkg_section_type_t type) {
+    for (uint32_t i = 0; i < u->header.section_count; i++) {
+        if (u->header.sections[i].type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stops the writer task (running or skipping whatever is still queued) and frees per-update state
+static void update_release(package_update_t *u) {
+    if (u->pending) {
+        update_pipeline_submit(u->pipeline, file_discard_job, u->pending, NULL, 0);
+    }
+    if (u->rx) {
+        update_pipeline_release(u->pipeline, u->rx);
+    }
+    update_pipeline_destroy(u->pipeline);
+    if (u->ota_started) {
+        ota_writer_abort(&u->writer);
+    }
+    free(u->sink.stage);
+    inflate_stream_destroy(u->inflater);
+    delta_patch_destroy(u->patch);
+    asset_manifest_destroy(u->manifest);
+    web_bank_unmount_next();
+    digest_free(&u->digest);
+}
+
+esp_err_t package_update_run(const package_update_config_t *config, package_update_result_t *result) {
+    int64_t upload_start = esp_timer_get_time();
+    memset(result, 0, sizeof(package_update_result_t));
+    const package_checkpoint_t *resume = config->resume;
+    if (resume && (resume->layout != PACKAGE_CHECKPOINT_LAYOUT || resume->offset > config->size)) {
+        resume = NULL;
+    }
+    update_telemetry_begin(config->size, resume ? resume->offset : 0);
+
+    package_update_t *u = calloc(1, sizeof(package_update_t));
+    if (!u) {
+        result->status = HTTPD_500_INTERNAL_SERVER_ERROR;
+        result->message = "Memory allocation failed";
+        update_telemetry_fail(ESP_ERR_NO_MEM, result->message);
+        update_telemetry_end(ESP_ERR_NO_MEM);
+        return ESP_ERR_NO_MEM;
+    }
+    u->config = config;
+    u->result = result;
+
+    update_pipeline_config_t pipeline_config = {
+        .buffer_count = UPDATE_PIPELINE_BUFFER_COUNT,
+        .buffer_size = WRITE_BLOCK_SIZE,
+        .stack_size = UPDATE_WRITER_TASK_STACK,
+        .priority = UPDATE_WRITER_TASK_PRIORITY,
+        .core_id = UPDATE_WRITER_TASK_CORE,
+    };
+    if (update_pipeline_create(&pipeline_config, &u->pipeline) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create update pipeline");
+        result->status = HTTPD_500_INTERNAL_SERVER_ERROR;
+        result->message = "Memory allocation failed";
+        update_telemetry_fail(ESP_ERR_NO_MEM, result->message);
+        update_telemetry_end(ESP_FAIL);
+        free(u);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Update package started. Size: %" PRIu32 " bytes", config->size);
+    esp_err_t err = ESP_OK;
+    if (resume) {
+        err = update_resume(u, resume);
+    } else {
+        pkg_parser_init(&u->parser, &parser_callbacks, u);
+    }
+    u->checkpoint_offset = u->offset;
+
+    if (err == ESP_OK) {
+        err = receive_package(u);
+    }
+
+    // Without web assets of its own, the new firmware keeps the running UI instead of booting into
+    // whatever its bank held before
+    if (err == ESP_OK && !package_has_section(u, PKG_SECTION_FILES) && !package_has_section(u, PKG_SECTION_WEB_IMAGE) &&
+        web_bank_copy_active(u->update_partition) != ESP_OK) {
+        err = update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to prepare web bank");
+    }
+
+    // A bundle left in the slot by an earlier update would shadow the web assets this package delivered
+    if (err == ESP_OK && !package_has_section(u, PKG_SECTION_ASSET_BUNDLE)) {
+        const esp_partition_t *bundle_partition = asset_bundle_partition(u->update_partition);
+        if (bundle_partition && asset_bundle_invalidate(bundle_partition) != ESP_OK) {
+            err = update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to clear asset bundle");
+        }
+    }
+
+    // Everything arrived intact: make the new firmware bootable, which also selects its web bank
+    if (err == ESP_OK && esp_ota_set_boot_partition(u->update_partition) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to complete OTA update");
+        err = update_failed(u, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to activate firmware");
+    }
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Firmware update complete!");
+        if (u->digest.enabled) {
+            int64_t upload_ms = (esp_timer_get_time() - upload_start) / 1000;
+            int64_t hash_ms = u->digest.hash_us / 1000;
+            int64_t file_hash_ms = u->digest.file_hash_us / 1000;
+            ESP_LOGI(TAG, "SHA-256: %" PRIu64 " bytes hashed in %" PRId64 " ms (%" PRIu64 " KB/s), %" PRId64 " of %" PRId64 " ms upload time",
+                     u->digest.hashed_bytes, hash_ms, hash_ms > 0 ? u->digest.hashed_bytes / (uint64_t)hash_ms : 0,
+                     hash_ms, upload_ms);
+            ESP_LOGI(TAG, "SHA-256 (files, writer task): %" PRIu64 " bytes hashed in %" PRId64 " ms",
+                     u->digest.file_hashed_bytes, file_hash_ms);
+        }
+    } else {
+        result->resumable = u->transport_failed;
+        if (u->transport_failed) {
+            result->message = NULL;
+        }
+    }
+
+    update_release(u);
+    free(u);
+    update_telemetry_end(err);
+    return err;
+}
+
+esp_err_t package_update_prepare_slot(const esp_partition_t *update_app) {
+    esp_err_t err = web_bank_copy_active(update_app);
+    const esp_partition_t *bundle_partition = asset_bundle_partition(update_app);
+    if (err == ESP_OK && bundle_partition) {
+        err = asset_bundle_invalidate(bundle_partition);
+    }
+    return err;
+}
@@ -0,0 +1,209 @@
+#include "update_pipeline.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <stdlib.h>
+
+static const char* TAG = "UpdatePipeline";
+
+typedef enum {
+    JOB_WRITE,
+    JOB_FLUSH,
+    JOB_SET_IDLE,
+    JOB_STOP,
+} pipeline_job_kind_t;
+
+typedef struct {
+    pipeline_job_kind_t kind;
+    update_pipeline_write_fn fn;
+    update_pipeline_idle_fn idle_fn;
+    void *ctx;
+    char *buffer;
+    size_t len;
+} pipeline_job_t;
+
+struct update_pipeline {
+    char **buffers;                 // Every buffer in the pool, for freeing
+    size_t buffer_count;
+    QueueHandle_t free_buffers;     // Buffers ready for the producer
+    QueueHandle_t jobs;             // Jobs waiting for the writer task
+    SemaphoreHandle_t flushed;
+    SemaphoreHandle_t stopped;
+    TaskHandle_t writer;
+    update_pipeline_idle_fn idle_fn; // Only touched by the writer task
+    void *idle_ctx;
+    volatile esp_err_t error;       // First error reported by a write job
+};
+
+static void writer_task(void *arg) {
+    update_pipeline_t *pipeline = arg;
+    pipeline_job_t job;
+
+    while (1) {
+        // With background work pending, poll the queue and fill idle time with it
+        TickType_t wait = pipeline->idle_fn ? 0 : portMAX_DELAY;
+        if (xQueueReceive(pipeline->jobs, &job, wait) != pdTRUE) {
+            if (pipeline->error != ESP_OK || !pipeline->idle_fn(pipeline->idle_ctx)) {
+                pipeline->idle_fn = NULL;
+            }
+            continue;
+        }
+
+        if (job.kind == JOB_STOP) {
+            break;
+        }
+        if (job.kind == JOB_FLUSH) {
+            xSemaphoreGive(pipeline->flushed);
+            continue;
+        }
+        if (job.kind == JOB_SET_IDLE) {
+            pipeline->idle_fn = job.idle_fn;
+            pipeline->idle_ctx = job.ctx;
+            continue;
+        }
+
+        // Skip data after a failure, but always run control jobs so resources get released
+        if (pipeline->error == ESP_OK || job.buffer == NULL) {
+            esp_err_t err = job.fn(job.ctx, job.buffer, job.len);
+            if (err != ESP_OK && pipeline->error == ESP_OK) {
+                pipeline->error = err;
+            }
+        }
+
+        if (job.buffer) {
+            xQueueSend(pipeline->free_buffers, &job.buffer, portMAX_DELAY);
+        }
+    }
+
+    xSemaphoreGive(pipeline->stopped);
+    vTaskDelete(NULL);
+}
+
+static void pipeline_free(update_pipeline_t *pipeline) {
+    if (pipeline->buffers) {
+        for (size_t i = 0; i < pipeline->buffer_count; i++) {
+            heap_caps_free(pipeline->buffers[i]);
+        }
+        free(pipeline->buffers);
+    }
+    if (pipeline->free_buffers) vQueueDelete(pipeline->free_buffers);
+    if (pipeline->jobs) vQueueDelete(pipeline->jobs);
+    if (pipeline->flushed) vSemaphoreDelete(pipeline->flushed);
+    if (pipeline->stopped) vSemaphoreDelete(pipeline->stopped);
+    free(pipeline);
+}
+
+esp_err_t update_pipeline_create(const update_pipeline_config_t *config, update_pipeline_t **out_pipeline) {
+    if (!config || !out_pipeline || config->buffer_count == 0 || config->buffer_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    update_pipeline_t *pipeline = calloc(1, sizeof(update_pipeline_t));
+    if (!pipeline) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    pipeline->buffer_count = config->buffer_count;
+    pipeline->buffers = calloc(config->buffer_count, sizeof(char *));
+    pipeline->free_buffers = xQueueCreate(config->buffer_count, sizeof(char *));
+    pipeline->jobs = xQueueCreate(config->buffer_count + 4, sizeof(pipeline_job_t));
+    pipeline->flushed = xSemaphoreCreateBinary();
+    pipeline->stopped = xSemaphoreCreateBinary();
+    if (!pipeline->buffers || !pipeline->free_buffers || !pipeline->jobs || !pipeline->flushed || !pipeline->stopped) {
+        pipeline_free(pipeline);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < config->buffer_count; i++) {
+        pipeline->buffers[i] = heap_caps_malloc(config->buffer_size, MALLOC_CAP_DMA);
+        if (!pipeline->buffers[i]) {
+            ESP_LOGE(TAG, "Failed to allocate pipeline buffer %d of %d", (int)i + 1, (int)config->buffer_count);
+            pipeline_free(pipeline);
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(pipeline->free_buffers, &pipeline->buffers[i], 0);
+    }
+
+    // Fall back to a floating task on single-core targets
+    BaseType_t core_id = config->core_id;
+    if (core_id != tskNO_AFFINITY && core_id >= portNUM_PROCESSORS) {
+        core_id = tskNO_AFFINITY;
+    }
+
+    if (xTaskCreatePinnedToCore(writer_task, "update_writer", config->stack_size, pipeline,
+                                config->priority, &pipeline->writer, core_id) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start writer task");
+        pipeline_free(pipeline);
+        return ESP_FAIL;
+    }
+
+    *out_pipeline = pipeline;
+    return ESP_OK;
+}
+
+char *update_pipeline_acquire(update_pipeline_t *pipeline) {
+    char *buffer = NULL;
+    xQueueReceive(pipeline->free_buffers, &buffer, portMAX_DELAY);
+    return buffer;
+}
+
+void update_pipeline_release(update_pipeline_t *pipeline, char *buffer) {
+    if (buffer) {
+        xQueueSend(pipeline->free_buffers, &buffer, portMAX_DELAY);
+    }
+}
+
+esp_err_t update_pipeline_submit(update_pipeline_t *pipeline, update_pipeline_write_fn fn, void *ctx,
+                                 char *buffer, size_t len) {
+    // Don't bother queueing data the writer would skip anyway
+    if (buffer && pipeline->error != ESP_OK) {
+        update_pipeline_release(pipeline, buffer);
+        return pipeline->error;
+    }
+
+    pipeline_job_t job = {
+        .kind = JOB_WRITE,
+        .fn = fn,
+        .ctx = ctx,
+        .buffer = buffer,
+        .len = len,
+    };
+    xQueueSend(pipeline->jobs, &job, portMAX_DELAY);
+    return pipeline->error;
+}
+
+esp_err_t update_pipeline_flush(update_pipeline_t *pipeline) {
+    pipeline_job_t job = { .kind = JOB_FLUSH };
+    xQueueSend(pipeline->jobs, &job, portMAX_DELAY);
+    xSemaphoreTake(pipeline->flushed, portMAX_DELAY);
+    return pipeline->error;
+}
+
+esp_err_t update_pipeline_error(update_pipeline_t *pipeline) {
+    return pipeline->error;
+}
+
+void update_pipeline_set_idle(update_pipeline_t *pipeline, update_pipeline_idle_fn fn, void *ctx) {
+    pipeline_job_t job = {
+        .kind = JOB_SET_IDLE,
+        .idle_fn = fn,
+        .ctx = ctx,
+    };
+    xQueueSend(pipeline->jobs, &job, portMAX_DELAY);
+}
+
+void update_pipeline_destroy(update_pipeline_t *pipeline) {
+    if (!pipeline) {
+        return;
+    }
+
+    pipeline_job_t job = { .kind = JOB_STOP };
+    xQueueSend(pipeline->jobs, &job, portMAX_DELAY);
+    xSemaphoreTake(pipeline->stopped, portMAX_DELAY);
+
+    pipeline_free(pipeline);
+}
@@ -0,0 +1,111 @@
+#include "project_settings.h"
+#include "update_restart.h"
+#include "web_bank.h"
+#include "asset_cache.h"
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include <errno.h>
+#include <inttypes.h>
+
+static const char* TAG = "UpdateRestart";
+
+#define RESTART_RECORD_MAGIC 0x52535452    // "RSTR"
+
+// Survives esp_restart(); checked against the magic because it holds garbage after a power-on
+typedef struct {
+    uint32_t magic;
+    uint32_t shutdown_ms;
+    uint32_t flush_ms;
+    uint32_t response_delivered;
+} restart_record_t;
+
+static RTC_NOINIT_ATTR restart_record_t restart_record;
+
+static update_restart_stats_t last_stats;
+static bool have_last_stats;
+
+void update_restart_init(void) {
+    uint32_t boot_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (restart_record.magic == RESTART_RECORD_MAGIC && esp_reset_reason() == ESP_RST_SW) {
+        last_stats = (update_restart_stats_t){
+            .shutdown_ms = restart_record.shutdown_ms,
+            .flush_ms = restart_record.flush_ms,
+            .boot_ms = boot_ms,
+            .response_delivered = restart_record.response_delivered != 0,
+        };
+        have_last_stats = true;
+        ESP_LOGI(TAG, "Rebooted after update in %" PRIu32 " ms (shutdown %" PRIu32 " ms, response %s after %" PRIu32 " ms, boot %" PRIu32 " ms)",
+                 last_stats.shutdown_ms + boot_ms, last_stats.shutdown_ms,
+                 last_stats.response_delivered ? "delivered" : "timed out", last_stats.flush_ms, boot_ms);
+    }
+    restart_record.magic = 0;
+}
+
+bool update_restart_last(update_restart_stats_t *stats) {
+    if (have_last_stats) {
+        *stats = last_stats;
+    }
+    return have_last_stats;
+}
+
+// Half-closes the connection and waits for the client to close its side. The client reads our
+// FIN only after every byte sent before it, so its close proves the response was delivered.
+static bool wait_response_delivered(int fd, int64_t deadline_us) {
+    if (fd < 0 || shutdown(fd, SHUT_WR) != 0) {
+        return false;
+    }
+
+    char discard[64];
+    while (true) {
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (left_us <= 0) {
+            return false;
+        }
+        struct timeval timeout = { .tv_sec = left_us / 1000000, .tv_usec = left_us % 1000000 };
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(fd, &read_fds);
+        if (select(fd + 1, &read_fds, NULL, NULL, &timeout) <= 0) {
+            return false;
+        }
+        int len = recv(fd, discard, sizeof(discard), 0);
+        if (len == 0) {
+            return true;
+        }
+        if (len < 0 && errno != EAGAIN && errno != EINTR) {
+            return false;   // Reset: the client went away, we cannot tell what it read
+        }
+    }
+}
+
+void update_restart_after_response(httpd_req_t *req, int64_t completed_us) {
+    int64_t deadline_us = completed_us + (int64_t)UPDATE_RESTART_TIMEOUT_MS * 1000;
+    httpd_handle_t server = req->handle;
+
+    // The session is detached while the async request is open, so the server does not read the socket meanwhile
+    bool delivered = wait_response_delivered(httpd_req_to_sockfd(req), deadline_us);
+    int64_t flushed_us = esp_timer_get_time();
+    httpd_req_async_handler_complete(req);
+    if (!delivered) {
+        ESP_LOGW(TAG, "Update response not confirmed by the client, restarting anyway");
+    }
+
+    // No handler may hold a file on the bank while it is unmounted
+    httpd_stop(server);
+    asset_cache_clear();
+    web_bank_unmount_active();
+
+    int64_t now_us = esp_timer_get_time();
+    restart_record = (restart_record_t){
+        .magic = RESTART_RECORD_MAGIC,
+        .shutdown_ms = (uint32_t)((now_us - completed_us) / 1000),
+        .flush_ms = (uint32_t)((flushed_us - completed_us) / 1000),
+        .response_delivered = delivered,
+    };
+    ESP_LOGI(TAG, "Restarting %" PRIu32 " ms after the update completed", restart_record.shutdown_ms);
+    esp_restart();
+}
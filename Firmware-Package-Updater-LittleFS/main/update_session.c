@@ -0,0 +1,242 @@
+#include "project_settings.h"
+#include "update_session.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/stream_buffer.h>
+
+static const char* TAG = "UpdateSession";
+
+#define NVS_NAMESPACE "update"
+#define NVS_KEY_CHECKPOINT "checkpoint"
+#define POLL_INTERVAL_MS 100
+
+// What NVS keeps for an interrupted upload
+typedef struct {
+    char id[UPDATE_SESSION_ID_MAX_LEN + 1];
+    uint32_t size;
+    package_checkpoint_t checkpoint;
+} session_record_t;
+
+static struct {
+    StreamBufferHandle_t stream;        // Chunk bytes, HTTP task -> session task
+    SemaphoreHandle_t done;             // Given by the session task when the update has ended
+    TaskHandle_t task;                  // Set from init until the end has been collected
+    volatile bool abort;
+    volatile bool finished;
+    esp_err_t err;
+    package_update_result_t result;
+    session_record_t record;            // Id and size of this upload, plus the checkpoint it resumed from
+    bool resume;
+    uint32_t received;                  // Package bytes handed to the session task
+} session;
+
+static esp_err_t record_load(session_record_t *record) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    size_t size = sizeof(session_record_t);
+    err = nvs_get_blob(nvs, NVS_KEY_CHECKPOINT, record, &size);
+    nvs_close(nvs);
+    if (err == ESP_OK && size != sizeof(session_record_t)) {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    return err;
+}
+
+static esp_err_t record_store(const session_record_t *record) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, NVS_KEY_CHECKPOINT, record, sizeof(session_record_t));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+static void record_erase(void) {
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, NVS_KEY_CHECKPOINT);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
+
+// package_recv_fn: waits for chunk data, giving up when the session is stopped or the client goes quiet
+static int session_recv(void *ctx, char *buffer, size_t len) {
+    int64_t idle_since = esp_timer_get_time();
+    while (!session.abort) {
+        size_t received = xStreamBufferReceive(session.stream, buffer, len, pdMS_TO_TICKS(POLL_INTERVAL_MS));
+        if (received > 0) {
+            return (int)received;
+        }
+        if (esp_timer_get_time() - idle_since > (int64_t)UPDATE_SESSION_IDLE_TIMEOUT_MS * 1000) {
+            ESP_LOGW(TAG, "No data for %d ms, pausing the upload", UPDATE_SESSION_IDLE_TIMEOUT_MS);
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// package_checkpoint_fn: the record is written in one NVS commit, so a reboot sees the old or the new one
+static esp_err_t session_checkpoint(void *ctx, const package_checkpoint_t *checkpoint) {
+    session_record_t *record = malloc(sizeof(session_record_t));
+    if (!record) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(record->id, session.record.id, sizeof(record->id));
+    record->size = session.record.size;
+    record->checkpoint = *checkpoint;
+    esp_err_t err = record_store(record);
+    free(record);
+    return err;
+}
+
+static void session_task(void *arg) {
+    package_update_config_t config = {
+        .recv = session_recv,
+        .size = session.record.size,
+        .resume = session.resume ? &session.record.checkpoint : NULL,
+        .checkpoint = session_checkpoint,
+    };
+    session.err = package_update_run(&config, &session.result);
+
+    // Keep the checkpoint only while the same package can still pick up from it
+    if (session.err == ESP_OK || !session.result.resumable) {
+        record_erase();
+    }
+    session.finished = true;
+    xSemaphoreGive(session.done);
+    vTaskDelete(NULL);
+}
+
+// Waits for the session task to end and releases the session
+static void session_join(void) {
+    xSemaphoreTake(session.done, portMAX_DELAY);
+    session.task = NULL;
+}
+
+esp_err_t update_session_init(const char *id, uint32_t size, uint32_t *offset) {
+    if (!id || id[0] == '\0' || strlen(id) > UPDATE_SESSION_ID_MAX_LEN || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Same upload reconnecting while its session is still running: carry on where it is
+    if (update_session_active() && strcmp(session.record.id, id) == 0 && session.record.size == size) {
+        *offset = session.received;
+        return ESP_OK;
+    }
+    update_session_abort();
+
+    if (!session.stream) {
+        session.stream = xStreamBufferCreate(UPDATE_SESSION_STREAM_SIZE, 1);
+        session.done = xSemaphoreCreateBinary();
+        if (!session.stream || !session.done) {
+            ESP_LOGE(TAG, "Failed to allocate session buffers");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    xStreamBufferReset(session.stream);
+
+    // A checkpoint only applies to the package it was taken for
+    session.resume = record_load(&session.record) == ESP_OK &&
+                     strcmp(session.record.id, id) == 0 && session.record.size == size &&
+                     session.record.checkpoint.layout == PACKAGE_CHECKPOINT_LAYOUT;
+    if (!session.resume) {
+        record_erase();
+        memset(&session.record, 0, sizeof(session.record));
+        memcpy(session.record.id, id, strlen(id) + 1);
+        session.record.size = size;
+    }
+    session.received = session.resume ? session.record.checkpoint.offset : 0;
+    session.abort = false;
+    session.finished = false;
+    session.err = ESP_OK;
+    memset(&session.result, 0, sizeof(session.result));
+
+    // Fall back to a floating task on single-core targets
+    BaseType_t core_id = UPDATE_SESSION_TASK_CORE;
+    if (core_id != tskNO_AFFINITY && core_id >= portNUM_PROCESSORS) {
+        core_id = tskNO_AFFINITY;
+    }
+    if (xTaskCreatePinnedToCore(session_task, "update_session", UPDATE_SESSION_TASK_STACK, NULL,
+                                UPDATE_SESSION_TASK_PRIORITY, &session.task, core_id) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start session task");
+        session.task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Upload %s (%" PRIu32 " bytes) %s at offset %" PRIu32, id, size,
+             session.resume ? "resumes" : "starts", session.received);
+    *offset = session.received;
+    return ESP_OK;
+}
+
+esp_err_t update_session_write(uint32_t offset, const char *data, size_t len) {
+    if (!session.task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (offset != session.received) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len > session.record.size - session.received) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t sent = 0;
+    while (sent < len) {
+        if (session.finished) {
+            return ESP_FAIL;
+        }
+        sent += xStreamBufferSend(session.stream, data + sent, len - sent, pdMS_TO_TICKS(POLL_INTERVAL_MS));
+    }
+    session.received += len;
+    return ESP_OK;
+}
+
+uint32_t update_session_offset(void) {
+    return session.received;
+}
+
+uint32_t update_session_size(void) {
+    return session.record.size;
+}
+
+esp_err_t update_session_commit(package_update_result_t *result) {
+    if (!session.task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!session.finished && session.received != session.record.size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    session_join();
+    *result = session.result;
+    return session.err;
+}
+
+bool update_session_active(void) {
+    return session.task && !session.finished;
+}
+
+void update_session_abort(void) {
+    if (!session.task) {
+        return;
+    }
+    session.abort = true;
+    session_join();
+    ESP_LOGI(TAG, "Upload %s stopped at offset %" PRIu32, session.record.id, session.received);
+}
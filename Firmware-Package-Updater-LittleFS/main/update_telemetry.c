@@ -0,0 +1,162 @@
+#include "project_settings.h"
+#include "update_telemetry.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+
+static const char* TAG = "UpdateTelemetry";
+
+// Each counter has one writer; readers only ever load
+static atomic_int phase;
+static atomic_uint_least32_t size;
+static atomic_uint_least32_t received;
+static atomic_uint_least32_t flashed;
+static atomic_uint_least32_t files_written;
+static atomic_uint_least32_t files_skipped;
+static atomic_uint_least32_t recv_ms;
+static atomic_uint_least32_t flash_ms;
+static atomic_uint_least32_t started_ms;
+static atomic_uint_least32_t ended_ms;      // 0 while the update runs
+static atomic_int error;
+static _Atomic(const char *) message;
+
+// Current file name: odd sequence numbers mark a write in progress, readers retry until stable
+static atomic_uint_least32_t file_seq;
+static char file_name[UPDATE_TELEMETRY_FILE_LEN];
+
+// Full-resolution totals, private to their writer task; the atomics above carry the published ms
+static int64_t recv_us_total;
+static int64_t flash_us_total;
+static int64_t last_log_us;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void update_telemetry_begin(uint32_t package_size, uint32_t offset) {
+    recv_us_total = 0;
+    flash_us_total = 0;
+    last_log_us = esp_timer_get_time();
+    atomic_store(&size, package_size);
+    atomic_store(&received, offset);
+    atomic_store(&flashed, 0);
+    atomic_store(&files_written, 0);
+    atomic_store(&files_skipped, 0);
+    atomic_store(&recv_ms, 0);
+    atomic_store(&flash_ms, 0);
+    atomic_store(&error, ESP_OK);
+    atomic_store(&message, NULL);
+    atomic_store(&ended_ms, 0);
+    atomic_store(&started_ms, now_ms());
+    update_telemetry_file("");
+    atomic_store(&phase, UPDATE_PHASE_HEADER);
+}
+
+void update_telemetry_phase(update_phase_t new_phase) {
+    atomic_store(&phase, new_phase);
+}
+
+void update_telemetry_received(uint32_t len, int64_t wait_us) {
+    recv_us_total += wait_us;
+    atomic_fetch_add_explicit(&received, len, memory_order_relaxed);
+    atomic_store_explicit(&recv_ms, (uint32_t)(recv_us_total / 1000), memory_order_relaxed);
+}
+
+void update_telemetry_flashed(uint32_t len, int64_t write_us) {
+    flash_us_total += write_us;
+    atomic_fetch_add_explicit(&flashed, len, memory_order_relaxed);
+    atomic_store_explicit(&flash_ms, (uint32_t)(flash_us_total / 1000), memory_order_relaxed);
+}
+
+void update_telemetry_file(const char *name) {
+    atomic_fetch_add_explicit(&file_seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    strncpy(file_name, name, sizeof(file_name) - 1);
+    file_name[sizeof(file_name) - 1] = '\0';
+    atomic_fetch_add_explicit(&file_seq, 1, memory_order_release);
+}
+
+void update_telemetry_file_done(bool skipped) {
+    atomic_fetch_add_explicit(skipped ? &files_skipped : &files_written, 1, memory_order_relaxed);
+}
+
+void update_telemetry_fail(esp_err_t err, const char *reason) {
+    int expected = ESP_OK;
+    if (atomic_compare_exchange_strong(&error, &expected, err == ESP_OK ? ESP_FAIL : err)) {
+        atomic_store(&message, reason);
+    }
+}
+
+void update_telemetry_end(esp_err_t result) {
+    if (result != ESP_OK) {
+        update_telemetry_fail(result, NULL);
+    }
+    atomic_store(&ended_ms, now_ms());
+    update_telemetry_file("");
+    atomic_store(&phase, result == ESP_OK ? UPDATE_PHASE_DONE : UPDATE_PHASE_FAILED);
+
+    update_telemetry_t t;
+    update_telemetry_snapshot(&t);
+    ESP_LOGI(TAG, "Update %s: %" PRIu32 " of %" PRIu32 " bytes received, %" PRIu32 " bytes flashed, "
+             "%" PRIu32 " files written, %" PRIu32 " skipped | total %" PRIu32 " ms, recv %" PRIu32 " ms, flash %" PRIu32 " ms",
+             update_telemetry_phase_name(t.phase), t.received, t.size, t.flashed, t.files_written, t.files_skipped,
+             t.elapsed_ms, t.recv_ms, t.flash_ms);
+}
+
+void update_telemetry_snapshot(update_telemetry_t *out) {
+    uint32_t seq;
+    do {
+        seq = atomic_load_explicit(&file_seq, memory_order_acquire);
+        memcpy(out->file, file_name, sizeof(out->file));
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&file_seq, memory_order_relaxed));
+
+    out->phase = atomic_load(&phase);
+    out->size = atomic_load(&size);
+    out->received = atomic_load(&received);
+    out->flashed = atomic_load(&flashed);
+    out->files_written = atomic_load(&files_written);
+    out->files_skipped = atomic_load(&files_skipped);
+    out->recv_ms = atomic_load(&recv_ms);
+    out->flash_ms = atomic_load(&flash_ms);
+    out->error = atomic_load(&error);
+    out->message = atomic_load(&message);
+
+    uint32_t started = atomic_load(&started_ms);
+    uint32_t ended = atomic_load(&ended_ms);
+    out->elapsed_ms = (out->phase == UPDATE_PHASE_IDLE) ? 0 : (ended ? ended : now_ms()) - started;
+}
+
+const char *update_telemetry_phase_name(update_phase_t p) {
+    switch (p) {
+    case UPDATE_PHASE_IDLE: return "idle";
+    case UPDATE_PHASE_HEADER: return "header";
+    case UPDATE_PHASE_FIRMWARE: return "firmware";
+    case UPDATE_PHASE_BANK_SYNC: return "bank_sync";
+    case UPDATE_PHASE_FILES: return "files";
+    case UPDATE_PHASE_IMAGE: return "image";
+    case UPDATE_PHASE_PARTITION: return "partition";
+    case UPDATE_PHASE_DONE: return "done";
+    case UPDATE_PHASE_FAILED: return "failed";
+    }
+    return "unknown";
+}
+
+void update_telemetry_log_progress(void) {
+#if UPDATE_TELEMETRY_LOG_INTERVAL_MS > 0
+    int64_t now = esp_timer_get_time();
+    if (now - last_log_us < UPDATE_TELEMETRY_LOG_INTERVAL_MS * 1000LL) {
+        return;
+    }
+    last_log_us = now;
+
+    update_telemetry_t t;
+    update_telemetry_snapshot(&t);
+    ESP_LOGI(TAG, "%s: %" PRIu32 "/%" PRIu32 " bytes received, %" PRIu32 " flashed, %" PRIu32 " files%s%s",
+             update_telemetry_phase_name(t.phase), t.received, t.size, t.flashed, t.files_written,
+             t.file[0] ? ", writing " : "", t.file);
+#endif
+}
@@ -0,0 +1,80 @@
+#include "project_settings.h"
+#include "update_worker.h"
+
+#include <esp_log.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+static const char* TAG = "UpdateWorker";
+
+typedef struct {
+    update_worker_job_fn job;
+    httpd_req_t *req;                   // Async copy of the request
+} worker_job_t;
+
+static QueueHandle_t jobs;
+static atomic_bool busy;                // Admission: set by a successful submit, cleared when the job returns
+
+static void worker_task(void *arg) {
+    worker_job_t job;
+    while (true) {
+        if (xQueueReceive(jobs, &job, portMAX_DELAY) == pdTRUE) {
+            job.job(job.req);
+            atomic_store(&busy, false);
+        }
+    }
+}
+
+esp_err_t update_worker_start(void) {
+    if (jobs) {
+        return ESP_OK;
+    }
+    jobs = xQueueCreate(1, sizeof(worker_job_t));
+    if (!jobs) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Fall back to a floating task on single-core targets
+    BaseType_t core_id = UPDATE_WORKER_TASK_CORE;
+    if (core_id != tskNO_AFFINITY && core_id >= portNUM_PROCESSORS) {
+        core_id = tskNO_AFFINITY;
+    }
+    if (xTaskCreatePinnedToCore(worker_task, "update_worker", UPDATE_WORKER_TASK_STACK, NULL,
+                                UPDATE_WORKER_TASK_PRIORITY, NULL, core_id) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start update worker task");
+        vQueueDelete(jobs);
+        jobs = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t update_worker_submit(httpd_req_t *req, update_worker_job_fn job) {
+    if (!jobs) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Claim the worker before detaching the request, so a refusal costs nothing
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&busy, &expected, true)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    worker_job_t worker_job = { .job = job };
+    esp_err_t err = httpd_req_async_handler_begin(req, &worker_job.req);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to detach request (%s)", esp_err_to_name(err));
+        atomic_store(&busy, false);
+        return err;
+    }
+
+    // The claim guarantees the queue slot is free
+    xQueueSend(jobs, &worker_job, 0);
+    return ESP_OK;
+}
+
+bool update_worker_busy(void) {
+    return atomic_load(&busy);
+}
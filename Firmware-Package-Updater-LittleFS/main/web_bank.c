@@ -0,0 +1,303 @@
+#include "web_bank.h"
+
+#include <esp_littlefs.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+
+#define COPY_BUFFER_SIZE 4096
+#define NAME_MAX_SIZE (PKG_FILE_NAME_MAX_LEN + 1)   // Relative to the bank root, as packages name files
+#define MANIFEST_NAME ".asset_manifest"
+#define ACTIVE_MANIFEST_PATH WEB_BANK_MOUNT_POINT "/" MANIFEST_NAME
+#define NEXT_MANIFEST_PATH WEB_BANK_NEXT_MOUNT_POINT "/" MANIFEST_NAME
+
+static const char* TAG = "WebBank";
+
+static const char *next_label;  // Label of the mounted next bank, NULL when unmounted
+
+typedef struct {
+    asset_manifest_t *active_manifest;
+    asset_manifest_t *next_manifest;
+    uint8_t *buffer;
+    uint32_t kept;
+    uint32_t copied;
+    uint32_t removed;
+    uint64_t copied_bytes;
+} bank_sync_t;
+
+typedef esp_err_t (*bank_file_fn)(bank_sync_t *sync, const char *name);
+
+const esp_partition_t *web_bank_partition(const esp_partition_t *app) {
+    int bank = 1;   // The factory app's first update goes to ota_0, so it must not share web_0
+    if (app && app->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_0 && app->subtype < ESP_PARTITION_SUBTYPE_APP_OTA_MAX) {
+        bank = app->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0;
+    }
+
+    char label[8];
+    snprintf(label, sizeof(label), "web_%d", bank);
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_LITTLEFS, label);
+}
+
+static esp_err_t mount_bank(const esp_partition_t *bank, const char *base_path, bool format_if_mount_failed) {
+    esp_vfs_littlefs_conf_t conf = {
+        .base_path = base_path,
+        .partition_label = bank->label,
+        .partition = NULL,
+        .format_if_mount_failed = format_if_mount_failed,
+        .read_only = false,
+        .dont_mount = false,
+        .grow_on_mount = false,
+    };
+
+    esp_err_t ret = esp_vfs_littlefs_register(&conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount %s at %s (%s)", bank->label, base_path, esp_err_to_name(ret));
+        return ret;
+    }
+
+    size_t total, used;
+    esp_littlefs_info(bank->label, &total, &used);
+    ESP_LOGI(TAG, "Mounted %s at %s, total: %" PRIu32 ", used: %" PRIu32,
+             bank->label, base_path, (uint32_t)total, (uint32_t)used);
+    return ESP_OK;
+}
+
+esp_err_t web_bank_mount_active(void) {
+    const esp_partition_t *bank = web_bank_partition(esp_ota_get_running_partition());
+    if (!bank) {
+        ESP_LOGE(TAG, "No web bank for the running app");
+        return ESP_ERR_NOT_FOUND;
+    }
+    return mount_bank(bank, WEB_BANK_MOUNT_POINT, true);
+}
+
+void web_bank_unmount_active(void) {
+    const esp_partition_t *bank = web_bank_partition(esp_ota_get_running_partition());
+    if (bank) {
+        esp_vfs_littlefs_unregister(bank->label);
+    }
+}
+
+esp_err_t web_bank_mount_next(const esp_partition_t *update_app, bool format_if_mount_failed) {
+    const esp_partition_t *bank = web_bank_partition(update_app);
+    if (!bank) {
+        ESP_LOGE(TAG, "No web bank for %s", update_app ? update_app->label : "(none)");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (bank == web_bank_partition(esp_ota_get_running_partition())) {
+        ESP_LOGE(TAG, "%s is the running bank", bank->label);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    web_bank_unmount_next();
+    esp_err_t ret = mount_bank(bank, WEB_BANK_NEXT_MOUNT_POINT, format_if_mount_failed);
+    if (ret == ESP_OK) {
+        next_label = bank->label;
+    }
+    return ret;
+}
+
+void web_bank_unmount_next(void) {
+    if (next_label) {
+        esp_vfs_littlefs_unregister(next_label);
+        next_label = NULL;
+    }
+}
+
+// `root`/`name`; false if the name is too long for a bank path, which no package can create
+static bool bank_path(char *path, const char *root, const char *name) {
+    int len = snprintf(path, WEB_BANK_PATH_MAX_SIZE, "%s/%s", root, name);
+    if (len < 0 || len >= (int)WEB_BANK_PATH_MAX_SIZE) {
+        ESP_LOGW(TAG, "Name too long: %s", name);
+        return false;
+    }
+    return true;
+}
+
+// Calls `fn` for every regular file below `root`/`dir`, with its name relative to `root`
+static esp_err_t walk_files(bank_sync_t *sync, const char *root, const char *dir, bank_file_fn fn) {
+    char path[WEB_BANK_PATH_MAX_SIZE];
+    if (dir[0] && !bank_path(path, root, dir)) {
+        return ESP_OK;
+    }
+    DIR *d = opendir(dir[0] ? path : root);
+    if (!d) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = ESP_OK;
+    struct dirent *entry;
+    while (err == ESP_OK && (entry = readdir(d)) != NULL) {
+        char name[NAME_MAX_SIZE];
+        int len = snprintf(name, sizeof(name), "%s%s%s", dir, dir[0] ? "/" : "", entry->d_name);
+        if (len >= (int)sizeof(name)) {
+            continue;
+        }
+        if (entry->d_type == DT_DIR) {
+            err = walk_files(sync, root, name, fn);
+        } else if (strncmp(name, MANIFEST_NAME, strlen(MANIFEST_NAME)) != 0) {  // Manifest, its .tmp and .resume copies
+            err = fn(sync, name);
+        }
+    }
+    closedir(d);
+    return err;
+}
+
+// Creates the directories leading up to `path`
+static void make_parent_dirs(const char *path) {
+    char dir[WEB_BANK_PATH_MAX_SIZE];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *slash = strchr(dir + strlen(WEB_BANK_NEXT_MOUNT_POINT) + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            ESP_LOGW(TAG, "Failed to create %s", dir);
+        }
+        *slash = '/';
+    }
+}
+
+static esp_err_t copy_file(bank_sync_t *sync, const char *name, asset_manifest_entry_t *next_entry) {
+    char from[WEB_BANK_PATH_MAX_SIZE], to[WEB_BANK_PATH_MAX_SIZE];
+    if (!bank_path(from, WEB_BANK_MOUNT_POINT, name) || !bank_path(to, WEB_BANK_NEXT_MOUNT_POINT, name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    make_parent_dirs(to);
+
+    FILE *in = fopen(from, "rb");
+    FILE *out = in ? fopen(to, "wb") : NULL;
+    if (!in || !out) {
+        ESP_LOGE(TAG, "Failed to copy %s", name);
+        if (in) fclose(in);
+        return ESP_FAIL;
+    }
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    uint32_t size = 0;
+    size_t read_bytes;
+    bool ok = true;
+    while (ok && (read_bytes = fread(sync->buffer, 1, COPY_BUFFER_SIZE, in)) > 0) {
+        mbedtls_sha256_update(&sha, sync->buffer, read_bytes);
+        ok = fwrite(sync->buffer, 1, read_bytes, out) == read_bytes;
+        size += read_bytes;
+    }
+    ok = !ferror(in) && ok;
+    fclose(in);
+    ok = fclose(out) == 0 && ok;
+
+    uint8_t digest[ASSET_MANIFEST_SHA256_LEN];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to copy %s", name);
+        remove(to);
+        return ESP_FAIL;
+    }
+
+    asset_manifest_set(next_entry, digest, size);
+    sync->copied++;
+    sync->copied_bytes += size;
+    return ESP_OK;
+}
+
+// Running bank file: keep the next bank's copy if it is known to match, copy it otherwise
+static esp_err_t sync_file(bank_sync_t *sync, const char *name) {
+    char next_path[WEB_BANK_PATH_MAX_SIZE];
+    if (!bank_path(next_path, WEB_BANK_NEXT_MOUNT_POINT, name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    asset_manifest_entry_t *active = asset_manifest_find(sync->active_manifest, name);
+    if (active && active->valid &&
+        asset_manifest_unchanged(sync->next_manifest, name, next_path, active->sha256, active->size)) {
+        sync->kept++;
+        return ESP_OK;
+    }
+
+    asset_manifest_entry_t *next = asset_manifest_get(sync->next_manifest, name);
+    if (!next) {
+        return ESP_ERR_NO_MEM;
+    }
+    next->valid = false;
+    return copy_file(sync, name, next);
+}
+
+// Next bank file: drop it if the running bank no longer has it
+static esp_err_t prune_file(bank_sync_t *sync, const char *name) {
+    char active_path[WEB_BANK_PATH_MAX_SIZE];
+    struct stat st;
+    if (bank_path(active_path, WEB_BANK_MOUNT_POINT, name) && stat(active_path, &st) == 0) {
+        return ESP_OK;
+    }
+
+    char next_path[WEB_BANK_PATH_MAX_SIZE];
+    if (bank_path(next_path, WEB_BANK_NEXT_MOUNT_POINT, name)) {
+        remove(next_path);
+    }
+    asset_manifest_entry_t *next = asset_manifest_find(sync->next_manifest, name);
+    if (next) {
+        next->valid = false;
+    }
+    sync->removed++;
+    return ESP_OK;
+}
+
+esp_err_t web_bank_sync(asset_manifest_t *active_manifest, asset_manifest_t *next_manifest) {
+    int64_t start = esp_timer_get_time();
+    bank_sync_t sync = {
+        .active_manifest = active_manifest,
+        .next_manifest = next_manifest,
+        .buffer = malloc(COPY_BUFFER_SIZE),
+    };
+    if (!sync.buffer) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Removing entries can disturb a directory listing in progress, so prune until a pass removes nothing
+    esp_err_t err;
+    uint32_t removed;
+    do {
+        removed = sync.removed;
+        err = walk_files(&sync, WEB_BANK_NEXT_MOUNT_POINT, "", prune_file);
+    } while (err == ESP_OK && sync.removed != removed);
+    if (err == ESP_OK) {
+        err = walk_files(&sync, WEB_BANK_MOUNT_POINT, "", sync_file);
+    }
+    free(sync.buffer);
+
+    ESP_LOGI(TAG, "Bank sync: %" PRIu32 " files kept, %" PRIu32 " copied (%" PRIu64 " bytes), %" PRIu32 " removed in %" PRId64 " ms",
+             sync.kept, sync.copied, sync.copied_bytes, sync.removed, (esp_timer_get_time() - start) / 1000);
+    return err;
+}
+
+esp_err_t web_bank_copy_active(const esp_partition_t *update_app) {
+    esp_err_t err = web_bank_mount_next(update_app, true);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // The stored manifest goes first, so an interrupted copy is redone in full next time
+    asset_manifest_t *next_manifest = asset_manifest_load(NEXT_MANIFEST_PATH);
+    asset_manifest_t *active_manifest = asset_manifest_load(ACTIVE_MANIFEST_PATH);
+    remove(NEXT_MANIFEST_PATH);
+    err = (next_manifest && active_manifest) ? web_bank_sync(active_manifest, next_manifest) : ESP_ERR_NO_MEM;
+    if (err == ESP_OK) {
+        err = asset_manifest_save(next_manifest, NEXT_MANIFEST_PATH);
+    }
+    asset_manifest_destroy(active_manifest);
+    asset_manifest_destroy(next_manifest);
+    web_bank_unmount_next();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to copy the running bank to %s (%s)", web_bank_partition(update_app)->label, esp_err_to_name(err));
+    }
+    return err;
+}
@@ -1,5 +1,17 @@
 #include "project_settings.h"
 #include "web_server.h"
+#include "package_update.h"
+#include "update_session.h"
+#include "update_worker.h"
+#include "update_telemetry.h"
+#include "update_restart.h"
+#include "asset_manifest.h"
+#include "asset_cache.h"
+#include "asset_bundle.h"
+#include "embedded_assets.h"
+#include "http_ranges.h"
+#include "mime_types.h"
+#include "web_bank.h"
 
 #include <esp_http_server.h>
 #include <esp_log.h>
@@ -7,12 +19,18 @@
 #include <esp_netif.h>
 #include <esp_event.h>
 #include <esp_ota_ops.h>
+#include <esp_image_format.h>
+#include <esp_timer.h>
 #include <esp_littlefs.h>
+#include <sdkconfig.h>
 #include <string.h>
+#include <strings.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <nvs_flash.h>
 #include <nvs.h>
 #include <dirent.h>
+#include <sys/stat.h>
 #include <inttypes.h>
 
 #include "cJSON.h"
@@ -22,278 +40,832 @@ extern const char* VERSION;
 
 static const char* TAG = "WebServer";
 
-// Define LittleFS Mount Path
-#define MOUNT_POINT "/web"
+// Define LittleFS Mount Path (the running firmware's web bank)
+#define MOUNT_POINT WEB_BANK_MOUNT_POINT
+#define ASSET_MANIFEST_PATH MOUNT_POINT "/.asset_manifest"  // Content hashes of the files on the web partition
 
 // Get MIN Utility Function
 #ifndef MIN
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #endif
 
-/* Generic file serving function */
-static esp_err_t file_get_handler(httpd_req_t *req, const char *file_path, const char *mime_type) {
-    FILE *file = fopen(file_path, "r");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open file: %s", file_path);
-        httpd_resp_send_404(req);
-        return ESP_FAIL;
+// true if the request's Accept-Encoding lists gzip (or "*") without refusing it with q=0
+static bool accepts_gzip(httpd_req_t *req) {
+    char value[128];
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
     }
 
-    httpd_resp_set_type(req, mime_type);
-    char buffer[512];
-    size_t read_bytes;
-    while ((read_bytes = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        httpd_resp_send_chunk(req, buffer, read_bytes);
+    char *save = NULL;
+    for (char *token = strtok_r(value, ",", &save); token; token = strtok_r(NULL, ",", &save)) {
+        while (*token == ' ' || *token == '\t') {
+            token++;
+        }
+        size_t name_len = strcspn(token, " \t;");
+        if (!((name_len == 4 && strncasecmp(token, "gzip", 4) == 0) || (name_len == 1 && token[0] == '*'))) {
+            continue;
+        }
+        const char *q = strstr(token + name_len, "q=");
+        return !q || strtod(q + 2, NULL) > 0;
     }
-    fclose(file);
-    httpd_resp_send_chunk(req, NULL, 0);
-    return ESP_OK;
+    return false;
 }
 
+// Content hashes of the files being served. Updates write the other bank, so the running bank
+// does not change until the next boot: the manifest is loaded once and read without a lock.
+static asset_manifest_t *served_manifest;
+
+// Cache-Control by MIME type. Asset names carry no content hash, so anything a firmware update can
+// change is revalidated on every use; the ETag makes that a 304 without a body.
+static const struct {
+    const char *mime_prefix;
+    const char *cache_control;
+} cache_policies[] = {
+    { "text/html", WEB_CACHE_CONTROL_DOCUMENT },
+    { "application/json", WEB_CACHE_CONTROL_DOCUMENT },
+    { "text/css", WEB_CACHE_CONTROL_CODE },
+    { "application/javascript", WEB_CACHE_CONTROL_CODE },
+    { "image/", WEB_CACHE_CONTROL_MEDIA },
+    { "font/", WEB_CACHE_CONTROL_MEDIA },
+};
 
-/************************************/
-/* Packaged Firmware Update Utility */
-/************************************/
+static const char *cache_control_for(const char *mime_type) {
+    for (size_t i = 0; i < sizeof(cache_policies) / sizeof(cache_policies[0]); i++) {
+        if (strncmp(mime_type, cache_policies[i].mime_prefix, strlen(cache_policies[i].mime_prefix)) == 0) {
+            return cache_policies[i].cache_control;
+        }
+    }
+    return WEB_CACHE_CONTROL_DOCUMENT;
+}
 
-// Define Package Header Format
-#define PACKAGE_MAGIC "ESP_UPDATE"
-#define HEADER_SIZE 10 + sizeof(uint32_t) * 4  // 10-byte magic + 4x uint32_t values
-#define WRITE_BLOCK_SIZE 8192 // LittleFS Default: 4096 | LittleFS Default: 8192
+// Manifest entry of a file below MOUNT_POINT, or NULL if its content hash is not known
+static const asset_manifest_entry_t *served_entry(const char *file_path) {
+    if (!served_manifest) {
+        return NULL;
+    }
+    const asset_manifest_entry_t *entry = asset_manifest_find(served_manifest, file_path + strlen(MOUNT_POINT "/"));
+    return (entry && entry->valid) ? entry : NULL;
+}
 
-// Struct for package header
-typedef struct {
-    uint32_t firmware_size;
-    uint32_t littlefs_size;
-    uint32_t firmware_offset;
-    uint32_t littlefs_offset;
-    uint32_t version;
-} package_header_t;
-
-// Handles the firmware update request
-static esp_err_t package_upload_handler(httpd_req_t *req) {
-    char *write_buffer = heap_caps_malloc(WRITE_BLOCK_SIZE, MALLOC_CAP_DMA);
-    if (!write_buffer) {
-        ESP_LOGE(TAG, "Failed to allocate write buffer");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
+// Strong ETag: the leading ETAG_HASH_BYTES of the file's SHA-256, quoted
+#define ETAG_HASH_BYTES 16
+static void format_etag(const uint8_t *sha256, char *etag) {
+    etag[0] = '"';
+    for (int i = 0; i < ETAG_HASH_BYTES; i++) {
+        sprintf(etag + 1 + 2 * i, "%02x", sha256[i]);
     }
+    strcpy(etag + 1 + 2 * ETAG_HASH_BYTES, "\"");
+}
 
-    int remaining = req->content_len;
-    ESP_LOGI(TAG, "Update package upload started. Size: %" PRIu32 " bytes", (uint32_t)remaining);
+// true if If-None-Match lists `etag` or is "*". Tags are quoted hex, so a substring match is exact;
+// a W/ prefix does not matter for If-None-Match (weak comparison).
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+    char value[160];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strstr(value, etag) != NULL || strcmp(value, "*") == 0;
+}
 
-    // Read the package header
-    int recv_len = httpd_req_recv(req, write_buffer, MIN(remaining, HEADER_SIZE));
-    if (recv_len <= 0) {
-        ESP_LOGE(TAG, "Error receiving package header");
-        free(write_buffer);
-        return ESP_FAIL;
+static void set_asset_headers(httpd_req_t *req, const char *mime_type, bool gzip, const char *etag) {
+    httpd_resp_set_type(req, mime_type);
+    httpd_resp_set_hdr(req, "Cache-Control", cache_control_for(mime_type));
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+    if (gzip) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+    if (etag) {
+        httpd_resp_set_hdr(req, "ETag", etag);
     }
+}
+
+// What a cached copy of `path` must match: the manifest hash when there is one, else size and mtime
+static bool asset_validator(const char *path, const asset_manifest_entry_t *entry, asset_cache_validator_t *validator) {
+    memset(validator, 0, sizeof(*validator));
+    if (entry) {
+        validator->hashed = true;
+        memcpy(validator->sha256, entry->sha256, ASSET_CACHE_SHA256_LEN);
+        validator->size = entry->size;
+        return true;
+    }
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+    validator->size = st.st_size;
+    validator->mtime = st.st_mtime;
+    return true;
+}
+
+// A send larger than lwIP's send buffer only blocks until the window moves, so bodies go out
+// in pieces of one send buffer
+#ifdef CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#define FILE_SEND_WINDOW CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#else
+#define FILE_SEND_WINDOW 5744
+#endif
+#define RESPONSE_HEADER_MAX 512         // Status line and headers written by stream_body()
+#define BYTERANGES_BOUNDARY "3d6b6a416f9b5"     // Separates the parts of a multi-range response
 
-    // Check magic header
-    if (memcmp(write_buffer, PACKAGE_MAGIC, 10) != 0) {
-        ESP_LOGE(TAG, "Invalid package magic header");
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid package format");
-        free(write_buffer);
+// Where a response body comes from
+typedef struct {
+    const uint8_t *data;                // Mapped or cached memory, sent without a copy when whole
+    FILE *file;                         // Or an open file, seeked for ranges
+    const esp_partition_t *partition;   // Or a flash partition
+    uint32_t size;
+    uint32_t position;                  // Next file offset, so sequential reads need no seek
+} body_source_t;
+
+static esp_err_t source_read(body_source_t *source, uint32_t offset, char *buffer, size_t len) {
+    if (source->data) {
+        memcpy(buffer, source->data + offset, len);
+        return ESP_OK;
+    }
+    if (source->partition) {
+        return esp_partition_read(source->partition, offset, buffer, len);
+    }
+    if (offset != source->position && fseek(source->file, offset, SEEK_SET) != 0) {
         return ESP_FAIL;
     }
+    size_t read_bytes = fread(buffer, 1, len, source->file);
+    source->position = offset + read_bytes;
+    return (read_bytes == len) ? ESP_OK : ESP_FAIL;
+}
 
-    // Extract firmware & LittleFS sizes and offsets
-    package_header_t pkg_header;
-    memcpy(&pkg_header.firmware_size, write_buffer + 10, sizeof(uint32_t));
-    memcpy(&pkg_header.littlefs_size, write_buffer + 10 + sizeof(uint32_t), sizeof(uint32_t));
-    memcpy(&pkg_header.firmware_offset, write_buffer + 10 + (2 * sizeof(uint32_t)), sizeof(uint32_t));
-    memcpy(&pkg_header.littlefs_offset, write_buffer + 10 + (3 * sizeof(uint32_t)), sizeof(uint32_t));
+// Response bytes collected into send-window sized pieces
+typedef struct {
+    httpd_req_t *req;
+    char *buffer;
+    size_t size;
+    size_t used;
+} body_writer_t;
+
+static esp_err_t writer_flush(body_writer_t *writer) {
+    const char *data = writer->buffer;
+    size_t len = writer->used;
+    writer->used = 0;
+    while (len > 0) {
+        int sent = httpd_send(writer->req, data, len);
+        if (sent < 0) {
+            return ESP_FAIL;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return ESP_OK;
+}
 
-    ESP_LOGI(TAG, "Package contains: Firmware (%" PRIu32 " bytes), LittleFS (%" PRIu32 " bytes)", 
-         (uint32_t)pkg_header.firmware_size, (uint32_t)pkg_header.littlefs_size);
+static esp_err_t writer_append(body_writer_t *writer, const char *data, size_t len) {
+    while (len > 0) {
+        if (writer->used == writer->size && writer_flush(writer) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        size_t n = MIN(len, writer->size - writer->used);
+        memcpy(writer->buffer + writer->used, data, n);
+        writer->used += n;
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+// Reads `len` body bytes from `offset` straight into the send buffer
+static esp_err_t writer_copy(body_writer_t *writer, body_source_t *source, uint32_t offset, uint32_t len) {
+    while (len > 0) {
+        if (writer->used == writer->size && writer_flush(writer) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        size_t n = MIN(len, writer->size - writer->used);
+        if (source_read(source, offset, writer->buffer + writer->used, n) != ESP_OK) {
+            ESP_LOGE(TAG, "Body read failed at offset %" PRIu32, offset);
+            return ESP_FAIL;
+        }
+        writer->used += n;
+        offset += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
 
-    remaining -= recv_len;
+// Header of one part of a multipart/byteranges body, written in pieces so a MIME type of any length
+// goes out whole and the bytes sent always match part_header_length()
+#define PART_HEADER_START "\r\n--" BYTERANGES_BOUNDARY "\r\nContent-Type: "
+#define BYTERANGES_END "\r\n--" BYTERANGES_BOUNDARY "--\r\n"
 
-    ESP_LOGI(TAG, "Remaining after package header (%d bytes)",remaining);
+static int format_part_range(char *out, size_t size, const http_range_t *range, uint32_t total) {
+    return snprintf(out, size, "\r\nContent-Range: bytes %" PRIu32 "-%" PRIu32 "/%" PRIu32 "\r\n\r\n", range->start, range->end, total);
+}
 
-    // **Unmount LittleFS BEFORE updating firmware**
-    ESP_LOGI(TAG, "Unmounting LittleFS before firmware update...");
-    esp_vfs_littlefs_unregister("web");
-    vTaskDelay(pdMS_TO_TICKS(500)); // Allow cleanup
+static size_t part_header_length(const char *mime_type, const http_range_t *range, uint32_t total) {
+    return strlen(PART_HEADER_START) + strlen(mime_type) + format_part_range(NULL, 0, range, total);
+}
 
-    // **Start Firmware Update (OTA)**
-    // Get update partition for firmware
-    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
-    esp_ota_handle_t ota_handle;
-    if (esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &ota_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start OTA update");
-        free(write_buffer);
+static esp_err_t append_part_header(body_writer_t *writer, const char *mime_type, const http_range_t *range, uint32_t total) {
+    char part_range[64];    // Fits three 32-bit offsets
+    int part_range_len = format_part_range(part_range, sizeof(part_range), range, total);
+    if (writer_append(writer, PART_HEADER_START, strlen(PART_HEADER_START)) != ESP_OK ||
+        writer_append(writer, mime_type, strlen(mime_type)) != ESP_OK) {
         return ESP_FAIL;
     }
+    return writer_append(writer, part_range, part_range_len);
+}
 
-    uint32_t firmware_written = 0;
-    uint32_t firmware_remaining = pkg_header.firmware_size;
-    while (firmware_written < pkg_header.firmware_size) {
-        recv_len = httpd_req_recv(req, write_buffer, MIN(firmware_remaining, WRITE_BLOCK_SIZE));
-        if (recv_len <= 0) {
-            ESP_LOGE(TAG, "Firmware upload failed");
-            esp_ota_end(ota_handle);
-            free(write_buffer);
-            return ESP_FAIL;
-        }
+// Headers every asset response carries, 304s included, appended to the `len` bytes already in
+// `buffer` (RESPONSE_HEADER_MAX bytes); returns the new length, or -1 if they do not fit
+static int append_asset_headers(char *buffer, int len, const char *mime_type, bool gzip, const char *etag,
+                                const char *extra_headers) {
+    if (len < 0 || len >= RESPONSE_HEADER_MAX) {
+        return -1;
+    }
+    int n = snprintf(buffer + len, RESPONSE_HEADER_MAX - len,
+                     "Cache-Control: %s\r\nVary: Accept-Encoding\r\nAccept-Ranges: bytes\r\n%s%s%s%s%s\r\n",
+                     cache_control_for(mime_type),
+                     gzip ? "Content-Encoding: gzip\r\n" : "",
+                     etag ? "ETag: " : "", etag ? etag : "", etag ? "\r\n" : "",
+                     extra_headers ? extra_headers : "");
+    return (n < 0 || n >= RESPONSE_HEADER_MAX - len) ? -1 : len + n;
+}
 
-        if (esp_ota_write(ota_handle, write_buffer, recv_len) != ESP_OK) {
-            ESP_LOGE(TAG, "Firmware write failed");
-            esp_ota_end(ota_handle);
-            free(write_buffer);
-            return ESP_FAIL;
+/* Streams a body as one response with a Content-Length instead of chunked encoding, so each send
+ * carries payload only and the client knows the size up front. The headers go out in the same send
+ * as the first payload; the buffer is one send window, or just enough for a smaller body. With
+ * `ranges` (count > 0) the response is a 206 with those ranges only, as multipart/byteranges when
+ * there are several. esp_http_server has no call that sends headers with a length but without the
+ * body, so they are written here. */
+static esp_err_t stream_body(httpd_req_t *req, body_source_t *source, const char *mime_type, bool gzip, const char *etag,
+                             const char *extra_headers, const http_range_t *ranges, int count) {
+    uint64_t length = source->size;
+    if (count == 1) {
+        length = ranges[0].end - ranges[0].start + 1;
+    } else if (count > 1) {
+        length = strlen(BYTERANGES_END);
+        for (int i = 0; i < count; i++) {
+            length += part_header_length(mime_type, &ranges[i], source->size) + (ranges[i].end - ranges[i].start + 1);
         }
+    }
 
-        firmware_written += recv_len;
-        firmware_remaining -= recv_len;
-        remaining -= recv_len;
-        ESP_LOGI(TAG, "Writing firmware: current remaining (%d bytes), firmware written (%d bytes), firmware remaining (%d bytes)",remaining, firmware_written, firmware_remaining);
+    body_writer_t writer = { .req = req, .size = RESPONSE_HEADER_MAX + MIN(length, (uint64_t)FILE_SEND_WINDOW) };
+    writer.buffer = malloc(writer.size);
+    if (!writer.buffer) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
     }
 
-    // Finalize OTA
-    if (esp_ota_end(ota_handle) != ESP_OK || esp_ota_set_boot_partition(update_partition) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to complete OTA update");
-        free(write_buffer);
+    char content_range[64] = "";
+    if (count == 1) {
+        snprintf(content_range, sizeof(content_range), "Content-Range: bytes %" PRIu32 "-%" PRIu32 "/%" PRIu32 "\r\n",
+                 ranges[0].start, ranges[0].end, source->size);
+    }
+    int header_len = snprintf(writer.buffer, RESPONSE_HEADER_MAX,
+                              "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %" PRIu64 "\r\n%s",
+                              count > 0 ? "206 Partial Content" : "200 OK",
+                              count > 1 ? "multipart/byteranges; boundary=" BYTERANGES_BOUNDARY : mime_type,
+                              length, content_range);
+    header_len = append_asset_headers(writer.buffer, header_len, mime_type, gzip, etag, extra_headers);
+    if (header_len < 0) {
+        free(writer.buffer);
+        httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    writer.used = header_len;
 
-    ESP_LOGI(TAG, "Firmware update complete!");
+    // A failure past this point cannot be reported in the response; failing closes the connection
+    esp_err_t err = ESP_OK;
+    if (count == 0) {
+        err = writer_copy(&writer, source, 0, source->size);
+    }
+    for (int i = 0; err == ESP_OK && i < count; i++) {
+        if (count > 1) {
+            err = append_part_header(&writer, mime_type, &ranges[i], source->size);
+        }
+        if (err == ESP_OK) {
+            err = writer_copy(&writer, source, ranges[i].start, ranges[i].end - ranges[i].start + 1);
+        }
+    }
+    if (err == ESP_OK && count > 1) {
+        err = writer_append(&writer, BYTERANGES_END, strlen(BYTERANGES_END));
+    }
+    if (err == ESP_OK) {
+        err = writer_flush(&writer);
+    }
+    free(writer.buffer);
+    return err;
+}
 
-    // **Remount LittleFS After updating firmware**
-    esp_vfs_littlefs_conf_t conf = {
-        .base_path = MOUNT_POINT,
-        .partition_label = "web",
-        .format_if_mount_failed = true,
-        .read_only = false
-    };
-    esp_err_t ret = esp_vfs_littlefs_register(&conf);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to remount LittleFS after firmware update: %s", esp_err_to_name(ret));
+// 304 with the caching headers and ETag of the response it stands for. httpd_resp_send() would add
+// Content-Length: 0, which a 304 must not carry (it would describe the client's copy), so the headers
+// are written as stream_body() writes them.
+static esp_err_t send_not_modified(httpd_req_t *req, const char *mime_type, const char *etag) {
+    char headers[RESPONSE_HEADER_MAX];
+    int len = snprintf(headers, sizeof(headers), "HTTP/1.1 304 Not Modified\r\n");
+    len = append_asset_headers(headers, len, mime_type, false, etag, NULL);
+    if (len < 0) {
+        httpd_resp_send_500(req);
         return ESP_FAIL;
     }
-    ESP_LOGI(TAG, "LittleFS remounted successfully.");
+    body_writer_t writer = { .req = req, .buffer = headers, .size = sizeof(headers), .used = len };
+    return writer_flush(&writer);
+}
 
-    // **Handle LittleFS File Updates**
-    while (remaining > 0) {
-        uint16_t file_name_len;
-        uint32_t file_size;
-
-        // Read 6-byte file metadata (file_name_len + file_size)
-        recv_len = httpd_req_recv(req, write_buffer, 6);
-        if (recv_len != 6) {
-            ESP_LOGE(TAG, "Failed to read file metadata");
-            free(write_buffer);
-            return ESP_FAIL;
-        }
+// Ranges the request asks for; If-Range with a tag other than the current one (or a date, as no
+// Last-Modified is sent) means the client's copy is stale, and it gets the whole body
+static int requested_ranges(httpd_req_t *req, uint32_t size, const char *etag, http_range_t *ranges) {
+    char value[128];
+    if (httpd_req_get_hdr_value_str(req, "Range", value, sizeof(value)) != ESP_OK) {
+        return 0;
+    }
+    char if_range[64];
+    if (httpd_req_get_hdr_value_len(req, "If-Range") > 0 &&
+        (!etag || httpd_req_get_hdr_value_str(req, "If-Range", if_range, sizeof(if_range)) != ESP_OK || strcmp(if_range, etag) != 0)) {
+        return 0;
+    }
+    return http_ranges_parse(value, size, ranges, HTTP_RANGES_MAX);
+}
 
-        // Extract values correctly (Little-Endian Fix)
-        file_name_len = (uint16_t)((write_buffer[1] << 8) | write_buffer[0]);
-        file_size = (uint32_t)((write_buffer[5] << 24) | (write_buffer[4] << 16) | (write_buffer[3] << 8) | write_buffer[2]);
+// Sends a body whole or in the ranges the request asks for; memory sent whole goes out in one httpd_resp_send()
+static esp_err_t send_asset(httpd_req_t *req, body_source_t *source, const char *mime_type, bool gzip, const char *etag,
+                            const char *extra_headers) {
+    http_range_t ranges[HTTP_RANGES_MAX];
+    int count = requested_ranges(req, source->size, etag, ranges);
+    if (count < 0) {
+        char content_range[32];
+        snprintf(content_range, sizeof(content_range), "bytes */%" PRIu32, source->size);
+        httpd_resp_set_status(req, "416 Range Not Satisfiable");
+        httpd_resp_set_hdr(req, "Content-Range", content_range);
+        return httpd_resp_send(req, NULL, 0);
+    }
+    if (count == 0 && source->data && !extra_headers) {
+        set_asset_headers(req, mime_type, gzip, etag);
+        return httpd_resp_send(req, (const char *)source->data, source->size);
+    }
+    return stream_body(req, source, mime_type, gzip, etag, extra_headers, ranges, count);
+}
 
-        ESP_LOGI(TAG, "Extracted file metadata -> File Name Length: %" PRIu32 ", File Size: %" PRIu32, 
-         (uint32_t)file_name_len, (uint32_t)file_size);
+// Sends an asset from the mapped bundle; the index holds its type and hash
+static esp_err_t send_bundled(httpd_req_t *req, const asset_bundle_file_t *file, bool gzip) {
+    char etag[2 * ETAG_HASH_BYTES + 3];
+    format_etag(file->sha256, etag);
+    if (etag_matches(req, etag)) {
+        return send_not_modified(req, file->mime_type, etag);
+    }
+    body_source_t source = { .data = file->data, .size = file->length };
+    return send_asset(req, &source, file->mime_type, gzip, etag, NULL);
+}
 
-        // Validate File Name Length (1-255 bytes)
-        if (file_name_len < 1 || file_name_len > 255) {
-            ESP_LOGE(TAG, "Invalid file name length: %d", file_name_len);
-            free(write_buffer);
-            return ESP_FAIL;
-        }        
+// Sends an asset compiled into the firmware; its ETags were worked out at build time
+static esp_err_t send_embedded(httpd_req_t *req, const embedded_asset_t *asset, bool gzip) {
+    gzip = gzip && asset->gzip_data;
+    const char *etag = gzip ? asset->gzip_etag : asset->etag;
+    if (etag_matches(req, etag)) {
+        return send_not_modified(req, asset->mime_type, etag);
+    }
+    body_source_t source = {
+        .data = gzip ? asset->gzip_data : asset->data,
+        .size = gzip ? asset->gzip_length : asset->length,
+    };
+    return send_asset(req, &source, asset->mime_type, gzip, etag, NULL);
+}
 
-        // Validate File Size (1MB limit)
-        if (file_size > 1024 * 1024) {
-            ESP_LOGE(TAG, "Invalid file size: %d", file_size);
-            free(write_buffer);
-            return ESP_FAIL;
+/* Generic file serving function: sends the precompressed "<file>.gz" instead when the client accepts
+ * gzip, and answers 304 from the manifest alone when the client already holds the content. Assets in
+ * the running slot's bundle are sent from mapped flash; hot files from the web bank come from the
+ * in-RAM asset cache in a single send. Files the bank lacks (or all of them while it is not mounted)
+ * fall back to the `embedded` copy compiled into the firmware, if there is one. Returns
+ * ESP_ERR_NOT_FOUND without sending anything when no source holds the file. */
+static esp_err_t file_get_handler(httpd_req_t *req, const char *file_path, const char *mime_type,
+                                  const embedded_asset_t *embedded) {
+    char gzip_path[128];
+    snprintf(gzip_path, sizeof(gzip_path), "%s.gz", file_path);
+    bool gzip = accepts_gzip(req);
+
+    asset_bundle_file_t bundled;
+    if (gzip && asset_bundle_find(gzip_path + strlen(MOUNT_POINT "/"), &bundled)) {
+        return send_bundled(req, &bundled, true);
+    }
+    if (asset_bundle_find(file_path + strlen(MOUNT_POINT "/"), &bundled)) {
+        return send_bundled(req, &bundled, false);
+    }
+
+    // The manifest tells whether the bank has a .gz variant; files it does not know are probed
+    const char *path = file_path;
+    if (gzip) {
+        struct stat st;
+        if (served_entry(gzip_path) || (!served_entry(file_path) && stat(gzip_path, &st) == 0)) {
+            path = gzip_path;
         }
+    }
 
-        remaining -= 6;
+    char etag[2 * ETAG_HASH_BYTES + 3];
+    const asset_manifest_entry_t *entry = served_entry(path);
+    if (entry) {
+        format_etag(entry->sha256, etag);
+        if (etag_matches(req, etag)) {
+            return send_not_modified(req, mime_type, etag);
+        }
+    }
 
-        // Read file name
-        recv_len = httpd_req_recv(req, write_buffer, file_name_len);
-        if (recv_len != file_name_len) {
-            ESP_LOGE(TAG, "Error: Expected file name length %d but received %d", file_name_len, recv_len);
-            free(write_buffer);
-            return ESP_FAIL;
+    asset_cache_validator_t validator;
+    if (asset_validator(path, entry, &validator)) {
+        asset_cache_entry_t *cached = asset_cache_acquire(path, &validator);
+        if (!cached) {
+            cached = asset_cache_load(path, &validator);
         }
+        if (cached) {
+            size_t len;
+            body_source_t source = { .data = asset_cache_data(cached, &len) };
+            source.size = len;
+            esp_err_t err = send_asset(req, &source, mime_type, path == gzip_path, entry ? etag : NULL, NULL);
+            asset_cache_release(cached);
+            return err;
+        }
+    }
 
-        char file_name[256];
-        memcpy(file_name, write_buffer, file_name_len);
-        file_name[file_name_len] = '\0';
+    // Too large for the cache (or no cache): stream it from flash
+    FILE *file = fopen(path, "r");
+    if (!file && path == gzip_path) {
+        path = file_path;
+        entry = served_entry(path);
+        if (entry) {
+            format_etag(entry->sha256, etag);
+        }
+        file = fopen(path, "r");
+    }
+    if (!file && embedded) {
+        ESP_LOGD(TAG, "%s is not in the web bank, sending the embedded copy", file_path);
+        return send_embedded(req, embedded, gzip);
+    }
+    if (!file) {
+        return ESP_ERR_NOT_FOUND;
+    }
 
-        remaining -= recv_len;
+    struct stat st;
+    body_source_t source = { .file = file };
+    esp_err_t err = ESP_FAIL;
+    if (fstat(fileno(file), &st) == 0) {
+        source.size = st.st_size;
+        err = send_asset(req, &source, mime_type, path == gzip_path, entry ? etag : NULL, NULL);
+    } else {
+        httpd_resp_send_500(req);
+    }
+    fclose(file);
+    return err;
+}
 
-        char filepath[300];
-        
-        // Ensure the file path is within bounds
-        if (strlen(file_name) > 250) {  // Leave space for "/web/ (MOUNT_POINT)"
-            ESP_LOGE(TAG, "File path too long: %s", file_name);
-            free(write_buffer);
-            return ESP_FAIL;
+
+/************************************/
+/* Packaged Firmware Update Utility */
+/************************************/
+
+// Set while the worker runs a single-request upload; its progress is in update_telemetry
+static volatile bool upload_active;
+
+// httpd_req_recv() as a package source for package_update_run()
+static int request_recv(void *ctx, char *buffer, size_t len) {
+    return httpd_req_recv((httpd_req_t *)ctx, buffer, len);
+}
+
+// Sends the outcome of a finished update
+static esp_err_t send_update_result(httpd_req_t *req, esp_err_t err, const package_update_result_t *result) {
+    if (err != ESP_OK) {
+        if (result->message) {
+            httpd_resp_send_err(req, result->status, result->message);
         }
+        return ESP_FAIL;
+    }
 
-        snprintf(filepath, sizeof(filepath), "%s/%s", MOUNT_POINT, file_name);
-        ESP_LOGI(TAG, "Writing file: %s (Size: %d bytes)", filepath, file_size);
+    // Confirm update
+    char response[128];
+    snprintf(response, sizeof(response), "Update complete! %" PRIu32 " unchanged files skipped (%" PRIu64 " bytes). Device rebooting...",
+             result->files_skipped, result->bytes_skipped);
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
+
+// Admission control: a second update is turned away at once instead of waiting for the first
+static esp_err_t send_update_busy(httpd_req_t *req) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "10");
+    httpd_resp_sendstr(req, "Another update is in progress");
+    return ESP_FAIL;
+}
 
-        // Open file in binary mode to prevent corruption
-        FILE *file = fopen(filepath, "wb");
-        if (!file) {
-            ESP_LOGE(TAG, "Failed to open file for writing: %s", filepath);
-            free(write_buffer);
+// Sends {"offset": N} with the given status line
+static esp_err_t send_session_offset(httpd_req_t *req, const char *status) {
+    char json_response[64];
+    snprintf(json_response, sizeof(json_response), "{\"offset\": %" PRIu32 "}", update_session_offset());
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json_response);
+    return ESP_OK;
+}
+
+// Worker job for /update_firmware: receives and applies the whole package
+static void package_upload_job(httpd_req_t *req) {
+    upload_active = true;
+    package_update_config_t config = {
+        .recv = request_recv,
+        .recv_ctx = req,
+        .size = req->content_len,
+    };
+    package_update_result_t result;
+    esp_err_t err = package_update_run(&config, &result);
+    int64_t completed_us = esp_timer_get_time();
+    err = send_update_result(req, err, &result);
+    if (err == ESP_OK) {
+        update_restart_after_response(req, completed_us);
+    }
+    httpd_req_async_handler_complete(req);
+    upload_active = false;
+}
+
+// Handles the firmware update request (whole package in one POST, not resumable). The upload
+// runs on the update worker, so the server keeps serving pages and /update_status meanwhile.
+static esp_err_t package_upload_handler(httpd_req_t *req) {
+    if (update_session_active()) {
+        return send_update_busy(req);
+    }
+    esp_err_t err = update_worker_submit(req, package_upload_job);
+    if (err == ESP_ERR_INVALID_STATE) {
+        return send_update_busy(req);
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start update");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// POST /update/init {"id": "...", "size": N} -> {"offset": N}: where the upload continues
+static esp_err_t update_init_handler(httpd_req_t *req) {
+    if (update_worker_busy()) {
+        return send_update_busy(req);
+    }
+
+    char body[160];
+    if (req->content_len >= sizeof(body)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    // The body may arrive in several pieces on a slow link; a few receive timeouts are retried
+    size_t received = 0;
+    int timeouts = 0;
+    while (received < req->content_len) {
+        int recv_len = httpd_req_recv(req, body + received, req->content_len - received);
+        if (recv_len == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= 3) {
+            continue;
+        }
+        if (recv_len <= 0) {
+            ESP_LOGW(TAG, "Init receive failed (%d)", recv_len);
             return ESP_FAIL;
         }
+        received += recv_len;
+    }
+    body[received] = '\0';
+
+    cJSON *root = cJSON_Parse(body);
+    cJSON *id = cJSON_GetObjectItem(root, "id");
+    cJSON *size = cJSON_GetObjectItem(root, "size");
+    uint32_t offset = 0;
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (cJSON_IsString(id) && cJSON_IsNumber(size) && size->valuedouble > 0 && size->valuedouble <= UINT32_MAX) {
+        err = update_session_init(id->valuestring, (uint32_t)size->valuedouble, &offset);
+    }
+    cJSON_Delete(root);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, err == ESP_ERR_INVALID_ARG ? HTTPD_400_BAD_REQUEST : HTTPD_500_INTERNAL_SERVER_ERROR,
+                            "Failed to start upload");
+        return ESP_FAIL;
+    }
+    return send_session_offset(req, "200 OK");
+}
 
-        // Track bytes written per file
-        uint32_t file_written = 0;
-        uint32_t file_remaining = file_size;
-
-        while (file_written < file_size) {
-            recv_len = httpd_req_recv(req, write_buffer, MIN(file_remaining, WRITE_BLOCK_SIZE));
-            
-            if (recv_len <= 0) {
-                ESP_LOGE(TAG, "File upload error: %s", filepath);
-                fclose(file);
-                remove(filepath);
-                free(write_buffer);
-                return ESP_FAIL;
-            }
-
-            fwrite(write_buffer, 1, recv_len, file);
-            file_written += recv_len;
-            file_remaining -= recv_len;
-            remaining -= recv_len;
-
-            ESP_LOGI(TAG, "Writing LittleFS file: %s, Remaining: %d bytes", filepath, file_remaining);
+// The `offset` query parameter of a chunk request
+static bool chunk_offset(httpd_req_t *req, uint32_t *offset) {
+    char query[32];
+    char value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "offset", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    *offset = strtoul(value, NULL, 10);
+    return true;
+}
+
+// Worker job for /update/chunk: the session task may fall behind on flash writes, so handing it the
+// chunk can block; that waits here instead of on the HTTP server task
+static void update_chunk_job(httpd_req_t *req) {
+    uint32_t offset = 0;
+    chunk_offset(req, &offset);     // Checked by the handler
+    bool close = true;              // A failed chunk ends the connection, as a failing handler does
+
+    char buffer[1024];
+    size_t remaining = req->content_len;
+    while (remaining > 0) {
+        int recv_len = httpd_req_recv(req, buffer, MIN(remaining, sizeof(buffer)));
+        if (recv_len <= 0) {
+            // Whatever arrived is kept; the client asks /update/init where to continue
+            ESP_LOGW(TAG, "Chunk receive failed (%d) at offset %" PRIu32, recv_len, update_session_offset());
+            break;
+        }
+        esp_err_t err = update_session_write(offset, buffer, recv_len);
+        if (err == ESP_ERR_INVALID_SIZE) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Chunk past the end of the package");
+            break;
         }
+        if (err != ESP_OK) {
+            // The update stopped on its own: report why
+            package_update_result_t result;
+            err = update_session_commit(&result);
+            send_update_result(req, err, &result);
+            break;
+        }
+        offset += recv_len;
+        remaining -= recv_len;
+    }
+    if (remaining == 0) {
+        close = send_session_offset(req, "200 OK") != ESP_OK;
+    }
+    if (close) {
+        httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+    }
+    httpd_req_async_handler_complete(req);
+}
 
-        fclose(file);
-        ESP_LOGI(TAG, "Successfully wrote file: %s (%" PRIu32 " bytes)", filepath, (uint32_t)file_written);
+// POST /update/chunk?offset=N with package bytes -> {"offset": N}. A chunk that does not start at the
+// expected offset gets 409 and the offset to continue from. The body is received on the update worker;
+// while it still handles the previous chunk the answer is 503, and the client sends the chunk again.
+static esp_err_t update_chunk_handler(httpd_req_t *req) {
+    uint32_t offset;
+    if (!chunk_offset(req, &offset)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing offset");
+        return ESP_FAIL;
+    }
+    if (!update_session_active()) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No upload in progress");
+        return ESP_FAIL;
+    }
+    if (offset != update_session_offset()) {
+        return send_session_offset(req, "409 Conflict");
     }
 
-    // Free memory and confirm update
-    free(write_buffer);
-    httpd_resp_sendstr(req, "Update complete! Device rebooting...");
+    esp_err_t err = update_worker_submit(req, update_chunk_job);
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        send_session_offset(req, "503 Service Unavailable");
+        return ESP_FAIL;    // The chunk was not read; closing the connection drops it
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive chunk");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
 
-    // **Reboot after everything is done**
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    esp_restart();
+// Worker job for /update/commit: waits for the last chunk to be applied, then reboots into the new firmware
+static void update_commit_job(httpd_req_t *req) {
+    package_update_result_t result;
+    esp_err_t err = update_session_commit(&result);
+    int64_t completed_us = esp_timer_get_time();
+    if (err == ESP_ERR_INVALID_STATE || err == ESP_ERR_INVALID_SIZE) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, err == ESP_ERR_INVALID_STATE ? "No upload in progress" : "Upload incomplete");
+    } else {
+        err = send_update_result(req, err, &result);
+    }
+    if (err == ESP_OK) {
+        update_restart_after_response(req, completed_us);
+    }
+    httpd_req_async_handler_complete(req);
+}
 
+// POST /update/commit: the final writes and checks can take a while, so they wait on the worker
+static esp_err_t update_commit_handler(httpd_req_t *req) {
+    esp_err_t err = update_worker_submit(req, update_commit_job);
+    if (err == ESP_ERR_INVALID_STATE) {
+        return send_update_busy(req);
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start update");
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
-/************************************/
+// GET /update_status -> {"state": "idle"|"upload"|"chunked", "received": N, "size": N, "phase": ..., ...}
+// The update fields come from the telemetry record of the current (or last) update; after an update
+// restart the timings of that restart are added.
+static esp_err_t update_status_handler(httpd_req_t *req) {
+    update_telemetry_t t;
+    update_telemetry_snapshot(&t);
+
+    const char *state = "idle";
+    uint32_t received = 0;
+    uint32_t size = 0;
+    if (update_session_active()) {
+        state = "chunked";
+        received = update_session_offset();
+        size = update_session_size();
+    } else if (upload_active) {
+        state = "upload";
+        received = t.received;
+        size = t.size;
+    }
 
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "state", state);
+    cJSON_AddNumberToObject(root, "received", received);
+    cJSON_AddNumberToObject(root, "size", size);
+    cJSON_AddStringToObject(root, "phase", update_telemetry_phase_name(t.phase));
+    cJSON_AddNumberToObject(root, "flashed", t.flashed);
+    cJSON_AddStringToObject(root, "file", t.file);
+    cJSON_AddNumberToObject(root, "files_written", t.files_written);
+    cJSON_AddNumberToObject(root, "files_skipped", t.files_skipped);
+    cJSON_AddNumberToObject(root, "recv_ms", t.recv_ms);
+    cJSON_AddNumberToObject(root, "flash_ms", t.flash_ms);
+    cJSON_AddNumberToObject(root, "elapsed_ms", t.elapsed_ms);
+    if (t.error != ESP_OK) {
+        cJSON_AddStringToObject(root, "error", t.message ? t.message : esp_err_to_name(t.error));
+    }
+    update_restart_stats_t restart;
+    if (update_restart_last(&restart)) {
+        cJSON_AddNumberToObject(root, "reboot_ms", restart.shutdown_ms + restart.boot_ms);
+        cJSON_AddNumberToObject(root, "shutdown_ms", restart.shutdown_ms);
+        cJSON_AddBoolToObject(root, "response_delivered", restart.response_delivered);
+    }
+    char *json_response = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json_response) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
 
-static esp_err_t css_get_handler(httpd_req_t *req) {
-    return file_get_handler(req, MOUNT_POINT "/styles.css", "text/css");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_sendstr(req, json_response);
+    cJSON_free(json_response);
+    return ESP_OK;
 }
 
-static esp_err_t firmware_update_html_get_handler(httpd_req_t *req) {
-    return file_get_handler(req, MOUNT_POINT "/firmware-update.html", "text/html");
+/************************************/
+
+
+// true if the bundle, the web bank or the embedded UI holds `uri`
+static bool static_file_exists(const char *uri) {
+    asset_bundle_file_t bundled;
+    char file_path[128];
+    struct stat st;
+    snprintf(file_path, sizeof(file_path), MOUNT_POINT "%s", uri);
+    return asset_bundle_find(uri + 1, &bundled) || embedded_asset_find(uri) || stat(file_path, &st) == 0;
 }
 
-static esp_err_t firmware_update_js_get_handler(httpd_req_t *req) {
-    return file_get_handler(req, MOUNT_POINT "/firmware-update.js", "application/javascript");
+// GET /* -> static files. A path is looked up in the bundle, the web bank and the embedded UI, so a
+// file shipped in a package is served without a firmware change or a handler of its own. "/" is the
+// UI's index page and other paths ending in "/" serve WEB_DIRECTORY_INDEX; a directory requested
+// without the slash is redirected to it, so that the relative links in its index resolve.
+static esp_err_t static_get_handler(httpd_req_t *req) {
+    char uri[100];
+    size_t uri_len = strcspn(req->uri, "?#");
+    if (uri_len == 0 || uri_len + strlen(WEB_DIRECTORY_INDEX) >= sizeof(uri) || req->uri[0] != '/') {
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    }
+    memcpy(uri, req->uri, uri_len);
+    uri[uri_len] = '\0';
+    if (strstr(uri, "/.") || (uri_len > strlen(".tmp") && strcmp(uri + uri_len - strlen(".tmp"), ".tmp") == 0)) {
+        // Nothing outside MOUNT_POINT, no hidden files (the manifest is read through /asset_manifest)
+        // and no partly written files of an update
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    }
+
+    bool directory = uri[uri_len - 1] == '/';
+    if (strcmp(uri, "/") == 0) {
+        strcpy(uri, WEB_UI_INDEX);
+    } else if (directory) {
+        strcat(uri, WEB_DIRECTORY_INDEX);
+    }
+
+    const embedded_asset_t *embedded = embedded_asset_find(uri);
+    char file_path[128];
+    snprintf(file_path, sizeof(file_path), MOUNT_POINT "%s", uri);
+    esp_err_t err = file_get_handler(req, file_path, embedded ? embedded->mime_type : mime_type_for_path(uri), embedded);
+    if (err != ESP_ERR_NOT_FOUND) {
+        return err;
+    }
+
+    char index_uri[sizeof(uri) + sizeof("/" WEB_DIRECTORY_INDEX)];
+    snprintf(index_uri, sizeof(index_uri), "%s/" WEB_DIRECTORY_INDEX, uri);
+    if (!directory && static_file_exists(index_uri)) {
+        char location[sizeof(uri) + 1];
+        snprintf(location, sizeof(location), "%s/", uri);
+        httpd_resp_set_status(req, "301 Moved Permanently");
+        httpd_resp_set_hdr(req, "Location", location);
+        return httpd_resp_send(req, NULL, 0);
+    }
+    ESP_LOGD(TAG, "No static file for %s", uri);
+    httpd_resp_send_404(req);
+    return ESP_OK;
 }
 
 // Handler for firmware version endpoint (returns JSON)
@@ -316,32 +888,131 @@ static esp_err_t version_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// GET /running_firmware.bin -> the running app image, for backing it up or for flashing another
+// device; supports Range requests so an interrupted download can be resumed
+static esp_err_t running_firmware_handler(httpd_req_t *req)
+{
+    static uint32_t image_len;      // The running image does not change until the next boot
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    if (image_len == 0) {
+        const esp_partition_pos_t pos = { .offset = running->address, .size = running->size };
+        esp_image_metadata_t metadata;
+        if (esp_image_get_metadata(&pos, &metadata) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read the firmware image");
+            return ESP_FAIL;
+        }
+        image_len = metadata.image_len;
+    }
+
+    char etag[2 * ETAG_HASH_BYTES + 3];
+    format_etag(esp_app_get_description()->app_elf_sha256, etag);
+    if (etag_matches(req, etag)) {
+        return send_not_modified(req, "application/octet-stream", etag);
+    }
+
+    body_source_t source = { .partition = running, .size = image_len };
+    return send_asset(req, &source, "application/octet-stream", false, etag,
+                      "Content-Disposition: attachment; filename=\"firmware.bin\"\r\n");
+}
+
+// GET /asset_cache -> hit/miss counters of the in-RAM asset cache, for sizing ASSET_CACHE_BUDGET
+static esp_err_t asset_cache_handler(httpd_req_t *req)
+{
+    asset_cache_stats_t stats;
+    asset_cache_get_stats(&stats);
+
+    char json_response[256];
+    snprintf(json_response, sizeof(json_response),
+             "{\"budget\": %" PRIu32 ", \"used\": %" PRIu32 ", \"entries\": %" PRIu32 ", \"hits\": %" PRIu32
+             ", \"misses\": %" PRIu32 ", \"evictions\": %" PRIu32 ", \"stale\": %" PRIu32 ", \"uncacheable\": %" PRIu32 "}",
+             stats.budget, stats.used, stats.entries, stats.hits, stats.misses, stats.evictions, stats.stale, stats.uncacheable);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_sendstr(req, json_response);
+    return ESP_OK;
+}
+
+// Handler for the asset manifest endpoint: the content hashes the update handler uses to skip
+// unchanged files, so a client can leave those files out of the package altogether
+static esp_err_t asset_manifest_handler(httpd_req_t *req)
+{
+    asset_manifest_t *manifest = asset_manifest_load(ASSET_MANIFEST_PATH);
+    cJSON *root = cJSON_CreateObject();
+    cJSON *files = cJSON_AddArrayToObject(root, "files");
+    if (!manifest || !files) {
+        asset_manifest_destroy(manifest);
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    for (asset_manifest_entry_t *entry = manifest->entries; entry; entry = entry->next) {
+        char sha256_hex[ASSET_MANIFEST_SHA256_LEN * 2 + 1];
+        for (int i = 0; i < ASSET_MANIFEST_SHA256_LEN; i++) {
+            sprintf(sha256_hex + 2 * i, "%02x", entry->sha256[i]);
+        }
+        cJSON *file = cJSON_CreateObject();
+        cJSON_AddStringToObject(file, "name", entry->name);
+        cJSON_AddNumberToObject(file, "size", entry->size);
+        cJSON_AddStringToObject(file, "sha256", sha256_hex);
+        cJSON_AddItemToArray(files, file);
+    }
+    asset_manifest_destroy(manifest);
+
+    char *json_response = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json_response) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json_response);
+    cJSON_free(json_response);
+    return ESP_OK;
+}
+
 /* URI handlers */
-static httpd_uri_t styles_css_uri = {
-    .uri       = "/styles.css",
+// Matches every GET the API handlers below do not; registered last, since the first match wins
+static httpd_uri_t static_files_uri = {
+    .uri       = "/*",
     .method    = HTTP_GET,
-    .handler   = css_get_handler,
+    .handler   = static_get_handler,
     .user_ctx  = NULL
 };
 
-static httpd_uri_t firmware_update_html_uri = {
-    .uri       = "/",
-    .method    = HTTP_GET,
-    .handler   = firmware_update_html_get_handler,
+httpd_uri_t update_firmware_uri = {
+    .uri       = "/update_firmware",
+    .method    = HTTP_POST,
+    .handler   = package_upload_handler,
     .user_ctx  = NULL
 };
 
-static httpd_uri_t firmware_update_js_uri = {
-    .uri       = "/firmware-update.js",
-    .method    = HTTP_GET,
-    .handler   = firmware_update_js_get_handler,
+httpd_uri_t update_init_uri = {
+    .uri       = "/update/init",
+    .method    = HTTP_POST,
+    .handler   = update_init_handler,
     .user_ctx  = NULL
 };
 
-httpd_uri_t update_firmware_uri = {
-    .uri       = "/update_firmware",
+httpd_uri_t update_chunk_uri = {
+    .uri       = "/update/chunk",
     .method    = HTTP_POST,
-    .handler   = package_upload_handler,
+    .handler   = update_chunk_handler,
+    .user_ctx  = NULL
+};
+
+httpd_uri_t update_commit_uri = {
+    .uri       = "/update/commit",
+    .method    = HTTP_POST,
+    .handler   = update_commit_handler,
+    .user_ctx  = NULL
+};
+
+httpd_uri_t update_status_uri = {
+    .uri       = "/update_status",
+    .method    = HTTP_GET,
+    .handler   = update_status_handler,
     .user_ctx  = NULL
 };
 
@@ -352,6 +1023,27 @@ httpd_uri_t version = {
     .user_ctx  = NULL
 };
 
+httpd_uri_t running_firmware_uri = {
+    .uri       = "/running_firmware.bin",
+    .method    = HTTP_GET,
+    .handler   = running_firmware_handler,
+    .user_ctx  = NULL
+};
+
+httpd_uri_t asset_cache_uri = {
+    .uri       = "/asset_cache",
+    .method    = HTTP_GET,
+    .handler   = asset_cache_handler,
+    .user_ctx  = NULL
+};
+
+httpd_uri_t asset_manifest_uri = {
+    .uri       = "/asset_manifest",
+    .method    = HTTP_GET,
+    .handler   = asset_manifest_handler,
+    .user_ctx  = NULL
+};
+
 /* Function to generate unique SSID */
 void generate_unique_ssid(char *ssid, size_t ssid_len) {
     uint8_t mac[6];
@@ -461,19 +1153,37 @@ httpd_handle_t start_webserver(void) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 
     // Increase the maximum number of URI handlers
-    config.max_uri_handlers = 20;  // Increase from default (8) to accommodate all our endpoints
+    config.max_uri_handlers = 20;  // Increase from default (8) to accommodate the API endpoints; static files share one route
+    config.uri_match_fn = httpd_uri_match_wildcard;  // For the "/*" static file route
 
     httpd_handle_t server = NULL;
 
-    if (httpd_start(&server, &config) == ESP_OK) {
-        // Register the URI handlers for files
-        httpd_register_uri_handler(server, &styles_css_uri);
-        httpd_register_uri_handler(server, &firmware_update_html_uri);
-        httpd_register_uri_handler(server, &firmware_update_js_uri);
+    // ETags of the served files; without a manifest the files are served without one
+    served_manifest = asset_manifest_load(ASSET_MANIFEST_PATH);
+    asset_bundle_map_active();
+    if (asset_cache_init(ASSET_CACHE_BUDGET) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up the asset cache");
+    }
 
+    // Package uploads run here instead of on the server task
+    if (update_worker_start() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start update worker");
+    }
+
+    if (httpd_start(&server, &config) == ESP_OK) {
         // Register API endpoint handlers
         httpd_register_uri_handler(server, &update_firmware_uri);
+        httpd_register_uri_handler(server, &update_init_uri);
+        httpd_register_uri_handler(server, &update_chunk_uri);
+        httpd_register_uri_handler(server, &update_commit_uri);
+        httpd_register_uri_handler(server, &update_status_uri);
         httpd_register_uri_handler(server, &version);
+        httpd_register_uri_handler(server, &asset_manifest_uri);
+        httpd_register_uri_handler(server, &asset_cache_uri);
+        httpd_register_uri_handler(server, &running_firmware_uri);
+
+        // Web assets, after the API so it does not shadow it
+        httpd_register_uri_handler(server, &static_files_uri);
 
         ESP_LOGI(TAG, "Web server started");
     } else {
@@ -0,0 +1,71 @@
+import argparse
+import gzip
+import hashlib
+import os
+import shutil
+
+# Precompressed web assets: the device serves "<name>.gz" with Content-Encoding: gzip to clients
+# that accept it, and "<name>" to the others. Used by the build (web_1 image) and by the packager.
+# The build also writes the asset manifest, so the device has ETags for a freshly flashed image.
+
+GZIP_EXTENSIONS = {".html", ".htm", ".js", ".mjs", ".css", ".json", ".svg", ".txt", ".xml", ".map", ".ico"}
+GZIP_MIN_SAVING = 0.1  # Keep a variant only if it is at least this much smaller than the file
+MANIFEST_NAME = ".asset_manifest"  # Content hashes of the files on the partition (include/asset_manifest.h); the device derives ETags from them
+
+def gzip_variant(name, data):
+    """ Returns the .gz variant of an asset, or None if it is not worth storing.
+
+    The output only depends on the content (no name, mtime 0), so an unchanged asset yields an
+    unchanged variant and both are left out of --only-changed packages together.
+    """
+    if name.endswith(".gz") or os.path.splitext(name)[1].lower() not in GZIP_EXTENSIONS:
+        return None
+    compressed = gzip.compress(data, compresslevel=9, mtime=0)
+    if len(compressed) > len(data) * (1 - GZIP_MIN_SAVING):
+        return None
+    return compressed
+
+def manifest_line(name, data):
+    """ One "<sha256 hex> <size> <name>" line of the device's asset manifest """
+    return f"{hashlib.sha256(data).hexdigest()} {len(data)} {name}\n"
+
+def stage_web_assets(source_folder, output_folder):
+    """ Copies source_folder to output_folder, writes the .gz variants next to the files and the
+        asset manifest that covers them all """
+    if os.path.isdir(output_folder):
+        shutil.rmtree(output_folder)
+    os.makedirs(output_folder)
+    manifest = []
+    raw_total = gzip_total = 0
+    for root, _, files in os.walk(source_folder):
+        for file in sorted(files):
+            source_path = os.path.join(root, file)
+            relative_path = os.path.relpath(source_path, source_folder)
+            output_path = os.path.join(output_folder, relative_path)
+            os.makedirs(os.path.dirname(output_path), exist_ok=True)
+            with open(source_path, "rb") as f:
+                data = f.read()
+            with open(output_path, "wb") as f:
+                f.write(data)
+            name = relative_path.replace(os.sep, "/")
+            manifest.append(manifest_line(name, data))
+
+            compressed = gzip_variant(relative_path, data) if file + ".gz" not in files else None
+            if compressed is not None:
+                with open(output_path + ".gz", "wb") as f:
+                    f.write(compressed)
+                manifest.append(manifest_line(name + ".gz", compressed))
+                raw_total += len(data)
+                gzip_total += len(compressed)
+                print(f"Precompressed {relative_path}: {len(data)} -> {len(compressed)} bytes")
+    with open(os.path.join(output_folder, MANIFEST_NAME), "w", newline="\n") as f:
+        f.writelines(manifest)
+    if raw_total:
+        print(f"Precompressed assets: {raw_total} -> {gzip_total} bytes ({100 - gzip_total * 100 // raw_total}% smaller)")
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Stage the web assets with precompressed .gz variants for the LittleFS image")
+    parser.add_argument("source_folder", help="Folder with the web assets (html/)")
+    parser.add_argument("output_folder", help="Folder to create; replaced if it exists")
+    args = parser.parse_args()
+    stage_web_assets(args.source_folder, args.output_folder)